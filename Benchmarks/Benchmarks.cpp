@@ -0,0 +1,350 @@
+#include "stdafx.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include "Utils.hpp"
+#include "AllocationTracker.hpp"
+#include "TextTable.hpp"
+#include "Messages.hpp"
+#include "MessagesFile.hpp"
+#include "ColumnarMessages.hpp"
+#include "Switches.hpp"
+
+//##############################################################################
+// CBenchmarks
+//##############################################################################
+//! Runs each benchmark in timed trials and collects the results.  A trial
+//! repeats the operation, in batches that double in size, until it has taken
+//! at least the minimum trial time, and the result of a benchmark is the
+//! median of its trials, so that a run is little affected by other activity
+//! on the machine.  Every operation returns a value that is accumulated into a
+//! sink, so that the compiler cannot drop the work.
+//##############################################################################
+
+namespace {
+
+class CBenchmarks {
+public:
+    struct CResult {
+        std::string Name;
+        uint64_t    Operations;  // In the median trial
+        double      NsPerOp;
+        double      MBPerS;      // Zero if the operation has no byte count
+        double      AllocsPerOp;
+    };
+
+    CBenchmarks(const std::string &filter) : mFilter(filter), mSink(0) {}
+
+    template <typename TOperation>
+    void Run(const std::string &name, size_t bytes, TOperation operation);
+
+    const std::vector<CResult> &Results() const { return mResults; }
+    void Show(std::ostream &stream) const;
+    void Json(std::ostream &stream) const;
+
+private:
+    static const size_t NTrials = 5;
+    static const std::chrono::milliseconds TrialTime;
+
+    std::string          mFilter;     // Prefix of the benchmarks to run
+    std::vector<CResult> mResults;
+    size_t               mSink;
+};
+
+const std::chrono::milliseconds CBenchmarks::TrialTime(100);
+
+//------------------------------------------------------------------------------
+//! Function times an operation that processes the specified number of bytes,
+//! or none, and returns a value for the sink, unless its name does not begin
+//! with the filter.
+//
+template <typename TOperation>
+void CBenchmarks::Run(const std::string &name, size_t bytes,
+    TOperation operation) {
+    typedef std::chrono::steady_clock CClock;
+    if (name.compare(0, mFilter.size(), mFilter) != 0)
+        return;
+
+    mSink += operation(); // Warm up caches and buffers
+    std::vector<CResult> Trials;
+    for (size_t Trial = 0; Trial < NTrials; ++Trial) {
+        uint64_t NOperations = 0;
+        uint64_t Batch = 1;
+        uint64_t Allocations = CAllocationTracker::Allocations();
+        CClock::time_point Start = CClock::now();
+        CClock::duration Elapsed;
+        do {
+            for (uint64_t Ix = 0; Ix < Batch; ++Ix)
+                mSink += operation();
+            NOperations += Batch;
+            Batch *= 2;
+            Elapsed = CClock::now() - Start;
+        } while (Elapsed < TrialTime);
+        Allocations = CAllocationTracker::Allocations() - Allocations;
+
+        double Ns = static_cast<double>(std::chrono::duration_cast<
+            std::chrono::nanoseconds>(Elapsed).count());
+        CResult Result;
+        Result.Name = name;
+        Result.Operations = NOperations;
+        Result.NsPerOp = Ns / NOperations;
+        Result.MBPerS = (bytes == 0) ? 0.0
+            : static_cast<double>(bytes) * NOperations * 1000.0 / Ns;
+        Result.AllocsPerOp = static_cast<double>(Allocations) / NOperations;
+        Trials.push_back(Result);
+    }
+    std::sort(Trials.begin(), Trials.end(),
+        [](const CResult &a, const CResult &b) {
+        return a.NsPerOp < b.NsPerOp;
+    });
+    mResults.push_back(Trials[NTrials / 2]);
+}
+
+//------------------------------------------------------------------------------
+//! Function writes the results as a table.
+//
+void CBenchmarks::Show(std::ostream &stream) const {
+    stream << std::left << std::setw(32) << "Benchmark" << std::right
+        << std::setw(14) << "ns/op" << std::setw(12) << "MB/s"
+        << std::setw(12) << "allocs/op" << std::endl;
+    for (const CResult &Result : mResults) {
+        stream << std::left << std::setw(32) << Result.Name << std::right
+            << std::fixed << std::setprecision(1) << std::setw(14)
+            << Result.NsPerOp << std::setw(12);
+        if (Result.MBPerS > 0.0)
+            stream << Result.MBPerS;
+        else
+            stream << "-";
+        stream << std::setprecision(2) << std::setw(12)
+            << Result.AllocsPerOp << std::endl;
+    }
+}
+
+//------------------------------------------------------------------------------
+//! Function writes the results as a JSON document.  Benchmark names contain
+//! no characters that need escaping.
+//
+void CBenchmarks::Json(std::ostream &stream) const {
+    stream << "{" << std::endl << "  \"benchmarks\": [" << std::endl;
+    for (size_t Ix = 0; Ix < mResults.size(); ++Ix) {
+        const CResult &Result = mResults[Ix];
+        stream << "    { \"name\": \"" << Result.Name << "\", "
+            << "\"operations\": " << Result.Operations << ", " << std::fixed
+            << std::setprecision(3) << "\"ns_per_op\": " << Result.NsPerOp
+            << ", \"mb_per_s\": " << Result.MBPerS << ", \"allocs_per_op\": "
+            << Result.AllocsPerOp << " }"
+            << (Ix + 1 < mResults.size() ? "," : "") << std::endl;
+    }
+    stream << "  ]," << std::endl << "  \"sink\": " << mSink << std::endl
+        << "}" << std::endl;
+}
+
+//------------------------------------------------------------------------------
+//! Function fills a catalog with messages with a mix of ASCII, accented and
+//! non-Latin text, the same on every run.
+//
+void CatalogMake(size_t nmessages, CMessages &messages) {
+    for (size_t Ix = 0; Ix < nmessages; ++Ix) {
+        CMessage Message;
+        std::wstring Number(std::to_wstring(Ix));
+        Message.Name(L"Message" + Number);
+        Message.Description(L"Description of message " + Number +
+            L", with a \"quoted\" word");
+        Message.Translate((Ix % 11 == 0) ? L'F' : L'T');
+        Message.TranslationAdd(L"The file " + Number + L" could not be "
+            L"opened.");
+        Message.TranslationAdd(L"Die Datei " + Number + L" konnte nicht "
+            L"ge\x00f6" L"ffnet werden.");
+        Message.TranslationAdd(L"Le fichier " + Number + L" n'a pas pu "
+            L"\x00ea" L"tre ouvert.");
+        Message.TranslationAdd(L"\x0424\x0430\x0439\x043b " + Number +
+            L" \x043d\x0435 \x043e\x0442\x043a\x0440\x044b\x0442.");
+        messages.MessageAdd(Message);
+    }
+}
+
+} // namespace
+
+//------------------------------------------------------------------------------
+//! Times the parsing, conversion, checksum, translation and loading functions
+//! on fixed data, and reports the time and allocations of each operation and
+//! its throughput:
+//!
+//!   Benchmarks [-i Messages.txt] [-o Results.json] [-f <name prefix>] [-v]
+//!
+//! The data are made up by the program, apart from the file loaded end to
+//! end, which is an in-memory file of 1000 made up messages unless -i names
+//! one.  Results are written as a table, and also as JSON with -o.
+//
+int main(int argc, char** argv) {
+    static const CSwitchSpec SwitchSpecs[] = {
+        { "-f",    ESwitchID::Filter,  1, 1 },
+        { "-h",    ESwitchID::Help,    0, 0 },
+        { "-?",    ESwitchID::Help,    0, 0 },
+        { "-i",    ESwitchID::Input,   1, 1 },
+        { "-o",    ESwitchID::Output,  1, 1 },
+        { "-v",    ESwitchID::Verbose, 0, 0 },
+        { nullptr, ESwitchID::None,    0, 0 } // Terminator
+    };
+
+    int ExitCode = 0;
+    CSwitches Switches(SwitchSpecs);
+
+    try {
+        Switches.ExecPath(argv[0]);
+        for (int Ix = 1; Ix < argc; ++Ix)
+            Switches.ItemAdd(argv[Ix]);
+        Switches.Check();
+        if (Switches.Exists(ESwitchID::Help)) {
+            std::cout << "Usage: Benchmarks [-i <messages file>] "
+                "[-o <JSON file>] [-f <name prefix>] [-v]" << std::endl;
+            return 0;
+        }
+        if (Switches.Exists(ESwitchID::Verbose))
+            Switches.Show();
+        CAllocationTracker::Enable(true); // For allocations per operation
+
+        std::vector<std::string> Parameters;
+        std::string Filter;
+        if (Switches.Parameters(ESwitchID::Filter, Parameters))
+            Filter = Parameters[0];
+        CBenchmarks Benchmarks(Filter);
+
+        // Text tables
+        CMessages Messages({ L"English", L"German", L"French", L"Russian" });
+        CatalogMake(1000, Messages);
+        const CMessage &Sample = Messages.Message(7);
+        std::vector<std::wstring> Values = { Sample.Name(),
+            Sample.Description(), std::wstring(1, Sample.Translate()) };
+        Values.insert(Values.end(), Sample.Translations().begin(),
+            Sample.Translations().end());
+        CTextTable Table;
+        Table.Add(Values);
+        std::wstring Line(Table.Line());
+        size_t LineBytes = Line.size() * sizeof(wchar_t);
+        Benchmarks.Run("TextTable.Add", LineBytes, [&]() {
+            Table.Clear();
+            Table.Add(Values);
+            return Table.Line().size();
+        });
+        std::vector<std::wstring> Parsed;
+        Benchmarks.Run("TextTable.Parse", LineBytes, [&]() {
+            Table.Parse(Line, Parsed);
+            return Parsed.size();
+        });
+        std::vector<CTextField> Fields;
+        std::wstring Scratch;
+        Benchmarks.Run("TextTable.ParseFields", LineBytes, [&]() {
+            Table.Parse(Line.data(), Line.size(), Fields, Scratch);
+            return Fields.size();
+        });
+
+        // UTF-8 conversion of all the translations of a message
+        std::wstring Wide;
+        for (const std::wstring &Translation : Sample.Translations())
+            Wide += Translation;
+        std::string Utf8(WStrToUtf8(Wide));
+        std::wstring WideResult;
+        std::string Utf8Result;
+        Benchmarks.Run("Utf8ToWStr", Utf8.size(), [&]() {
+            Utf8ToWStr(Utf8.data(), Utf8.size(), WideResult);
+            return WideResult.size();
+        });
+        Benchmarks.Run("WStrToUtf8", Utf8.size(), [&]() {
+            WStrToUtf8(Wide.data(), Wide.size(), Utf8Result);
+            return Utf8Result.size();
+        });
+        Benchmarks.Run("Utf8Check", Utf8.size(), [&]() {
+            Utf8Check(Utf8.data(), Utf8.size());
+            return Utf8.size();
+        });
+
+        // Checksums of a 4 KB buffer
+        std::vector<uint8_t> Buffer(4096);
+        for (size_t Ix = 0; Ix < Buffer.size(); ++Ix)
+            Buffer[Ix] = static_cast<uint8_t>(Ix * 131 + (Ix >> 8));
+        Benchmarks.Run("ModbusCRC.AddByte", Buffer.size(), [&]() {
+            CModbusCRC CRC;
+            for (uint8_t Byte : Buffer)
+                CRC.Add(Byte);
+            return static_cast<size_t>(CRC.Value());
+        });
+        Benchmarks.Run("ModbusCRC.AddBuffer", Buffer.size(), [&]() {
+            CModbusCRC CRC;
+            CRC.Add(Buffer.data(), static_cast<uint32_t>(Buffer.size()));
+            return static_cast<size_t>(CRC.Value());
+        });
+
+        // Translations of a whole catalog into one language
+        ELanguage German = Messages.Language(L"German");
+        std::vector<std::wstring> Translations;
+        Messages.Translations(German, Translations);
+        size_t TranslationBytes = 0;
+        for (const std::wstring &Translation : Translations)
+            TranslationBytes += Translation.size() * sizeof(wchar_t);
+        Benchmarks.Run("Messages.Translations", TranslationBytes, [&]() {
+            Messages.Translations(German, Translations);
+            return Translations.size();
+        });
+        Benchmarks.Run("Messages.Lookup", 0, [&]() {
+            return Messages.Lookup(L"Message500", German).size();
+        });
+
+        // Loading a messages file end to end
+        std::string FileText;
+        CMessagesFile MessagesFile;
+        if (Switches.Parameters(ESwitchID::Input, Parameters)) {
+            std::ifstream File(Parameters[0], std::ios::binary);
+            if (!File)
+                throw std::runtime_error("Unable to open \"" +
+                    Parameters[0] + "\".");
+            std::ostringstream Stream;
+            Stream << File.rdbuf();
+            FileText = Stream.str();
+        }
+        else {
+            std::ostringstream Stream;
+            MessagesFile.Save(Stream, Messages);
+            FileText = Stream.str();
+        }
+        Benchmarks.Run("MessagesFile.Load", FileText.size(), [&]() {
+            CMessages Loaded;
+            MessagesFile.Load(FileText.data(), FileText.size(), Loaded);
+            return Loaded.MessageCount();
+        });
+        Benchmarks.Run("MessagesFile.LoadColumns", FileText.size(), [&]() {
+            CColumnarMessages Loaded;
+            MessagesFile.Load(FileText.data(), FileText.size(), Loaded);
+            return Loaded.MessageCount();
+        });
+        Benchmarks.Run("MessagesFile.LoadUtf8Columns", FileText.size(),
+            [&]() {
+            CUtf8ColumnarMessages Loaded;
+            MessagesFile.Load(FileText.data(), FileText.size(), Loaded);
+            return Loaded.MessageCount();
+        });
+
+        Benchmarks.Show(std::cout);
+        if (Switches.Parameters(ESwitchID::Output, Parameters)) {
+            std::ofstream Json(Parameters[0]);
+            if (!Json)
+                throw std::runtime_error("Unable to create \"" +
+                    Parameters[0] + "\".");
+            Benchmarks.Json(Json);
+        }
+    }
+    catch (std::exception &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        ExitCode = -1;
+    }
+
+    return ExitCode;
+}
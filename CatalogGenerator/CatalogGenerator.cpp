@@ -0,0 +1,294 @@
+#include "stdafx.h"
+
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include "TextWriter.hpp"
+#include "Switches.hpp"
+
+//##############################################################################
+// CRandom
+//##############################################################################
+//! Generates pseudo-random numbers by the SplitMix64 algorithm.  Only integer
+//! arithmetic is used, unlike the distributions of <random>, whose results
+//! differ between standard libraries, so a seed gives the same catalog on
+//! every platform.
+//##############################################################################
+
+namespace {
+
+class CRandom {
+public:
+    CRandom(uint64_t seed) : mState(seed) {}
+
+    uint64_t Next();
+    uint64_t Below(uint64_t n) { return Next() % n; }
+    bool     Chance(uint64_t threshold) { return Next() < threshold; }
+
+    static uint64_t Threshold(double ratio);
+
+private:
+    uint64_t mState;
+};
+
+//------------------------------------------------------------------------------
+//! Function returns the next number of the sequence.
+//
+uint64_t CRandom::Next() {
+    uint64_t Z = (mState += 0x9e3779b97f4a7c15ull);
+    Z = (Z ^ (Z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    Z = (Z ^ (Z >> 27)) * 0x94d049bb133111ebull;
+    return Z ^ (Z >> 31);
+}
+
+//------------------------------------------------------------------------------
+//! Static function returns the threshold below which a number occurs with the
+//! specified probability, for Chance().
+//
+uint64_t CRandom::Threshold(double ratio) {
+    if (ratio <= 0.0)
+        return 0;
+    if (ratio >= 1.0)
+        return UINT64_MAX;
+    return static_cast<uint64_t>(ratio * 18446744073709551616.0);
+}
+
+//##############################################################################
+// CCatalogGenerator
+//##############################################################################
+//! Writes a messages file of made up messages.  The length of each text, in
+//! characters, is its minimum plus a geometrically distributed number with
+//! the specified mean, which gives many short texts and a few long ones, as
+//! in real catalogs, and is capped at the maximum.  Each character is, with
+//! the specified probabilities, a delimiter, quote or line break, which all
+//! force quoting, or a non-ASCII character of two, three or four bytes in
+//! UTF-8, and is otherwise a letter or space.  Messages not to be translated
+//! have only a first translation.
+//##############################################################################
+
+class CCatalogGenerator {
+public:
+    CCatalogGenerator(uint64_t seed);
+
+    void Length(size_t minLen, size_t meanLen, size_t maxLen);
+    void Special(double ratio) { mSpecial = CRandom::Threshold(ratio); }
+    void NonAscii(double ratio) { mNonAscii = CRandom::Threshold(ratio); }
+    void Untranslated(double ratio) {
+        mUntranslated = CRandom::Threshold(ratio);
+    }
+
+    uint64_t Write(std::ostream &stream, uint64_t nmessages,
+        size_t nlanguages);
+
+private:
+    CRandom     mRandom;
+    size_t      mMinLen;
+    size_t      mMaxLen;
+    uint64_t    mLonger;       // Threshold to lengthen a text by one more
+    uint64_t    mSpecial;
+    uint64_t    mNonAscii;
+    uint64_t    mUntranslated;
+    std::string mText;
+
+    void TextMake();
+};
+
+//------------------------------------------------------------------------------
+//! Constructor sets the seed, and the default lengths and ratios.
+//
+CCatalogGenerator::CCatalogGenerator(uint64_t seed) : mRandom(seed),
+    mSpecial(CRandom::Threshold(0.01)), mNonAscii(CRandom::Threshold(0.1)),
+    mUntranslated(CRandom::Threshold(0.1)) {
+    Length(1, 24, 200);
+}
+
+//------------------------------------------------------------------------------
+//! Function sets the minimum, mean and maximum lengths of texts.
+//
+void CCatalogGenerator::Length(size_t minLen, size_t meanLen, size_t maxLen) {
+    if (minLen > meanLen || meanLen > maxLen)
+        throw std::runtime_error("The lengths must be in increasing order.");
+    mMinLen = minLen;
+    mMaxLen = maxLen;
+    double Extra = static_cast<double>(meanLen - minLen);
+    mLonger = CRandom::Threshold(Extra / (Extra + 1.0));
+}
+
+//------------------------------------------------------------------------------
+//! Function writes a heading and the specified number of messages with
+//! translations into the specified number of languages, and returns the
+//! number of bytes written.
+//
+uint64_t CCatalogGenerator::Write(std::ostream &stream, uint64_t nmessages,
+    size_t nlanguages) {
+    static const char *Languages[] = { "English", "German", "French",
+        "Spanish", "Italian", "Portuguese", "Dutch", "Russian", "Greek",
+        "Japanese", "Chinese", "Korean" };
+    static const size_t NNamed = sizeof(Languages) / sizeof(*Languages);
+
+    std::streampos Start = stream.tellp();
+    CTextWriter Writer(stream);
+    Writer.Add("Name", 4);
+    Writer.Add("Description", 11);
+    Writer.Add("Type", 4);
+    for (size_t Ix = 0; Ix < nlanguages; ++Ix) {
+        std::string Language(Ix < NNamed ? std::string(Languages[Ix])
+            : "Language" + std::to_string(Ix + 1));
+        Writer.Add(Language.data(), Language.size());
+    }
+    Writer.RecordEnd();
+
+    for (uint64_t Ix = 0; Ix < nmessages; ++Ix) {
+        std::string Name("Message" + std::to_string(Ix));
+        Writer.Add(Name.data(), Name.size());
+        TextMake();
+        Writer.Add(mText.data(), mText.size());
+        bool IsTranslated = !mRandom.Chance(mUntranslated);
+        Writer.Add(IsTranslated ? "T" : "F", 1);
+        for (size_t Iy = 0; Iy < nlanguages; ++Iy) {
+            if (Iy == 0 || IsTranslated)
+                TextMake();
+            else
+                mText.clear();
+            Writer.Add(mText.data(), mText.size());
+        }
+        Writer.RecordEnd();
+    }
+    Writer.Flush();
+    if (!stream)
+        throw std::runtime_error("Unable to write the catalog.");
+    return static_cast<uint64_t>(stream.tellp() - Start);
+}
+
+//------------------------------------------------------------------------------
+//! Private function makes a text in mText, in UTF-8.
+//
+void CCatalogGenerator::TextMake() {
+    static const char Letters[] = "etaoinshrdlucmfwypvbgkqjxz    ";
+    static const char *NonAscii[] = { "\xc3\xa9", "\xc3\xbc", "\xc3\x9f",
+        "\xc3\xa7", "\xd0\x96", "\xd1\x8f", "\xce\xa9", "\xe2\x82\xac",
+        "\xe4\xb8\xad", "\xe6\x96\x87", "\xe3\x81\x82", "\xf0\x9f\x98\x80",
+        "\xf0\x9d\x84\x9e" };
+    static const char Special[] = ",\"\n";
+
+    size_t Len = mMinLen;
+    while (Len < mMaxLen && mRandom.Chance(mLonger))
+        ++Len;
+    mText.clear();
+    for (size_t Ix = 0; Ix < Len; ++Ix) {
+        if (mRandom.Chance(mSpecial))
+            mText += Special[mRandom.Below(sizeof(Special) - 1)];
+        else if (mRandom.Chance(mNonAscii))
+            mText += NonAscii[mRandom.Below(sizeof(NonAscii) /
+                sizeof(*NonAscii))];
+        else
+            mText += Letters[mRandom.Below(sizeof(Letters) - 1)];
+    }
+}
+
+//------------------------------------------------------------------------------
+//! Function returns a switch parameter as a ratio from 0 to 1.
+//
+double Ratio(const std::string &parameter) {
+    double Value = std::stod(parameter);
+    if (Value < 0.0 || Value > 1.0)
+        throw std::runtime_error("Ratio \"" + parameter + "\" is not from 0 "
+            "to 1.");
+    return Value;
+}
+
+} // namespace
+
+//------------------------------------------------------------------------------
+//! Writes a messages file of made up messages, for testing at the sizes of
+//! real catalogs.  The same switches always give the same file:
+//!
+//!   CatalogGenerator [-o Catalog.txt] [-r <rows>] [-l <languages>]
+//!       [-s <seed>] [-w <min> <mean> <max>] [-q <special ratio>]
+//!       [-a <non-ASCII ratio>] [-f <untranslated ratio>] [-v]
+//!
+//! The file is written by CTextWriter, which quotes values by the rules that
+//! CTextTable and CTextPushParser read, so it is always valid input.
+//
+int main(int argc, char** argv) {
+    static const CSwitchSpec SwitchSpecs[] = {
+        { "-a",    ESwitchID::NonAscii,     1, 1 },
+        { "-f",    ESwitchID::Untranslated, 1, 1 },
+        { "-h",    ESwitchID::Help,         0, 0 },
+        { "-?",    ESwitchID::Help,         0, 0 },
+        { "-l",    ESwitchID::Language,     1, 1 },
+        { "-o",    ESwitchID::Output,       1, 1 },
+        { "-q",    ESwitchID::Special,      1, 1 },
+        { "-r",    ESwitchID::Rows,         1, 1 },
+        { "-s",    ESwitchID::Seed,         1, 1 },
+        { "-v",    ESwitchID::Verbose,      0, 0 },
+        { "-w",    ESwitchID::Length,       3, 3 },
+        { nullptr, ESwitchID::None,         0, 0 } // Terminator
+    };
+
+    int ExitCode = 0;
+    CSwitches Switches(SwitchSpecs);
+
+    try {
+        Switches.ExecPath(argv[0]);
+        for (int Ix = 1; Ix < argc; ++Ix)
+            Switches.ItemAdd(argv[Ix]);
+        Switches.Check();
+        if (Switches.Exists(ESwitchID::Help)) {
+            std::cout << "Usage: CatalogGenerator [-o <messages file>] "
+                "[-r <rows>] [-l <languages>] [-s <seed>]" << std::endl
+                << "    [-w <min> <mean> <max>] [-q <special ratio>] "
+                "[-a <non-ASCII ratio>]" << std::endl
+                << "    [-f <untranslated ratio>] [-v]" << std::endl;
+            return 0;
+        }
+        if (Switches.Exists(ESwitchID::Verbose))
+            Switches.Show();
+
+        std::string OutputFileName("Catalog.txt");
+        uint64_t NMessages = 1000;
+        size_t NLanguages = 4;
+        uint64_t Seed = 1;
+        std::vector<std::string> Parameters;
+        if (Switches.Parameters(ESwitchID::Output, Parameters))
+            OutputFileName = Parameters[0];
+        if (Switches.Parameters(ESwitchID::Rows, Parameters))
+            NMessages = std::stoull(Parameters[0]);
+        if (Switches.Parameters(ESwitchID::Language, Parameters))
+            NLanguages = std::stoul(Parameters[0]);
+        if (NLanguages == 0)
+            throw std::runtime_error("There must be at least one language.");
+        if (Switches.Parameters(ESwitchID::Seed, Parameters))
+            Seed = std::stoull(Parameters[0]);
+
+        CCatalogGenerator Generator(Seed);
+        if (Switches.Parameters(ESwitchID::Length, Parameters))
+            Generator.Length(std::stoul(Parameters[0]),
+                std::stoul(Parameters[1]), std::stoul(Parameters[2]));
+        if (Switches.Parameters(ESwitchID::Special, Parameters))
+            Generator.Special(Ratio(Parameters[0]));
+        if (Switches.Parameters(ESwitchID::NonAscii, Parameters))
+            Generator.NonAscii(Ratio(Parameters[0]));
+        if (Switches.Parameters(ESwitchID::Untranslated, Parameters))
+            Generator.Untranslated(Ratio(Parameters[0]));
+
+        std::ofstream File(OutputFileName, std::ios::binary);
+        if (!File)
+            throw std::runtime_error("Unable to create \"" + OutputFileName +
+                "\".");
+        uint64_t Bytes = Generator.Write(File, NMessages, NLanguages);
+        if (Switches.Exists(ESwitchID::Verbose))
+            std::cout << "Wrote " << NMessages << " messages, " << Bytes
+                << " bytes, to \"" << OutputFileName << "\"." << std::endl;
+    }
+    catch (std::exception &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        ExitCode = -1;
+    }
+
+    return ExitCode;
+}
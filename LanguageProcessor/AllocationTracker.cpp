@@ -0,0 +1,440 @@
+#include "stdafx.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <iomanip>
+#include <new>
+#include <ostream>
+#include <sstream>
+
+#include "Arena.hpp"
+#include "AllocationTracker.hpp"
+
+//##############################################################################
+// Allocation functions
+//##############################################################################
+//! If ALLOCATION_TRACKING is defined, the global allocation functions are
+//! replaced so that each block carries a header recording its size and
+//! subsystem, just in front of the memory returned.  The header is a multiple
+//! of the alignment malloc() gives, so the memory that follows it is aligned
+//! as well; for the aligned forms, the memory is moved further into the block
+//! to the alignment requested.
+//##############################################################################
+
+namespace {
+
+struct CCounters {
+    std::atomic<uint64_t> Allocations;
+    std::atomic<uint64_t> Bytes;
+    std::atomic<int64_t>  Current;
+    std::atomic<int64_t>  Peak;
+};
+
+// One set of counters per subsystem, followed by the total.  These are
+// initialized statically, so they may be used before main() is entered.
+const size_t TotalIx = static_cast<size_t>(ESubsystem::Count);
+CCounters sCounters[TotalIx + 1];
+std::atomic<bool> sIsEnabled(false);
+thread_local ESubsystem tSubsystem = ESubsystem::Other;
+
+const char *sSubsystemNames[] = { "Other", "Loader", "TextTable", "UTF-8",
+    "Catalog" };
+static_assert(sizeof(sSubsystemNames) / sizeof(*sSubsystemNames) == TotalIx,
+    "A subsystem has no name.");
+
+#ifdef ALLOCATION_TRACKING
+
+struct CBlockHeader {
+    uint64_t Size;
+    uint16_t Subsystem;
+    uint16_t IsTracked;  // Nonzero if counted when allocated
+    uint32_t Offset;     // Of the memory returned from the start of the block
+};
+
+const size_t HeaderSize = 16;
+static_assert(sizeof(CBlockHeader) <= HeaderSize, "The header is too large.");
+
+//------------------------------------------------------------------------------
+//! Function raises a peak to the specified value, if it is higher.
+//
+void PeakRaise(std::atomic<int64_t> &peak, int64_t value) {
+    int64_t Peak = peak.load(std::memory_order_relaxed);
+    while (value > Peak && !peak.compare_exchange_weak(Peak, value,
+        std::memory_order_relaxed)) {
+    }
+}
+
+//------------------------------------------------------------------------------
+//! Function adds a block to, or with a negative size removes one from, the
+//! bytes held by the set of counters.
+//
+void Hold(CCounters &counters, int64_t size) {
+    int64_t Current = counters.Current.fetch_add(size,
+        std::memory_order_relaxed) + size;
+    if (size > 0)
+        PeakRaise(counters.Peak, Current);
+}
+
+//------------------------------------------------------------------------------
+//! Function allocates a block with its header, returning nullptr on failure.
+//! The memory returned is aligned to the specified power of two, which needs
+//! as many bytes of padding less one.
+//
+void *BlockAllocate(size_t size, size_t alignment = 1) {
+    size_t Padding = alignment - 1;
+    if (alignment > UINT32_MAX - HeaderSize ||
+        size > SIZE_MAX - HeaderSize - Padding)
+        return nullptr;
+    char *pBlock = static_cast<char *>(std::malloc(size + HeaderSize +
+        Padding));
+    if (pBlock == nullptr)
+        return nullptr;
+
+    uintptr_t Start = reinterpret_cast<uintptr_t>(pBlock) + HeaderSize;
+    size_t Offset = HeaderSize + ((alignment - Start % alignment) % alignment);
+    char *pMemory = pBlock + Offset;
+    CBlockHeader *pHeader = reinterpret_cast<CBlockHeader *>(pMemory -
+        HeaderSize);
+    pHeader->Size = size;
+    pHeader->Subsystem = static_cast<uint16_t>(tSubsystem);
+    pHeader->IsTracked = sIsEnabled.load(std::memory_order_relaxed) ? 1 : 0;
+    pHeader->Offset = static_cast<uint32_t>(Offset);
+    if (pHeader->IsTracked) {
+        for (size_t Ix : { static_cast<size_t>(pHeader->Subsystem), TotalIx }) {
+            sCounters[Ix].Allocations.fetch_add(1, std::memory_order_relaxed);
+            sCounters[Ix].Bytes.fetch_add(size, std::memory_order_relaxed);
+            Hold(sCounters[Ix], static_cast<int64_t>(size));
+        }
+    }
+    return pMemory;
+}
+
+//------------------------------------------------------------------------------
+//! Function frees a block allocated by BlockAllocate(), if any.  A block that
+//! was counted is released from its subsystem even if tracking has since been
+//! disabled, so that the bytes held stay correct.
+//
+void BlockFree(void *pmemory) {
+    if (pmemory == nullptr)
+        return;
+    const CBlockHeader *pHeader = reinterpret_cast<CBlockHeader *>(
+        static_cast<char *>(pmemory) - HeaderSize);
+    if (pHeader->IsTracked) {
+        int64_t Size = static_cast<int64_t>(pHeader->Size);
+        Hold(sCounters[pHeader->Subsystem], -Size);
+        Hold(sCounters[TotalIx], -Size);
+    }
+    std::free(static_cast<char *>(pmemory) - pHeader->Offset);
+}
+
+#endif // ALLOCATION_TRACKING
+
+} // namespace
+
+#ifdef ALLOCATION_TRACKING
+
+void *operator new(size_t size) {
+    void *pMemory = BlockAllocate(size);
+    if (pMemory == nullptr)
+        throw std::bad_alloc();
+    return pMemory;
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+    return BlockAllocate(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+    return BlockAllocate(size);
+}
+
+void operator delete(void *pmemory) noexcept {
+    BlockFree(pmemory);
+}
+
+void operator delete[](void *pmemory) noexcept {
+    BlockFree(pmemory);
+}
+
+void operator delete(void *pmemory, size_t) noexcept {
+    BlockFree(pmemory);
+}
+
+void operator delete[](void *pmemory, size_t) noexcept {
+    BlockFree(pmemory);
+}
+
+void operator delete(void *pmemory, const std::nothrow_t &) noexcept {
+    BlockFree(pmemory);
+}
+
+void operator delete[](void *pmemory, const std::nothrow_t &) noexcept {
+    BlockFree(pmemory);
+}
+
+#ifdef __cpp_aligned_new
+
+void *operator new(size_t size, std::align_val_t alignment) {
+    void *pMemory = BlockAllocate(size, static_cast<size_t>(alignment));
+    if (pMemory == nullptr)
+        throw std::bad_alloc();
+    return pMemory;
+}
+
+void *operator new[](size_t size, std::align_val_t alignment) {
+    return operator new(size, alignment);
+}
+
+void *operator new(size_t size, std::align_val_t alignment,
+    const std::nothrow_t &) noexcept {
+    return BlockAllocate(size, static_cast<size_t>(alignment));
+}
+
+void *operator new[](size_t size, std::align_val_t alignment,
+    const std::nothrow_t &) noexcept {
+    return BlockAllocate(size, static_cast<size_t>(alignment));
+}
+
+void operator delete(void *pmemory, std::align_val_t) noexcept {
+    BlockFree(pmemory);
+}
+
+void operator delete[](void *pmemory, std::align_val_t) noexcept {
+    BlockFree(pmemory);
+}
+
+void operator delete(void *pmemory, size_t, std::align_val_t) noexcept {
+    BlockFree(pmemory);
+}
+
+void operator delete[](void *pmemory, size_t, std::align_val_t) noexcept {
+    BlockFree(pmemory);
+}
+
+void operator delete(void *pmemory, std::align_val_t,
+    const std::nothrow_t &) noexcept {
+    BlockFree(pmemory);
+}
+
+void operator delete[](void *pmemory, std::align_val_t,
+    const std::nothrow_t &) noexcept {
+    BlockFree(pmemory);
+}
+
+#endif // __cpp_aligned_new
+
+#endif // ALLOCATION_TRACKING
+
+//##############################################################################
+// CAllocationTracker
+//##############################################################################
+//! Counts allocations and bytes held by subsystem, and reports them.
+//##############################################################################
+
+namespace {
+
+//------------------------------------------------------------------------------
+//! Function returns a snapshot of a set of counters.
+//
+CAllocationStats StatsGet(const CCounters &counters) {
+    CAllocationStats Stats;
+    Stats.Allocations = counters.Allocations.load(std::memory_order_relaxed);
+    Stats.Bytes = counters.Bytes.load(std::memory_order_relaxed);
+    Stats.Current = counters.Current.load(std::memory_order_relaxed);
+    Stats.Peak = counters.Peak.load(std::memory_order_relaxed);
+    return Stats;
+}
+
+} // namespace
+
+//------------------------------------------------------------------------------
+//! Static function returns true if the allocation functions that count
+//! allocations are built in, as they are if ALLOCATION_TRACKING is defined.
+//
+bool CAllocationTracker::IsAvailable() {
+#ifdef ALLOCATION_TRACKING
+    return true;
+#else
+    return false;
+#endif
+}
+
+//------------------------------------------------------------------------------
+//! Static function starts or stops counting allocations.
+//
+void CAllocationTracker::Enable(bool enable) {
+    sIsEnabled.store(enable, std::memory_order_relaxed);
+}
+
+//------------------------------------------------------------------------------
+//! Static function returns true if allocations are being counted.
+//
+bool CAllocationTracker::IsEnabled() {
+    return sIsEnabled.load(std::memory_order_relaxed);
+}
+
+//------------------------------------------------------------------------------
+//! Static function sets the allocations and bytes counted to zero, and the
+//! peaks to the bytes held now, so that what follows can be measured alone.
+//
+void CAllocationTracker::Reset() {
+    for (CCounters &Counters : sCounters) {
+        Counters.Allocations.store(0, std::memory_order_relaxed);
+        Counters.Bytes.store(0, std::memory_order_relaxed);
+        Counters.Peak.store(Counters.Current.load(std::memory_order_relaxed),
+            std::memory_order_relaxed);
+    }
+}
+
+//------------------------------------------------------------------------------
+//! Static function returns the counts of a subsystem.
+//
+CAllocationStats CAllocationTracker::Stats(ESubsystem subsystem) {
+    return StatsGet(sCounters[static_cast<size_t>(subsystem)]);
+}
+
+//------------------------------------------------------------------------------
+//! Static function returns the counts of all subsystems together.  The peak is
+//! the most held by all of them at once, which may be less than the sum of
+//! their peaks.
+//
+CAllocationStats CAllocationTracker::Total() {
+    return StatsGet(sCounters[TotalIx]);
+}
+
+//------------------------------------------------------------------------------
+//! Static function writes a table of the counts of each subsystem and the
+//! total.
+//
+void CAllocationTracker::Report(std::ostream &stream) {
+    std::ostringstream Text;
+    auto Line = [&Text](const char *pname, const CAllocationStats &stats) {
+        Text << std::left << std::setw(10) << pname << std::right
+            << std::setw(13) << stats.Allocations << std::setw(15)
+            << stats.Bytes << std::setw(15) << stats.Current << std::setw(15)
+            << stats.Peak << std::endl;
+    };
+    Text << std::left << std::setw(10) << "Subsystem" << std::right
+        << std::setw(13) << "Allocations" << std::setw(15) << "Bytes"
+        << std::setw(15) << "Held" << std::setw(15) << "Peak held"
+        << std::endl;
+    for (size_t Ix = 0; Ix < TotalIx; ++Ix)
+        Line(sSubsystemNames[Ix], StatsGet(sCounters[Ix]));
+    Line("Total", Total());
+    stream << Text.str();
+}
+
+//##############################################################################
+// CAllocationScope
+//##############################################################################
+//! Attributes the allocations of the current thread to a subsystem.
+//##############################################################################
+
+//------------------------------------------------------------------------------
+//! Constructor attributes allocations to the specified subsystem.
+//
+CAllocationScope::CAllocationScope(ESubsystem subsystem)
+    : mPrevious(tSubsystem) {
+    tSubsystem = subsystem;
+}
+
+//------------------------------------------------------------------------------
+//! Destructor attributes allocations to the previous subsystem again.
+//
+CAllocationScope::~CAllocationScope() {
+    tSubsystem = mPrevious;
+}
+
+//##############################################################################
+
+//------------------------------------------------------------------------------
+//! Function tests CAllocationTracker by allocating blocks in nested scopes,
+//! freeing one in a different scope from the one it was allocated in, and
+//! checking that blocks are counted only while tracking is enabled, including
+//! the blocks of a CArena, from which catalogs take their text.  Counts
+//! are compared before and after, so the test holds whether or not tracking
+//! was already enabled.  The allocation functions are called directly, as
+//! allocations by new expressions may be left out by the compiler.  Nothing
+//! is counted, or tested, unless the tracking functions are built in.
+//
+uint32_t AllocationTrackerTest(std::vector<std::string> &report) {
+    uint32_t NErrors = 0;
+    report.push_back("");
+    report.push_back("Allocation Tracker Test:");
+    if (!CAllocationTracker::IsAvailable())
+        return NErrors;
+
+    bool WasEnabled = CAllocationTracker::IsEnabled();
+    CAllocationTracker::Enable(false);
+    void *pUntracked = ::operator new(100);
+    CAllocationTracker::Enable(true);
+
+    CAllocationStats Catalog = CAllocationTracker::Stats(ESubsystem::Catalog);
+    CAllocationStats Utf8 = CAllocationTracker::Stats(ESubsystem::Utf8);
+    void *pCatalog;
+    void *pUtf8;
+    size_t ArenaBytes; // Excluding the block header
+    {
+        CAllocationScope Scope(ESubsystem::Catalog);
+        pCatalog = ::operator new(1000);
+        {
+            CAllocationScope Inner(ESubsystem::Utf8);
+            pUtf8 = ::operator new(300);
+        }
+        ::operator delete(::operator new(50));
+        ::operator delete(pUtf8);
+        ::operator delete(pUntracked);
+#ifdef __cpp_aligned_new
+        void *pAligned = ::operator new(64, std::align_val_t(256));
+        if (reinterpret_cast<uintptr_t>(pAligned) % 256 != 0) {
+            report.push_back("  Incorrect alignment.");
+            ++NErrors;
+        }
+        ::operator delete(pAligned, std::align_val_t(256));
+#else
+        ::operator delete(::operator new(64));
+#endif
+        CArena Arena(200);
+        Arena.Allocate(10);
+        ArenaBytes = Arena.Reserved();
+    }
+    CAllocationStats NewCatalog = CAllocationTracker::Stats(
+        ESubsystem::Catalog);
+    CAllocationStats NewUtf8 = CAllocationTracker::Stats(ESubsystem::Utf8);
+    if (NewCatalog.Allocations != Catalog.Allocations + 4 ||
+        NewCatalog.Bytes <= Catalog.Bytes + 1114 + ArenaBytes ||
+        NewCatalog.Bytes > Catalog.Bytes + 1114 + ArenaBytes + 64 ||
+        NewCatalog.Current != Catalog.Current + 1000 ||
+        NewCatalog.Peak < Catalog.Current + 1050 ||
+        NewUtf8.Allocations != Utf8.Allocations + 1 ||
+        NewUtf8.Bytes != Utf8.Bytes + 300 ||
+        NewUtf8.Current != Utf8.Current ||
+        NewUtf8.Peak < Utf8.Current + 300) {
+        report.push_back("  Incorrect counts: catalog " +
+            std::to_string(NewCatalog.Allocations - Catalog.Allocations) +
+            " allocations of " + std::to_string(NewCatalog.Bytes -
+            Catalog.Bytes) + " bytes, UTF-8 " + std::to_string(
+            NewUtf8.Allocations - Utf8.Allocations) + " allocations of " +
+            std::to_string(NewUtf8.Bytes - Utf8.Bytes) + " bytes.");
+        ++NErrors;
+    }
+
+    CAllocationTracker::Enable(false);
+    ::operator delete(pCatalog);
+    std::ostringstream Report;
+    CAllocationTracker::Report(Report);
+    if (CAllocationTracker::Stats(ESubsystem::Catalog).Current !=
+        Catalog.Current ||
+        Report.str().find("Catalog") == std::string::npos ||
+        Report.str().find("Total") == std::string::npos) {
+        report.push_back("  Incorrect release after disabling, or report.");
+        ++NErrors;
+    }
+    CAllocationTracker::Enable(WasEnabled);
+
+    return NErrors;
+}
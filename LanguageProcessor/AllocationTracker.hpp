@@ -0,0 +1,92 @@
+//#pragma once
+
+#ifndef ALLOCATION_TRACKER_HPP
+#define ALLOCATION_TRACKER_HPP
+
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+//##############################################################################
+// ESubsystem
+//##############################################################################
+//! Parts of the program to which heap allocations are attributed by
+//! CAllocationTracker.
+//##############################################################################
+
+enum class ESubsystem {
+    Other,     // Anything not within a scope below
+    Loader,    // Reading and parsing messages files
+    TextTable, // Formatting and parsing lines by CTextTable
+    Utf8,      // Converting text to and from UTF-8
+    Catalog,   // Storing messages in catalogs
+    Count
+};
+
+//##############################################################################
+// CAllocationStats
+//##############################################################################
+//! Allocations made, and bytes held, by a subsystem while tracking is enabled.
+//##############################################################################
+
+struct CAllocationStats {
+    uint64_t Allocations;
+    uint64_t Bytes;       // Requested, in total
+    int64_t  Current;     // Still held
+    int64_t  Peak;        // Most held at once
+};
+
+//##############################################################################
+// CAllocationTracker
+//##############################################################################
+//! Counts the heap allocations made through the global operator new, and the
+//! bytes they hold, for each subsystem.  If ALLOCATION_TRACKING is defined,
+//! the global allocation functions are replaced by ones that put a small
+//! header in front of each block, recording its size and the subsystem that
+//! allocated it, so that the block is counted against the same subsystem when
+//! freed, on whatever thread.  Otherwise the standard functions are left in
+//! place, nothing is counted and IsAvailable() returns false; the option is
+//! defined for Benchmarks and for the Debug build of LanguageProcessor, so
+//! that release builds pay nothing for it.  Counting is off until enabled,
+//! and blocks allocated while it is off are never counted.
+//! Each thread attributes its allocations to the subsystem of its innermost
+//! CAllocationScope, or to ESubsystem::Other outside of any.
+//##############################################################################
+
+class CAllocationTracker {
+public:
+    static bool   IsAvailable();
+    static void   Enable(bool enable);
+    static bool   IsEnabled();
+    static void   Reset();
+    static CAllocationStats Stats(ESubsystem subsystem);
+    static CAllocationStats Total();
+    static uint64_t Allocations() { return Total().Allocations; }
+    static void   Report(std::ostream &stream);
+};
+
+//##############################################################################
+// CAllocationScope
+//##############################################################################
+//! Attributes the allocations of the current thread to a subsystem from its
+//! construction to its destruction, after which the previous subsystem applies
+//! again.
+//##############################################################################
+
+class CAllocationScope {
+public:
+    CAllocationScope(ESubsystem subsystem);
+    CAllocationScope(const CAllocationScope &other) = delete;
+    CAllocationScope &operator=(const CAllocationScope &other) = delete;
+    ~CAllocationScope();
+
+private:
+    ESubsystem mPrevious;
+};
+
+//##############################################################################
+
+uint32_t AllocationTrackerTest(std::vector<std::string> &report);
+
+#endif // ALLOCATION_TRACKER_HPP
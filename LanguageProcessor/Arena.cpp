@@ -0,0 +1,161 @@
+#include "stdafx.h"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+#include "Arena.hpp"
+
+//##############################################################################
+// CArena
+//##############################################################################
+//! Monotonic allocator that hands out memory from a chain of blocks of
+//! doubling size and frees it only all at once.
+//##############################################################################
+
+//------------------------------------------------------------------------------
+//! Constructor sets the size of the first block, which is allocated on first
+//! use.
+//
+CArena::CArena(size_t firstBlockSize) : mpBlock(nullptr), mpNext(nullptr),
+    mpEnd(nullptr), mFirstBlockSize(std::max<size_t>(firstBlockSize, 64)),
+    mBlockSize(mFirstBlockSize), mAllocated(0), mReserved(0), mBlocks(0) {
+}
+
+//------------------------------------------------------------------------------
+//! Destructor frees all blocks.
+//
+CArena::~CArena() {
+    Reset();
+}
+
+//------------------------------------------------------------------------------
+//! Function returns size bytes aligned to align, which must be a power of 2,
+//! adding a block if the current one has too little room left.  The padding
+//! needed for the alignment may itself be more than the room left.
+//
+void *CArena::Allocate(size_t size, size_t align) {
+    uintptr_t Next = reinterpret_cast<uintptr_t>(mpNext);
+    uintptr_t Aligned = (Next + align - 1) & ~static_cast<uintptr_t>(align - 1);
+    size_t Left = static_cast<size_t>(mpEnd - mpNext);
+    size_t Padding = static_cast<size_t>(Aligned - Next);
+    if (mpBlock == nullptr || Padding > Left || size > Left - Padding) {
+        BlockAdd(size + align);
+        Next = reinterpret_cast<uintptr_t>(mpNext);
+        Aligned = (Next + align - 1) & ~static_cast<uintptr_t>(align - 1);
+    }
+    mpNext = reinterpret_cast<char *>(Aligned) + size;
+    mAllocated += size;
+    return reinterpret_cast<void *>(Aligned);
+}
+
+//------------------------------------------------------------------------------
+//! Function frees all blocks, invalidating everything allocated from the
+//! arena.  The cost depends on the number of blocks only.
+//
+void CArena::Reset() {
+    while (mpBlock != nullptr) {
+        CBlock *pNext = mpBlock->pNext;
+        ::operator delete(mpBlock);
+        mpBlock = pNext;
+    }
+    mpNext = nullptr;
+    mpEnd = nullptr;
+    mBlockSize = mFirstBlockSize;
+    mAllocated = 0;
+    mReserved = 0;
+    mBlocks = 0;
+}
+
+//------------------------------------------------------------------------------
+//! Private function starts a new block of at least minSize bytes.  The rest
+//! of the current block is abandoned.  Blocks come from the global operator
+//! new, so that CAllocationTracker counts them.
+//
+void CArena::BlockAdd(size_t minSize) {
+    size_t Size = std::max(mBlockSize, minSize);
+    if (Size > SIZE_MAX - sizeof(CBlock))
+        throw std::bad_alloc();
+    CBlock *pBlock = static_cast<CBlock *>(::operator new(sizeof(CBlock) +
+        Size));
+    pBlock->pNext = mpBlock;
+    pBlock->Size = Size;
+    mpBlock = pBlock;
+    mpNext = reinterpret_cast<char *>(pBlock + 1);
+    mpEnd = mpNext + Size;
+    mReserved += Size;
+    ++mBlocks;
+    if (mBlockSize < MaxBlockSize)
+        mBlockSize *= 2;
+}
+
+//##############################################################################
+
+//------------------------------------------------------------------------------
+//! Function tests CArena by making many small allocations of various
+//! alignments, up to more than that of the blocks, from blocks of an odd
+//! size, and a large one.  Every allocation is filled with its own byte and
+//! checked afterwards, so overlapping allocations are found, and the number
+//! of blocks used is checked.
+//
+uint32_t ArenaTest(std::vector<std::string> &report) {
+    uint32_t NErrors = 0;
+    report.push_back("");
+    report.push_back("Arena Test:");
+
+    CArena Arena(255);
+    struct CAllocation {
+        unsigned char *p;
+        size_t         Size;
+    };
+    std::vector<CAllocation> Allocations;
+    bool IsAligned = true;
+    for (size_t Ix = 0; Ix < 1000; ++Ix) {
+        size_t Align = size_t(1) << (Ix % 7);
+        size_t Size = Ix % 37 + 1;
+        void *p = Arena.Allocate(Size, Align);
+        IsAligned = IsAligned &&
+            (reinterpret_cast<uintptr_t>(p) & (Align - 1)) == 0;
+        std::memset(p, static_cast<int>(Ix & 0xff), Size);
+        CAllocation Allocation = { static_cast<unsigned char *>(p), Size };
+        Allocations.push_back(Allocation);
+    }
+    void *pLarge = Arena.Allocate(100000);
+    std::memset(pLarge, 0, 100000);
+    if (!IsAligned || pLarge == nullptr) {
+        report.push_back("  Misaligned allocation.");
+        ++NErrors;
+    }
+    for (size_t Ix = 0; Ix < Allocations.size(); ++Ix) {
+        const CAllocation &Allocation = Allocations[Ix];
+        for (size_t Iy = 0; Iy < Allocation.Size; ++Iy) {
+            if (Allocation.p[Iy] != (Ix & 0xff)) {
+                report.push_back("  Overlapping allocation " +
+                    std::to_string(Ix) + ".");
+                ++NErrors;
+                break;
+            }
+        }
+    }
+    if (Arena.Blocks() > 12 || Arena.Allocated() > Arena.Reserved()) {
+        report.push_back("  Too many blocks: " +
+            std::to_string(Arena.Blocks()) + ".");
+        ++NErrors;
+    }
+    Arena.Reset();
+    if (Arena.Blocks() != 0 || Arena.Reserved() != 0) {
+        report.push_back("  Blocks remain after reset.");
+        ++NErrors;
+    }
+
+    // Padding for the alignment that does not fit in the rest of the block
+    CArena Small(100);
+    Small.Allocate(98, 1);
+    std::memset(Small.Allocate(8, 16), 0, 8);
+    if (Small.Blocks() != 2 || Small.Allocated() > Small.Reserved()) {
+        report.push_back("  Padding not fitted in block.");
+        ++NErrors;
+    }
+
+    return NErrors;
+}
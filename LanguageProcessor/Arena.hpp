@@ -0,0 +1,60 @@
+//#pragma once
+
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//##############################################################################
+// CArena
+//##############################################################################
+//! Monotonic allocator that hands out memory from a chain of blocks and frees
+//! it only all at once.  Each block is twice the size of the one before, up
+//! to MaxBlockSize, so a large load costs one allocation per few megabytes
+//! and wastes at most part of the last block, and releasing everything
+//! allocated from the arena is independent of the number of allocations made.
+//! Nothing is freed individually.  An arena is not thread safe.
+//##############################################################################
+
+class CArena {
+public:
+    static const size_t FirstBlockSize = 0x1000;
+    static const size_t MaxBlockSize = 0x400000;
+
+    CArena(size_t firstBlockSize = FirstBlockSize);
+    CArena(const CArena &other) = delete;
+    CArena &operator=(const CArena &other) = delete;
+    ~CArena();
+
+    void  *Allocate(size_t size, size_t align = alignof(std::max_align_t));
+    void   Reset();
+    size_t Allocated() const { return mAllocated; }
+    size_t Reserved() const { return mReserved; }
+    size_t Blocks() const { return mBlocks; }
+
+private:
+    struct CBlock {
+        CBlock *pNext;
+        size_t  Size;      // Bytes following the header
+    };
+
+    CBlock *mpBlock;       // Most recent block, heading the chain
+    char   *mpNext;
+    char   *mpEnd;
+    size_t  mFirstBlockSize;
+    size_t  mBlockSize;    // Size of the next block
+    size_t  mAllocated;
+    size_t  mReserved;
+    size_t  mBlocks;
+
+    void BlockAdd(size_t minSize);
+};
+
+//##############################################################################
+
+uint32_t ArenaTest(std::vector<std::string> &report);
+
+#endif // ARENA_HPP
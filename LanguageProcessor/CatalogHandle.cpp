@@ -0,0 +1,97 @@
+#include "stdafx.h"
+
+#include <atomic>
+#include <thread>
+
+#include "CatalogHandle.hpp"
+
+//##############################################################################
+
+namespace {
+
+//------------------------------------------------------------------------------
+//! Catalog for the test, whose values all equal its version and which counts
+//! the instances alive.
+//
+struct CTestCatalog {
+    static std::atomic<int> sLive;
+
+    std::vector<uint64_t> Values;
+
+    CTestCatalog(uint64_t version) : Values(64, version) { ++sLive; }
+    ~CTestCatalog() { --sLive; }
+};
+
+std::atomic<int> CTestCatalog::sLive(0);
+
+} // namespace
+
+//------------------------------------------------------------------------------
+//! Function tests CCatalogHandle by publishing catalogs while several threads
+//! acquire snapshots, checking that every snapshot is whole, that versions
+//! only increase, and that every replaced catalog is deleted.
+//
+uint32_t CatalogHandleTest(std::vector<std::string> &report) {
+    static const uint64_t NVersions = 2000;
+    static const size_t NReaders = 4;
+
+    uint32_t NErrors = 0;
+    report.push_back("");
+    report.push_back("CatalogHandle Test:");
+
+    {
+        CCatalogHandle<CTestCatalog> Handle;
+        if (Handle.Acquire()) {
+            report.push_back("  Snapshot before first Publish().");
+            ++NErrors;
+        }
+        Handle.Publish(std::unique_ptr<const CTestCatalog>(
+            new CTestCatalog(1)));
+
+        std::atomic<bool> IsDone(false);
+        std::atomic<uint32_t> NBad(0);
+        CCatalogHandle<CTestCatalog>::CSnapshot Held = Handle.Acquire();
+        std::vector<std::thread> Readers;
+        for (size_t Ix = 0; Ix < NReaders; ++Ix) {
+            Readers.push_back(std::thread([&]() {
+                uint64_t Last = 0;
+                while (!IsDone) {
+                    CCatalogHandle<CTestCatalog>::CSnapshot Snapshot =
+                        Handle.Acquire();
+                    uint64_t Version = Snapshot.Version();
+                    for (uint64_t Value : Snapshot->Values)
+                        if (Value != Version)
+                            ++NBad;
+                    if (Version < Last)
+                        ++NBad;
+                    Last = Version;
+                }
+            }));
+        }
+        for (uint64_t Version = 2; Version <= NVersions; ++Version)
+            Handle.Publish(std::unique_ptr<const CTestCatalog>(
+                new CTestCatalog(Version)));
+        IsDone = true;
+        for (std::thread &Reader : Readers)
+            Reader.join();
+
+        if (NBad != 0) {
+            report.push_back("  Inconsistent snapshots: " +
+                std::to_string(NBad) + ".");
+            ++NErrors;
+        }
+        // The held first version and the current one remain
+        if (CTestCatalog::sLive != 2 || Held.Version() != 1 ||
+            Held->Values[0] != 1 || Handle.Version() != NVersions) {
+            report.push_back("  Replaced catalogs not deleted: " +
+                std::to_string(CTestCatalog::sLive) + " alive.");
+            ++NErrors;
+        }
+    }
+    if (CTestCatalog::sLive != 0) {
+        report.push_back("  Catalogs alive after handle deleted.");
+        ++NErrors;
+    }
+
+    return NErrors;
+}
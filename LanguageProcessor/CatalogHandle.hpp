@@ -0,0 +1,175 @@
+//#pragma once
+
+#ifndef CATALOG_HANDLE_HPP
+#define CATALOG_HANDLE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//##############################################################################
+// CCatalogHandle
+//##############################################################################
+//! Publishes immutable snapshots of a catalog (such as CColumnarMessages) to
+//! concurrent readers.  Readers call Acquire() for a CSnapshot of the current
+//! catalog and query it for as long as they hold it, without locks, while a
+//! writer builds a new catalog in the background and replaces the current
+//! one with Publish().  A snapshot is deleted once it has been replaced and
+//! the last CSnapshot referring to it has gone.
+//!
+//! Acquire() reads the current pointer and takes a reference to it within a
+//! read-side critical section marked by one of two reader counters, chosen by
+//! the parity of an epoch.  Publish() swaps the pointer, advances the epoch
+//! and waits for the counter of the previous epoch to drain, which takes no
+//! longer than the few instructions of the readers already inside it, before
+//! giving up its own reference to the old catalog.  Readers never wait for
+//! writers or for each other; writers are serialized by a mutex.
+//##############################################################################
+
+template <typename T>
+class CCatalogHandle {
+private:
+    struct CNode {
+        std::unique_ptr<const T> pCatalog;
+        uint64_t                 Version;
+        std::atomic<size_t>      Refs;
+    };
+
+public:
+    //--------------------------------------------------------------------------
+    //! Counted reference to one snapshot of the catalog.
+    //
+    class CSnapshot {
+    public:
+        CSnapshot() : mpNode(nullptr) {}
+        CSnapshot(const CSnapshot &other) : mpNode(other.mpNode) {
+            if (mpNode != nullptr)
+                mpNode->Refs.fetch_add(1, std::memory_order_relaxed);
+        }
+        CSnapshot(CSnapshot &&other) : mpNode(other.mpNode) {
+            other.mpNode = nullptr;
+        }
+        CSnapshot &operator=(CSnapshot other) {
+            std::swap(mpNode, other.mpNode);
+            return *this;
+        }
+        ~CSnapshot() { Release(mpNode); }
+
+        explicit operator bool() const { return mpNode != nullptr; }
+        const T &operator*() const { return *mpNode->pCatalog; }
+        const T *operator->() const { return mpNode->pCatalog.get(); }
+        uint64_t Version() const {
+            return (mpNode != nullptr) ? mpNode->Version : 0;
+        }
+
+    private:
+        friend class CCatalogHandle;
+        explicit CSnapshot(CNode *pnode) : mpNode(pnode) {}
+
+        CNode *mpNode;
+    };
+
+    CCatalogHandle();
+    CCatalogHandle(const CCatalogHandle &other) = delete;
+    CCatalogHandle &operator=(const CCatalogHandle &other) = delete;
+    ~CCatalogHandle();
+
+    CSnapshot Acquire() const;
+    uint64_t  Publish(std::unique_ptr<const T> pcatalog);
+    uint64_t  Version() const { return mVersion.load(); }
+
+private:
+    std::atomic<CNode *>        mpCurrent;
+    std::atomic<uint64_t>       mEpoch;
+    mutable std::atomic<size_t> mReaders[2]; // By parity of the epoch
+    std::atomic<uint64_t>       mVersion;
+    std::mutex                  mPublishMutex;
+
+    static void Release(CNode *pnode);
+};
+
+//------------------------------------------------------------------------------
+//! Constructor creates a handle with no catalog; Acquire() returns an empty
+//! snapshot until the first Publish().
+//
+template <typename T>
+CCatalogHandle<T>::CCatalogHandle() : mpCurrent(nullptr), mEpoch(0),
+    mVersion(0) {
+    mReaders[0] = 0;
+    mReaders[1] = 0;
+}
+
+//------------------------------------------------------------------------------
+//! Destructor gives up the handle's reference to the current catalog, which
+//! lives on while snapshots of it remain.  No reader may be inside Acquire().
+//
+template <typename T>
+CCatalogHandle<T>::~CCatalogHandle() {
+    Release(mpCurrent.load());
+}
+
+//------------------------------------------------------------------------------
+//! Function returns a snapshot of the current catalog without blocking.  The
+//! loop repeats only if a Publish() advances the epoch between choosing a
+//! counter and checking it was the right one.
+//
+template <typename T>
+typename CCatalogHandle<T>::CSnapshot CCatalogHandle<T>::Acquire() const {
+    for (;;) {
+        uint64_t Epoch = mEpoch.load();
+        std::atomic<size_t> &Readers = mReaders[Epoch & 1];
+        Readers.fetch_add(1);
+        if (mEpoch.load() == Epoch) {
+            CNode *pNode = mpCurrent.load();
+            if (pNode != nullptr)
+                pNode->Refs.fetch_add(1, std::memory_order_relaxed);
+            Readers.fetch_sub(1);
+            return CSnapshot(pNode);
+        }
+        Readers.fetch_sub(1);
+    }
+}
+
+//------------------------------------------------------------------------------
+//! Function makes the specified catalog current and returns its version
+//! number, counting from 1.  The previous catalog is deleted at once if no
+//! snapshot of it is held, or else when the last one is released.
+//
+template <typename T>
+uint64_t CCatalogHandle<T>::Publish(std::unique_ptr<const T> pcatalog) {
+    std::lock_guard<std::mutex> Lock(mPublishMutex);
+    CNode *pNode = new CNode;
+    pNode->pCatalog = std::move(pcatalog);
+    pNode->Version = mVersion.load() + 1;
+    pNode->Refs = 1; // The handle's reference
+    CNode *pOld = mpCurrent.exchange(pNode);
+    mVersion = pNode->Version;
+
+    // Wait for readers that may have read the old pointer to reference it
+    uint64_t Epoch = mEpoch.fetch_add(1);
+    while (mReaders[Epoch & 1].load() != 0)
+        std::this_thread::yield();
+    Release(pOld);
+    return pNode->Version;
+}
+
+//------------------------------------------------------------------------------
+//! Private static function drops a reference to a node, deleting it with its
+//! catalog when it was the last.
+//
+template <typename T>
+void CCatalogHandle<T>::Release(CNode *pnode) {
+    if (pnode != nullptr &&
+        pnode->Refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        delete pnode;
+}
+
+//##############################################################################
+
+uint32_t CatalogHandleTest(std::vector<std::string> &report);
+
+#endif // CATALOG_HANDLE_HPP
@@ -0,0 +1,495 @@
+#include "stdafx.h"
+
+#include <stdexcept>
+
+#include "Utils.hpp"
+#include "AllocationTracker.hpp"
+#include "StringPool.hpp"
+#include "ColumnarMessages.hpp"
+
+//##############################################################################
+// CBasicColumnarMessages
+//##############################################################################
+//! Holds the content of a CMessages object column by column, each column an
+//! array of spans of a shared pool of interned text.  The functions are
+//! instantiated below for wide and UTF-8 text.
+//##############################################################################
+
+namespace {
+
+//------------------------------------------------------------------------------
+//! Functions return the text of translations into unknown languages.
+//
+template <typename TChar> CBasicField<TChar> Unknown();
+
+template <> CTextField Unknown<wchar_t>() {
+    const std::wstring &Text = UnknownTranslation();
+    CTextField Field = { Text.data(), Text.size() };
+    return Field;
+}
+
+template <> CUtf8Field Unknown<char>() {
+    const std::string &Text = UnknownUtf8Translation();
+    CUtf8Field Field = { Text.data(), Text.size() };
+    return Field;
+}
+
+//------------------------------------------------------------------------------
+//! Functions return a view of wide text as the text stored in a catalog,
+//! converting it into buffer if need be, which must outlive the view.
+//
+inline CTextField FieldOf(const std::wstring &text, std::wstring &) {
+    CTextField Field = { text.data(), text.size() };
+    return Field;
+}
+
+inline CUtf8Field FieldOf(const std::wstring &text, std::string &buffer) {
+    WStrToUtf8(text.data(), text.size(), buffer);
+    CUtf8Field Field = { buffer.data(), buffer.size() };
+    return Field;
+}
+
+//------------------------------------------------------------------------------
+//! Functions set wide to the text of a view of a catalog.
+//
+inline void WideAssign(const CTextField &field, std::wstring &wide) {
+    wide.assign(field.pText, field.Len);
+}
+
+inline void WideAssign(const CUtf8Field &field, std::wstring &wide) {
+    Utf8ToWStr(field.pText, field.Len, wide);
+}
+
+} // namespace
+
+//------------------------------------------------------------------------------
+//! Default constructor creates an empty catalog.
+//
+template <typename TChar>
+CBasicColumnarMessages<TChar>::CBasicColumnarMessages() : mIndex(EmptySlot) {
+}
+
+//------------------------------------------------------------------------------
+//! Constructor copies the languages and messages of a CMessages object.
+//
+template <typename TChar>
+CBasicColumnarMessages<TChar>::CBasicColumnarMessages(
+    const CMessages &messages) : CBasicColumnarMessages() {
+    Assign(messages);
+}
+
+//------------------------------------------------------------------------------
+//! Function replaces the content of the catalog with the languages and
+//! messages of a CMessages object, interning their text.
+//
+template <typename TChar>
+void CBasicColumnarMessages<TChar>::Assign(const CMessages &messages) {
+    CAllocationScope Scope(ESubsystem::Catalog);
+    Clear();
+    std::vector<std::wstring> Languages;
+    messages.Languages(Languages);
+    for (const std::wstring &Language : Languages)
+        LanguageAdd(Language);
+
+    size_t NMessages = messages.MessageCount();
+    mNames.reserve(NMessages);
+    mDescriptions.reserve(NMessages);
+    mTranslate.reserve(NMessages);
+    mFingerprints.reserve(NMessages);
+    for (CColumn &Column : mTranslations)
+        Column.reserve(NMessages);
+
+    std::vector<TString> Buffers(2);
+    std::vector<TField> Translations;
+    for (size_t Ix = 0; Ix < NMessages; ++Ix) {
+        const CMessage &Message = messages.Message(Ix);
+        const std::vector<std::wstring> &Texts = Message.Translations();
+        if (Buffers.size() < 2 + Texts.size())
+            Buffers.resize(2 + Texts.size());
+        Translations.clear();
+        for (size_t Iy = 0; Iy < Texts.size(); ++Iy)
+            Translations.push_back(FieldOf(Texts[Iy], Buffers[2 + Iy]));
+        MessageAdd(FieldOf(Message.Name(), Buffers[0]),
+            FieldOf(Message.Description(), Buffers[1]), Message.Translate(),
+            Translations);
+    }
+}
+
+//------------------------------------------------------------------------------
+//! Function removes all languages and messages.
+//
+template <typename TChar>
+void CBasicColumnarMessages<TChar>::Clear() {
+    mLanguages.clear();
+    mPool.Clear();
+    mNames.clear();
+    mDescriptions.clear();
+    mTranslate.clear();
+    mTranslations.clear();
+    mFingerprints.clear();
+    mIndex.Clear();
+}
+
+//------------------------------------------------------------------------------
+//! Function adds a language.  Messages already present get an empty
+//! translation, or their first translation if they are not to be translated.
+//
+template <typename TChar>
+void CBasicColumnarMessages<TChar>::LanguageAdd(const std::wstring &language) {
+    CAllocationScope Scope(ESubsystem::Catalog);
+    size_t NMessages = MessageCount();
+    CSpan Empty = { 0, 0 };
+    CColumn Column(NMessages, Empty);
+    if (!mTranslations.empty())
+        for (size_t Ix = 0; Ix < NMessages; ++Ix)
+            if (mTranslate[Ix] == L'F')
+                Column[Ix] = mTranslations[0][Ix];
+    mLanguages.push_back(language);
+    mTranslations.push_back(std::move(Column));
+}
+
+//------------------------------------------------------------------------------
+//! Function adds a message, interning its text.  Translations beyond the
+//! number of languages are ignored and missing ones are empty.  Only the
+//! first translation of a message that is not to be translated is kept, and
+//! every language column refers to it.  The fingerprint identifies the
+//! record the message came from, or is zero if there was none.
+//
+template <typename TChar>
+void CBasicColumnarMessages<TChar>::MessageAdd(const TField &name,
+    const TField &description, wchar_t translate,
+    const std::vector<TField> &translations, uint64_t fingerprint) {
+    CAllocationScope Scope(ESubsystem::Catalog);
+    mNames.push_back(mPool.Add(name.pText, name.Len));
+    mDescriptions.push_back(mPool.Add(description.pText, description.Len));
+    mTranslate.push_back(translate);
+    size_t NLanguages = mLanguages.size();
+    CSpan First = { 0, 0 };
+    for (size_t Iy = 0; Iy < NLanguages; ++Iy) {
+        CSpan Span = { 0, 0 }; // Missing translations are empty
+        if (Iy > 0 && translate == L'F')
+            Span = First;
+        else if (Iy < translations.size())
+            Span = mPool.Add(translations[Iy].pText, translations[Iy].Len);
+        if (Iy == 0)
+            First = Span;
+        mTranslations[Iy].push_back(Span);
+    }
+    mFingerprints.push_back(fingerprint);
+    IndexAdd(mNames.size() - 1);
+}
+
+//------------------------------------------------------------------------------
+//! Function adds a copy of the message at the specified position of another
+//! catalog with the same languages, with its fingerprint, interning its text.
+//! A catalog built from another one this way holds none of the text of the
+//! messages left out.
+//
+template <typename TChar>
+void CBasicColumnarMessages<TChar>::MessageCopy(
+    const CBasicColumnarMessages &other, size_t ix) {
+    CAllocationScope Scope(ESubsystem::Catalog);
+    size_t NLanguages = mLanguages.size();
+    if (other.mLanguages.size() != NLanguages)
+        throw std::runtime_error("CColumnarMessages::MessageCopy(): "
+            "The catalogs have different languages.");
+    TField Name = other.Name(ix);
+    TField Description = other.Description(ix);
+    wchar_t Translate = other.mTranslate[ix];
+    mNames.push_back(mPool.Add(Name.pText, Name.Len));
+    mDescriptions.push_back(mPool.Add(Description.pText, Description.Len));
+    mTranslate.push_back(Translate);
+    for (size_t Iy = 0; Iy < NLanguages; ++Iy) {
+        CSpan Span;
+        if (Iy > 0 && Translate == L'F') {
+            Span = mTranslations[0].back();
+        } else {
+            TField Text = other.mPool.Field(other.mTranslations[Iy][ix]);
+            Span = mPool.Add(Text.pText, Text.Len);
+        }
+        mTranslations[Iy].push_back(Span);
+    }
+    mFingerprints.push_back(other.mFingerprints[ix]);
+    IndexAdd(mNames.size() - 1);
+}
+
+//------------------------------------------------------------------------------
+//! Function returns the handle of the specified language, or ELanguage::Invalid
+//! if it is not known.
+//
+template <typename TChar>
+ELanguage CBasicColumnarMessages<TChar>::Language(
+    const std::wstring &language) const {
+    size_t Count = mLanguages.size();
+    for (size_t Ix = 0; Ix < Count; ++Ix)
+        if (mLanguages[Ix] == language)
+            return static_cast<ELanguage>(Ix);
+    return ELanguage::Invalid;
+}
+
+//------------------------------------------------------------------------------
+//! Function returns the list of languages.
+//
+template <typename TChar>
+void CBasicColumnarMessages<TChar>::Languages(
+    std::vector<std::wstring> &languages) const {
+    languages = mLanguages;
+}
+
+//------------------------------------------------------------------------------
+//! Function returns the translation of the message at the specified position
+//! into the language with the specified handle, as CMessage::Translation()
+//! does: "???" if the language is not known and the first translation if the
+//! message is not to be translated, which MessageAdd() has already put in
+//! every column.
+//
+template <typename TChar>
+typename CBasicColumnarMessages<TChar>::TField
+CBasicColumnarMessages<TChar>::Translation(size_t ix,
+    ELanguage language) const {
+    size_t LanguageIx = static_cast<size_t>(language);
+    if (LanguageIx >= mLanguages.size()) // If language not found
+        return Unknown<TChar>();
+    return mPool.Field(mTranslations[LanguageIx].at(ix));
+}
+
+//------------------------------------------------------------------------------
+//! Function returns the position of the first message with the specified
+//! name, or NotFound if there is none.
+//
+template <typename TChar>
+size_t CBasicColumnarMessages<TChar>::Find(const std::wstring &name) const {
+    TString Buffer;
+    TField Name = FieldOf(name, Buffer);
+    return Find(Name, NameHash(Name));
+}
+
+//------------------------------------------------------------------------------
+//! Function returns the position of the first message with the specified
+//! name, whose hash by NameHash() the caller already has, or NotFound if
+//! there is none.
+//
+template <typename TChar>
+size_t CBasicColumnarMessages<TChar>::Find(const TField &name,
+    uint32_t hash) const {
+    uint32_t Ix = mIndex.Find(hash,
+        [&](uint32_t ix) { return mPool.Field(mNames[ix]).Equals(name); });
+    return (Ix == EmptySlot) ? NotFound : Ix;
+}
+
+//------------------------------------------------------------------------------
+//! Function returns the translation of the first message with the specified
+//! name into the language with the specified handle, or "???" if there is no
+//! such message.
+//
+template <typename TChar>
+typename CBasicColumnarMessages<TChar>::TField
+CBasicColumnarMessages<TChar>::Lookup(const std::wstring &name,
+    ELanguage language) const {
+    size_t Ix = Find(name);
+    return (Ix == NotFound) ? Unknown<TChar>() : Translation(Ix, language);
+}
+
+//------------------------------------------------------------------------------
+//! Function returns views of the translations for the language with the
+//! specified handle.
+//
+template <typename TChar>
+void CBasicColumnarMessages<TChar>::Translations(ELanguage language,
+    std::vector<TField> &translations) const {
+    size_t NMessages = MessageCount();
+    translations.resize(NMessages);
+    for (size_t Ix = 0; Ix < NMessages; ++Ix)
+        translations[Ix] = Translation(Ix, language);
+}
+
+//------------------------------------------------------------------------------
+//! Function returns the translations for the language with the specified
+//! handle.
+//
+template <typename TChar>
+void CBasicColumnarMessages<TChar>::Translations(ELanguage language,
+    std::vector<std::wstring> &translations) const {
+    size_t NMessages = MessageCount();
+    translations.resize(NMessages);
+    for (size_t Ix = 0; Ix < NMessages; ++Ix)
+        WideAssign(Translation(Ix, language), translations[Ix]);
+}
+
+//------------------------------------------------------------------------------
+//! Function returns the translations for the specified language.
+//
+template <typename TChar>
+void CBasicColumnarMessages<TChar>::Translations(const std::wstring &language,
+    std::vector<std::wstring> &translations) const {
+    Translations(Language(language), translations);
+}
+
+//------------------------------------------------------------------------------
+//! Function returns the number of bytes of heap memory held by the catalog.
+//
+template <typename TChar>
+size_t CBasicColumnarMessages<TChar>::MemoryUsed() const {
+    size_t Bytes = mLanguages.capacity() * sizeof(std::wstring) +
+        mTranslate.capacity() * sizeof(wchar_t) +
+        mFingerprints.capacity() * sizeof(uint64_t) +
+        mTranslations.capacity() * sizeof(CColumn) + mPool.MemoryUsed() +
+        (mNames.capacity() + mDescriptions.capacity()) *
+        sizeof(CSpan) + mIndex.MemoryUsed();
+    for (const CColumn &Column : mTranslations)
+        Bytes += Column.capacity() * sizeof(CSpan);
+    return Bytes;
+}
+
+//------------------------------------------------------------------------------
+//! Private function adds the message at the specified position to the index,
+//! unless a message of the same name is already there, in which case the
+//! first message of the name is still the one found.  Names are interned, so
+//! equal names have equal spans.
+//
+template <typename TChar>
+void CBasicColumnarMessages<TChar>::IndexAdd(size_t ix) {
+    if (ix >= EmptySlot)
+        throw std::runtime_error("CColumnarMessages::MessageAdd(): Too many "
+            "messages.");
+    CSpan Span = mNames[ix];
+    mIndex.Insert(NameHash(mPool.Field(Span)), [&](uint32_t other) {
+        return mNames[other] == Span;
+    }, [ix]() { return static_cast<uint32_t>(ix); });
+}
+
+template class CBasicColumnarMessages<wchar_t>;
+template class CBasicColumnarMessages<char>;
+
+//##############################################################################
+
+//------------------------------------------------------------------------------
+//! Function tests CColumnarMessages by checking that it gives the same
+//! translations as the CMessages object it is made from, that repeated text is
+//! stored once, that UTF-8 columns hold the same text, and that clearing it
+//! frees the pool.
+//
+uint32_t ColumnarMessagesTest(std::vector<std::string> &report) {
+    uint32_t NErrors = 0;
+    report.push_back("");
+    report.push_back("ColumnarMessages Test:");
+
+    std::vector<std::wstring> Languages = { L"English", L"German", L"French" };
+    CMessages Messages(Languages);
+    size_t References = 0; // Names, descriptions and used translations
+    size_t Shared = 0;     // German translations repeating the English
+    for (size_t Ix = 0; Ix < 500; ++Ix) {
+        CMessage Message;
+        std::wstring Number(std::to_wstring(Ix));
+        Message.Name(L"Message" + Number);
+        Message.Description(L"Description of message " + Number);
+        Message.Translate((Ix % 7 == 0) ? L'F' : L'T');
+        Message.TranslationAdd(L"English translation " + Number);
+        Message.TranslationAdd((Ix % 3 == 0) ? L"English translation " + Number
+            : L"Deutsche \x00dc" L"bersetzung " + Number); // Some shared text
+        if (Ix % 5 != 0) // Some messages lack a French translation
+            Message.TranslationAdd(L"Traduction fran\x00e7" L"aise " + Number);
+        References += 2 + (Message.DoTranslate()
+            ? Message.Translations().size() : 1);
+        if (Message.DoTranslate() && Ix % 3 == 0)
+            ++Shared;
+        Messages.MessageAdd(Message);
+    }
+
+    CColumnarMessages Columns(Messages);
+    std::vector<std::wstring> ColumnLanguages;
+    Columns.Languages(ColumnLanguages);
+    if (ColumnLanguages != Languages ||
+        Columns.MessageCount() != Messages.MessageCount()) {
+        report.push_back("  Incorrect languages or message count.");
+        ++NErrors;
+    }
+    Languages.push_back(L"Klingon");
+    for (const std::wstring &Language : Languages) {
+        std::vector<std::wstring> Expected, Actual;
+        Messages.Translations(Language, Expected);
+        Columns.Translations(Language, Actual);
+        if (Actual != Expected) {
+            report.push_back("  Incorrect translations for " +
+                WStrToUtf8(Language) + ".");
+            ++NErrors;
+        }
+    }
+    for (size_t Ix = 0; Ix < Messages.MessageCount(); ++Ix) {
+        const CMessage &Message = Messages.Message(Ix);
+        if (Columns.Name(Ix).Str() != Message.Name() ||
+            Columns.Description(Ix).Str() != Message.Description() ||
+            Columns.Translate(Ix) != Message.Translate()) {
+            report.push_back("  Incorrect message " + std::to_string(Ix) +
+                ".");
+            ++NErrors;
+        }
+    }
+    ELanguage German = Columns.Language(L"German");
+    for (const wchar_t *pName : { L"Message0", L"Message123", L"Missing" }) {
+        if (Columns.Lookup(pName, German).Str() !=
+            Messages.Lookup(pName, Messages.Language(L"German"))) {
+            report.push_back("  Incorrect lookup of " +
+                WStrToUtf8(pName) + ".");
+            ++NErrors;
+        }
+    }
+    const CStringPool &Pool = Columns.Pool();
+    if (Pool.References() != References ||
+        Pool.Strings() != References - Shared) {
+        report.push_back("  Incorrect pool counts.");
+        ++NErrors;
+    }
+
+    // UTF-8 columns give the same text in less memory
+    CUtf8ColumnarMessages Utf8Columns(Messages);
+    for (const std::wstring &Language : Languages) {
+        std::vector<std::wstring> Expected, Actual;
+        Columns.Translations(Language, Expected);
+        Utf8Columns.Translations(Language, Actual);
+        if (Actual != Expected) {
+            report.push_back("  Incorrect UTF-8 translations for " +
+                WStrToUtf8(Language) + ".");
+            ++NErrors;
+        }
+    }
+    if (Utf8Columns.Lookup(L"Message124", Utf8Columns.Language(L"German"))
+        .Str() != WStrToUtf8(Columns.Lookup(L"Message124", German).Str()) ||
+        Utf8Columns.Pool().Strings() != Pool.Strings() ||
+        Utf8Columns.MemoryUsed() >= Columns.MemoryUsed()) {
+        report.push_back("  Incorrect UTF-8 columns.");
+        ++NErrors;
+    }
+
+    // Copying some messages into another catalog interns only their text
+    CColumnarMessages Copied;
+    for (const std::wstring &Language : ColumnLanguages)
+        Copied.LanguageAdd(Language);
+    for (size_t Ix = 0; Ix < Columns.MessageCount(); Ix += 2)
+        Copied.MessageCopy(Columns, Ix);
+    bool IsSame = (Copied.MessageCount() == Columns.MessageCount() / 2);
+    for (size_t Ix = 0; IsSame && Ix < Copied.MessageCount(); ++Ix) {
+        IsSame = Copied.Name(Ix).Str() == Columns.Name(2 * Ix).Str() &&
+            Copied.Translate(Ix) == Columns.Translate(2 * Ix);
+        for (size_t Iy = 0; Iy < ColumnLanguages.size(); ++Iy) {
+            ELanguage Language = static_cast<ELanguage>(Iy);
+            IsSame = IsSame && Copied.Translation(Ix, Language).Str() ==
+                Columns.Translation(2 * Ix, Language).Str();
+        }
+    }
+    if (!IsSame || Copied.Find(L"Message1") != CColumnarMessages::NotFound ||
+        Copied.Find(L"Message2") != 1 ||
+        Copied.Pool().Strings() >= Pool.Strings() * 2 / 3) {
+        report.push_back("  Incorrect copied messages.");
+        ++NErrors;
+    }
+
+    Columns.Clear();
+    if (Columns.MessageCount() != 0 || Columns.Pool().MemoryUsed() != 0) {
+        report.push_back("  Clear() left " +
+            std::to_string(Columns.Pool().MemoryUsed()) + " bytes.");
+        ++NErrors;
+    }
+
+    return NErrors;
+}
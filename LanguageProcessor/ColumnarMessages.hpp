@@ -0,0 +1,122 @@
+//#pragma once
+
+#ifndef COLUMNAR_MESSAGES_HPP
+#define COLUMNAR_MESSAGES_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Utils.hpp"
+#include "TextTable.hpp"
+#include "Messages.hpp"
+#include "StringPool.hpp"
+
+//##############################################################################
+// CBasicColumnarMessages
+//##############################################################################
+//! Holds the content of a CMessages object column by column rather than
+//! message by message.  The text of every column (names, descriptions and the
+//! translations into each language) is interned into one shared string pool,
+//! and each column is an array of spans of the pool indexed by message
+//! position.  Identical strings, such as a text repeated across languages or
+//! the empty translations of many messages, are therefore stored once, and a
+//! catalog costs a few allocations in total rather than several per message.
+//! The pool keeps its text in an arena, so messages may be added straight
+//! from a file with a handful of bulk allocations, and clearing or destroying
+//! the catalog frees a few blocks and arrays rather than every string.
+//! Only the first translation of a message that is not to be translated is
+//! kept; the other columns refer to it.  Queries give the same results as the
+//! corresponding CMessages functions but return views of the pool, which
+//! remain valid until the object is changed.
+//! Each message may carry a fingerprint of the record it was loaded from, so
+//! that a reload can copy the messages whose records have not changed from
+//! the previous catalog with MessageCopy() rather than decode them again.
+//! Messages are indexed by name as in CMessages, and where several share a
+//! name the first is the one found.
+//!
+//! CColumnarMessages stores wide text, as CMessages does, and
+//! CUtf8ColumnarMessages stores UTF-8 text, which may be loaded from a file
+//! without converting it and written out as it is.  For mostly Latin text,
+//! UTF-8 takes a quarter of the memory of wide text where wchar_t has 32 bits
+//! and half where it has 16.  Language names, and names passed to Find() and
+//! Lookup(), are wide for both, and wide translations are available from
+//! either.
+//##############################################################################
+
+template <typename TChar>
+class CBasicColumnarMessages {
+public:
+    typedef CBasicField<TChar>       TField;
+    typedef std::basic_string<TChar> TString;
+    typedef CBasicStringPool<TChar>  TPool;
+    static const size_t NotFound = static_cast<size_t>(-1);
+
+    CBasicColumnarMessages();
+    CBasicColumnarMessages(const CMessages &messages);
+    CBasicColumnarMessages(const CBasicColumnarMessages &other) = delete;
+    CBasicColumnarMessages &operator=(const CBasicColumnarMessages &other) =
+        delete;
+
+    void Assign(const CMessages &messages);
+    void Clear();
+    void LanguageAdd(const std::wstring &language);
+    void MessageAdd(const TField &name, const TField &description,
+        wchar_t translate, const std::vector<TField> &translations,
+        uint64_t fingerprint = 0);
+    void MessageCopy(const CBasicColumnarMessages &other, size_t ix);
+
+    size_t    LanguageCount() const { return mLanguages.size(); }
+    size_t    MessageCount() const { return mTranslate.size(); }
+    ELanguage Language(const std::wstring &language) const;
+    void      Languages(std::vector<std::wstring> &languages) const;
+    TField    Name(size_t ix) const { return mPool.Field(mNames.at(ix)); }
+    TField    Description(size_t ix) const {
+        return mPool.Field(mDescriptions.at(ix));
+    }
+    wchar_t   Translate(size_t ix) const { return mTranslate.at(ix); }
+    TField    Translation(size_t ix, ELanguage language) const;
+    uint64_t  Fingerprint(size_t ix) const { return mFingerprints.at(ix); }
+    size_t    Find(const std::wstring &name) const;
+    size_t    Find(const TField &name, uint32_t hash) const;
+    TField    Lookup(const std::wstring &name, ELanguage language) const;
+
+    void Translations(ELanguage language,
+        std::vector<TField> &translations) const;
+    void Translations(ELanguage language,
+        std::vector<std::wstring> &translations) const;
+    void Translations(const std::wstring &language,
+        std::vector<std::wstring> &translations) const;
+
+    const TPool &Pool() const { return mPool; }
+    size_t MemoryUsed() const;
+
+    static uint32_t NameHash(const TField &name) {
+        return TextHash(name.pText, name.Len);
+    }
+
+private:
+    typedef typename TPool::CSpan CSpan;
+    typedef std::vector<CSpan>    CColumn;
+    static const uint32_t EmptySlot = 0xffffffff;
+
+    std::vector<std::wstring> mLanguages;
+    TPool                     mPool;
+    CColumn                   mNames;
+    CColumn                   mDescriptions;
+    std::vector<wchar_t>      mTranslate;
+    std::vector<CColumn>      mTranslations; // One column per language
+    std::vector<uint64_t>     mFingerprints; // Of each record, or zero
+    CHashIndex<uint32_t>      mIndex;        // Of positions, by name
+
+    void IndexAdd(size_t ix);
+};
+
+typedef CBasicColumnarMessages<wchar_t> CColumnarMessages;
+typedef CBasicColumnarMessages<char>    CUtf8ColumnarMessages;
+
+//##############################################################################
+
+uint32_t ColumnarMessagesTest(std::vector<std::string> &report);
+
+#endif // COLUMNAR_MESSAGES_HPP
@@ -0,0 +1,494 @@
+#include "stdafx.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <unordered_map>
+
+#include "Utils.hpp"
+#include "CompiledMessages.hpp"
+
+//##############################################################################
+// CCompiledMessages
+//##############################################################################
+//! Provides read-only access to a compiled messages file (.lpc), a binary
+//! image of a CMessages object that is memory mapped and queried in place.
+//##############################################################################
+
+const char CCompiledMessages::sMagic[4] = { 'L', 'P', 'C', '\x1a' };
+
+namespace {
+
+//------------------------------------------------------------------------------
+//! Function rounds offset up to the next multiple of 8.
+//
+inline size_t Align8(size_t offset) {
+    return (offset + 7) & ~static_cast<size_t>(7);
+}
+
+//------------------------------------------------------------------------------
+//! Function returns the Modbus CRC of the specified bytes.
+//
+uint16_t BufferCRC(const char *pdata, size_t size) {
+    CModbusCRC CRC;
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(pdata);
+    while (size > 0) { // CModbusCRC::Add() takes a 32 bit count
+        uint32_t Count = (size > 0x40000000) ? 0x40000000 :
+            static_cast<uint32_t>(size);
+        CRC.Add(p, Count);
+        p += Count;
+        size -= Count;
+    }
+    return CRC.Value();
+}
+
+} // namespace
+
+//------------------------------------------------------------------------------
+//! Default constructor creates an object with no file open.
+//
+CCompiledMessages::CCompiledMessages() : mpHeader(nullptr),
+    mpLanguages(nullptr), mpMessages(nullptr), mpTranslations(nullptr),
+    mpPool(nullptr) {
+}
+
+//------------------------------------------------------------------------------
+//! Static function writes messages to the specified file as a compiled
+//! messages file.  Strings are stored once however often they occur.
+//
+void CCompiledMessages::Compile(const CMessages &messages,
+    const std::string &fileName) {
+    std::vector<std::wstring> Languages;
+    messages.Languages(Languages);
+    size_t NLanguages = Languages.size();
+    size_t NMessages = messages.MessageCount();
+    if (NLanguages > 0xffffffff || NMessages > 0xffffffff ||
+        NMessages * NLanguages > 0x0fffffff)
+        throw std::runtime_error("CCompiledMessages::Compile(): Too many "
+            "messages or languages.");
+
+    // Build the pool, sharing duplicate strings
+    std::string Pool;
+    std::unordered_map<std::string, CLpcString> PoolIndex;
+    auto StringMake = [&Pool, &PoolIndex](const std::wstring &text) {
+        std::string Utf8(WStrToUtf8(text));
+        auto It = PoolIndex.find(Utf8);
+        if (It != PoolIndex.end())
+            return It->second;
+        if (Pool.size() + Utf8.size() > 0xffffffff)
+            throw std::runtime_error("CCompiledMessages::Compile(): Text "
+                "exceeds 4 GB.");
+        CLpcString String = { static_cast<uint32_t>(Pool.size()),
+            static_cast<uint32_t>(Utf8.size()) };
+        Pool += Utf8;
+        PoolIndex.emplace(std::move(Utf8), String);
+        return String;
+    };
+
+    std::vector<CLpcString> LpcLanguages;
+    for (const std::wstring &Language : Languages)
+        LpcLanguages.push_back(StringMake(Language));
+
+    std::vector<CLpcMessage> LpcMessages(NMessages);
+    std::vector<CLpcString> LpcTranslations(NMessages * NLanguages);
+    std::vector<std::wstring> Translations;
+    for (size_t Ix = 0; Ix < NMessages; ++Ix) {
+        const CMessage &Message = messages.Message(Ix);
+        CLpcMessage &LpcMessage = LpcMessages[Ix];
+        LpcMessage.Name = StringMake(Message.Name());
+        LpcMessage.Description = StringMake(Message.Description());
+        LpcMessage.Translate = static_cast<uint32_t>(Message.Translate());
+        LpcMessage.Reserved = 0;
+        Translations = Message.Translations();
+        Translations.resize(NLanguages); // Missing translations are empty
+        for (size_t Iy = 0; Iy < NLanguages; ++Iy)
+            LpcTranslations[Ix * NLanguages + Iy] =
+                StringMake(Translations[Iy]);
+    }
+
+    // Lay out the sections
+    CLpcHeader Header;
+    std::memset(&Header, 0, sizeof(Header));
+    std::memcpy(Header.Magic, sMagic, sizeof(Header.Magic));
+    Header.Version = sVersion;
+    Header.NLanguages = static_cast<uint32_t>(NLanguages);
+    Header.NMessages = static_cast<uint32_t>(NMessages);
+    Header.LanguagesOffset = Align8(sizeof(CLpcHeader));
+    Header.MessagesOffset = Align8(Header.LanguagesOffset +
+        NLanguages * sizeof(CLpcString));
+    Header.TranslationsOffset = Align8(Header.MessagesOffset +
+        NMessages * sizeof(CLpcMessage));
+    Header.PoolOffset = Align8(Header.TranslationsOffset +
+        LpcTranslations.size() * sizeof(CLpcString));
+    Header.PoolSize = Pool.size();
+    Header.FileSize = Header.PoolOffset + Header.PoolSize;
+
+    std::string Image(static_cast<size_t>(Header.FileSize), '\0');
+    auto SectionCopy = [&Image](uint64_t offset, const void *pdata,
+        size_t size) {
+        if (size > 0)
+            std::memcpy(&Image[static_cast<size_t>(offset)], pdata, size);
+    };
+    SectionCopy(Header.LanguagesOffset, LpcLanguages.data(),
+        LpcLanguages.size() * sizeof(CLpcString));
+    SectionCopy(Header.MessagesOffset, LpcMessages.data(),
+        LpcMessages.size() * sizeof(CLpcMessage));
+    SectionCopy(Header.TranslationsOffset, LpcTranslations.data(),
+        LpcTranslations.size() * sizeof(CLpcString));
+    SectionCopy(Header.PoolOffset, Pool.data(), Pool.size());
+
+    Header.BodyCRC = BufferCRC(Image.data() + sizeof(CLpcHeader),
+        Image.size() - sizeof(CLpcHeader));
+    Header.HeaderCRC = HeaderCRC(Header);
+    SectionCopy(0, &Header, sizeof(Header));
+
+    std::ofstream File(fileName, std::ios::binary | std::ios::trunc);
+    if (!File.write(Image.data(), Image.size()) || !File.flush())
+        throw std::runtime_error("Failed to write \"" + fileName + "\".");
+}
+
+//------------------------------------------------------------------------------
+//! Function maps the specified compiled messages file and checks its header
+//! and section bounds, replacing any file opened previously.  The body of the
+//! file is not read until it is queried.
+//
+void CCompiledMessages::Open(const std::string &fileName) {
+    Close();
+    mFile.Open(fileName);
+
+    const char *pdata = mFile.Data();
+    size_t Size = mFile.Size();
+    const CLpcHeader *pheader = reinterpret_cast<const CLpcHeader *>(pdata);
+    bool IsValid = Size >= sizeof(CLpcHeader) &&
+        std::memcmp(pheader->Magic, sMagic, sizeof(sMagic)) == 0 &&
+        pheader->Version == sVersion &&
+        pheader->HeaderCRC == HeaderCRC(*pheader) &&
+        pheader->FileSize == Size;
+    if (IsValid) {
+        // Each section must fit between its offset and the start of the next
+        // one, checked in a form that cannot overflow whatever the header
+        // holds.  The counts are 32 bits, so their product cannot overflow.
+        auto Fits = [](uint64_t offset, uint64_t count, uint64_t itemSize,
+            uint64_t end) {
+            return offset <= end && count <= (end - offset) / itemSize;
+        };
+        uint64_t NLanguages = pheader->NLanguages;
+        uint64_t NMessages = pheader->NMessages;
+        IsValid = pheader->LanguagesOffset >= sizeof(CLpcHeader) &&
+            Fits(pheader->PoolOffset, pheader->PoolSize, 1, Size) &&
+            Fits(pheader->TranslationsOffset, NMessages * NLanguages,
+            sizeof(CLpcString), pheader->PoolOffset) &&
+            Fits(pheader->MessagesOffset, NMessages, sizeof(CLpcMessage),
+            pheader->TranslationsOffset) &&
+            Fits(pheader->LanguagesOffset, NLanguages, sizeof(CLpcString),
+            pheader->MessagesOffset) &&
+            (pheader->LanguagesOffset | pheader->MessagesOffset |
+            pheader->TranslationsOffset) % 8 == 0;
+    }
+    if (!IsValid) {
+        mFile.Close();
+        throw std::runtime_error("\"" + fileName + "\" is not a valid "
+            "compiled messages file.");
+    }
+
+    mpHeader = pheader;
+    mpLanguages = reinterpret_cast<const CLpcString *>(
+        pdata + pheader->LanguagesOffset);
+    mpMessages = reinterpret_cast<const CLpcMessage *>(
+        pdata + pheader->MessagesOffset);
+    mpTranslations = reinterpret_cast<const CLpcString *>(
+        pdata + pheader->TranslationsOffset);
+    mpPool = pdata + pheader->PoolOffset;
+}
+
+//------------------------------------------------------------------------------
+//! Function closes the file, if any.
+//
+void CCompiledMessages::Close() {
+    mFile.Close();
+    mpHeader = nullptr;
+    mpLanguages = nullptr;
+    mpMessages = nullptr;
+    mpTranslations = nullptr;
+    mpPool = nullptr;
+}
+
+//------------------------------------------------------------------------------
+//! Function returns true if the CRC of the body of the file is correct.  It
+//! reads the whole file, so is intended for use after a file is copied, not
+//! every time a file is opened.
+//
+bool CCompiledMessages::Verify() const {
+    if (mpHeader == nullptr)
+        return false;
+    return BufferCRC(mFile.Data() + sizeof(CLpcHeader),
+        mFile.Size() - sizeof(CLpcHeader)) == mpHeader->BodyCRC;
+}
+
+//------------------------------------------------------------------------------
+//! Function returns the handle of the specified language, or ELanguage::Invalid
+//! if it is not known.
+//
+ELanguage CCompiledMessages::Language(const std::wstring &language) const {
+    std::string Utf8(WStrToUtf8(language));
+    size_t NLanguages = LanguageCount();
+    for (size_t Ix = 0; Ix < NLanguages; ++Ix)
+        if (String(mpLanguages[Ix]).Equals(Utf8.c_str()))
+            return static_cast<ELanguage>(Ix);
+    return ELanguage::Invalid;
+}
+
+//------------------------------------------------------------------------------
+//! Function returns the name of the language with the specified handle.
+//
+CUtf8Field CCompiledMessages::LanguageName(ELanguage language) const {
+    size_t Ix = static_cast<size_t>(language);
+    if (Ix >= LanguageCount())
+        throw std::runtime_error("CCompiledMessages::LanguageName(): Invalid "
+            "language.");
+    return String(mpLanguages[Ix]);
+}
+
+//------------------------------------------------------------------------------
+//! Function returns the name of the specified message.
+//
+CUtf8Field CCompiledMessages::Name(size_t messageIx) const {
+    if (messageIx >= MessageCount())
+        throw std::runtime_error("CCompiledMessages::Name(): Invalid index.");
+    return String(mpMessages[messageIx].Name);
+}
+
+//------------------------------------------------------------------------------
+//! Function returns the description of the specified message.
+//
+CUtf8Field CCompiledMessages::Description(size_t messageIx) const {
+    if (messageIx >= MessageCount())
+        throw std::runtime_error("CCompiledMessages::Description(): Invalid "
+            "index.");
+    return String(mpMessages[messageIx].Description);
+}
+
+//------------------------------------------------------------------------------
+//! Function returns the translate flag of the specified message.
+//
+wchar_t CCompiledMessages::Translate(size_t messageIx) const {
+    if (messageIx >= MessageCount())
+        throw std::runtime_error("CCompiledMessages::Translate(): Invalid "
+            "index.");
+    return static_cast<wchar_t>(mpMessages[messageIx].Translate);
+}
+
+//------------------------------------------------------------------------------
+//! Function returns the translation of the specified message into the
+//! language with the specified handle, as CMessage::Translation() does: "???"
+//! if the language is not known and the first translation if the message is
+//! not to be translated.
+//
+CUtf8Field CCompiledMessages::Translation(size_t messageIx,
+    ELanguage language) const {
+    if (messageIx >= MessageCount())
+        throw std::runtime_error("CCompiledMessages::Translation(): Invalid "
+            "index.");
+    size_t LanguageIx = static_cast<size_t>(language);
+    if (LanguageIx >= LanguageCount()) { // If language not found
+        const std::string &Unknown = UnknownUtf8Translation();
+        CUtf8Field Field = { Unknown.data(), Unknown.size() };
+        return Field;
+    }
+    if (mpMessages[messageIx].Translate == L'F') // If do not translate
+        LanguageIx = 0;
+    return String(mpTranslations[messageIx * LanguageCount() + LanguageIx]);
+}
+
+//------------------------------------------------------------------------------
+//! Function returns the list of languages.
+//
+void CCompiledMessages::Languages(std::vector<std::wstring> &languages) const {
+    size_t NLanguages = LanguageCount();
+    languages.resize(NLanguages);
+    for (size_t Ix = 0; Ix < NLanguages; ++Ix) {
+        CUtf8Field Field = String(mpLanguages[Ix]);
+        Utf8ToWStr(Field.pText, Field.Len, languages[Ix]);
+    }
+}
+
+//------------------------------------------------------------------------------
+//! Function returns the translations for the language with the specified
+//! handle.
+//
+void CCompiledMessages::Translations(ELanguage language,
+    std::vector<std::wstring> &translations) const {
+    size_t NMessages = MessageCount();
+    translations.resize(NMessages);
+    for (size_t Ix = 0; Ix < NMessages; ++Ix) {
+        CUtf8Field Field = Translation(Ix, language);
+        Utf8ToWStr(Field.pText, Field.Len, translations[Ix]);
+    }
+}
+
+//------------------------------------------------------------------------------
+//! Function returns the translations for the specified language.
+//
+void CCompiledMessages::Translations(const std::wstring &language,
+    std::vector<std::wstring> &translations) const {
+    Translations(Language(language), translations);
+}
+
+//------------------------------------------------------------------------------
+//! Private static function returns the CRC of the header, excluding the
+//! HeaderCRC field itself.
+//
+uint16_t CCompiledMessages::HeaderCRC(const CLpcHeader &header) {
+    CLpcHeader Header(header);
+    Header.HeaderCRC = 0;
+    return BufferCRC(reinterpret_cast<const char *>(&Header), sizeof(Header));
+}
+
+//------------------------------------------------------------------------------
+//! Private function returns the text of a string within the pool.
+//
+CUtf8Field CCompiledMessages::String(const CLpcString &string) const {
+    if (static_cast<uint64_t>(string.Offset) + string.Len > mpHeader->PoolSize)
+        throw std::runtime_error("CCompiledMessages: Corrupt string in \"" +
+            mFile.FileName() + "\".");
+    CUtf8Field Field = { mpPool + string.Offset, string.Len };
+    return Field;
+}
+
+//##############################################################################
+
+//------------------------------------------------------------------------------
+//! Function tests CCompiledMessages by compiling messages to a temporary file
+//! and checking that the compiled file gives the same translations, and that
+//! a damaged file is rejected.
+//
+uint32_t CompiledMessagesTest(std::vector<std::string> &report) {
+    static const char FileName[] = "CompiledMessagesTest.lpc";
+    static const wchar_t *Table[][5] = {
+        { L"T", L"Hello",   L"Hallo",   L"Bonjour", L"Hola"  },
+        { L"F", L"OK",      L"Okay",    L"D'accord", L"Vale" },
+        { L"T", L"Yes",     L"Ja",      L"Oui",     L"S\u00ed" },
+        { L"T", L"Hello",   L"",        L"Salut",   nullptr  },
+    };
+
+    uint32_t NErrors = 0;
+    report.push_back("");
+    report.push_back("CompiledMessages Test:");
+
+    std::vector<std::wstring> Languages = {
+        L"English", L"German", L"French", L"Spanish"
+    };
+    CMessages Messages(Languages);
+    size_t Ix = 0;
+    for (const auto &Row : Table) {
+        CMessage Message;
+        Message.Name(L"Msg" + std::to_wstring(Ix++));
+        Message.Description(L"Test message");
+        Message.Translate(Row[0][0]);
+        for (size_t Iy = 1; Iy < 5 && Row[Iy] != nullptr; ++Iy)
+            Message.TranslationAdd(Row[Iy]);
+        Messages.MessageAdd(Message);
+    }
+
+    try {
+        CCompiledMessages::Compile(Messages, FileName);
+        CCompiledMessages Compiled;
+        Compiled.Open(FileName);
+        if (!Compiled.Verify()) {
+            report.push_back("  Verify() failed.");
+            ++NErrors;
+        }
+
+        std::vector<std::wstring> CompiledLanguages;
+        Compiled.Languages(CompiledLanguages);
+        if (CompiledLanguages != Languages) {
+            report.push_back("  Incorrect languages.");
+            ++NErrors;
+        }
+        Languages.push_back(L"Klingon");
+        for (const std::wstring &Language : Languages) {
+            std::vector<std::wstring> Expected, Actual;
+            Messages.Translations(Language, Expected);
+            Compiled.Translations(Language, Actual);
+            if (Actual != Expected) {
+                report.push_back("  Incorrect translations for " +
+                    WStrToUtf8(Language) + ".");
+                ++NErrors;
+            }
+        }
+        if (!Compiled.Name(2).Equals("Msg2")) {
+            report.push_back("  Incorrect name.");
+            ++NErrors;
+        }
+        Compiled.Close();
+
+        // Damage the last byte of the pool
+        {
+            std::fstream File(FileName, std::ios::in | std::ios::out |
+                std::ios::binary);
+            File.seekg(-1, std::ios::end);
+            char Ch = static_cast<char>(File.get() ^ 0x20);
+            File.seekp(-1, std::ios::end);
+            File.put(Ch);
+        }
+        Compiled.Open(FileName);
+        if (Compiled.Verify()) {
+            report.push_back("  Damaged file not detected.");
+            ++NErrors;
+        }
+        Compiled.Close();
+
+        // Craft headers, with correct CRCs, whose sections would lie outside
+        // the file if their bounds were summed without regard to overflow
+        typedef CCompiledMessages::CLpcHeader CHeader;
+        std::string Image;
+        {
+            std::ifstream File(FileName, std::ios::binary);
+            Image.assign(std::istreambuf_iterator<char>(File),
+                std::istreambuf_iterator<char>());
+        }
+        auto IsRejected = [&](void (*pcraft)(CHeader &header)) {
+            CHeader Header;
+            std::memcpy(&Header, Image.data(), sizeof(Header));
+            pcraft(Header);
+            Header.HeaderCRC = CCompiledMessages::HeaderCRC(Header);
+            std::string Crafted(Image);
+            std::memcpy(&Crafted[0], &Header, sizeof(Header));
+            {
+                std::ofstream File(FileName, std::ios::binary |
+                    std::ios::trunc);
+                File.write(Crafted.data(), Crafted.size());
+            }
+            try {
+                Compiled.Open(FileName);
+            }
+            catch (std::exception &) {
+                return !Compiled.IsOpen();
+            }
+            Compiled.Close();
+            return false;
+        };
+        if (!IsRejected([](CHeader &header) {
+                header.MessagesOffset = ~static_cast<uint64_t>(15);
+            }) ||
+            !IsRejected([](CHeader &header) {
+                header.PoolSize = ~static_cast<uint64_t>(0);
+            }) ||
+            !IsRejected([](CHeader &header) {
+                header.NLanguages = 0xffffffff;
+                header.NMessages = 0xffffffff;
+            })) {
+            report.push_back("  Crafted section bounds not detected.");
+            ++NErrors;
+        }
+    }
+    catch (std::exception &e) {
+        report.push_back(std::string("  ") + e.what());
+        ++NErrors;
+    }
+    std::remove(FileName);
+
+    return NErrors;
+}
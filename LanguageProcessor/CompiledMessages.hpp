@@ -0,0 +1,123 @@
+//#pragma once
+
+#ifndef COMPILED_MESSAGES_HPP
+#define COMPILED_MESSAGES_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "MappedFile.hpp"
+#include "TextTable.hpp"
+#include "Messages.hpp"
+
+//##############################################################################
+// CCompiledMessages
+//##############################################################################
+//! Provides read-only access to a compiled messages file (.lpc), a binary
+//! image of a CMessages object that is memory mapped and queried in place, so
+//! that opening it costs the same however many messages it holds.  The file
+//! is laid out as follows, with every section starting on an 8 byte boundary:
+//!
+//!   Header        CLpcHeader
+//!   Languages     CLpcString[NLanguages]
+//!   Messages      CLpcMessage[NMessages]
+//!   Translations  CLpcString[NMessages * NLanguages], by message
+//!   Pool          UTF-8 text of all strings, each distinct string once
+//!
+//! Open() checks the header and the section bounds only; Verify() also checks
+//! the CRC of the body of the file.  Queries give the same results as the
+//! corresponding CMessages and CMessage functions, and languages are likewise
+//! referred to by ELanguage handles.
+//##############################################################################
+
+class CCompiledMessages {
+public:
+    CCompiledMessages();
+    CCompiledMessages(const CCompiledMessages &other) = delete;
+    CCompiledMessages &operator=(const CCompiledMessages &other) = delete;
+
+    static void Compile(const CMessages &messages, const std::string &fileName);
+
+    void Open(const std::string &fileName);
+    void Close();
+    bool IsOpen() const { return mFile.IsOpen(); }
+    bool Verify() const;
+
+    size_t     LanguageCount() const;
+    size_t     MessageCount() const;
+    ELanguage  Language(const std::wstring &language) const;
+    CUtf8Field LanguageName(ELanguage language) const;
+    CUtf8Field Name(size_t messageIx) const;
+    CUtf8Field Description(size_t messageIx) const;
+    wchar_t    Translate(size_t messageIx) const;
+    CUtf8Field Translation(size_t messageIx, ELanguage language) const;
+
+    void Languages(std::vector<std::wstring> &languages) const;
+    void Translations(ELanguage language,
+        std::vector<std::wstring> &translations) const;
+    void Translations(const std::wstring &language,
+        std::vector<std::wstring> &translations) const;
+
+private:
+    static const char     sMagic[4];
+    static const uint16_t sVersion = 1;
+
+    struct CLpcString {
+        uint32_t Offset; // Offset within the pool
+        uint32_t Len;    // Length in bytes
+    };
+    struct CLpcMessage {
+        CLpcString Name;
+        CLpcString Description;
+        uint32_t   Translate;
+        uint32_t   Reserved;
+    };
+    struct CLpcHeader {
+        char     Magic[4];
+        uint16_t Version;
+        uint16_t HeaderCRC; // CRC of the header with HeaderCRC zero
+        uint32_t NLanguages;
+        uint32_t NMessages;
+        uint64_t LanguagesOffset;
+        uint64_t MessagesOffset;
+        uint64_t TranslationsOffset;
+        uint64_t PoolOffset;
+        uint64_t PoolSize;
+        uint64_t FileSize;
+        uint16_t BodyCRC;   // CRC of everything after the header
+        uint16_t Reserved[3];
+    };
+
+    CMappedFile        mFile;
+    const CLpcHeader  *mpHeader;
+    const CLpcString  *mpLanguages;
+    const CLpcMessage *mpMessages;
+    const CLpcString  *mpTranslations;
+    const char        *mpPool;
+
+    static uint16_t HeaderCRC(const CLpcHeader &header);
+    CUtf8Field String(const CLpcString &string) const;
+
+    friend uint32_t CompiledMessagesTest(std::vector<std::string> &report);
+};
+
+//------------------------------------------------------------------------------
+//! Function returns the number of languages, or zero if no file is open.
+//
+inline size_t CCompiledMessages::LanguageCount() const {
+    return (mpHeader != nullptr) ? mpHeader->NLanguages : 0;
+}
+
+//------------------------------------------------------------------------------
+//! Function returns the number of messages, or zero if no file is open.
+//
+inline size_t CCompiledMessages::MessageCount() const {
+    return (mpHeader != nullptr) ? mpHeader->NMessages : 0;
+}
+
+//##############################################################################
+
+uint32_t CompiledMessagesTest(std::vector<std::string> &report);
+
+#endif // COMPILED_MESSAGES_HPP
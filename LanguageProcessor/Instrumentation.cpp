@@ -0,0 +1,160 @@
+#include "stdafx.h"
+
+#include <chrono>
+#include <iomanip>
+#include <ostream>
+#include <sstream>
+#include <thread>
+
+#include "Instrumentation.hpp"
+
+//##############################################################################
+// CInstrumentation
+//##############################################################################
+//! Accumulates phase times and counters, and writes them as JSON.
+//##############################################################################
+
+namespace {
+
+const char *sPhaseNames[] = { "open", "read", "parse", "decode",
+    "message_add", "lookup" };
+const char *sCounterNames[] = { "rows", "bytes", "fields", "quoted_fields" };
+
+static_assert(sizeof(sPhaseNames) / sizeof(*sPhaseNames) ==
+    static_cast<size_t>(EPhase::Count), "A phase has no name.");
+static_assert(sizeof(sCounterNames) / sizeof(*sCounterNames) ==
+    static_cast<size_t>(ECounter::Count), "A counter has no name.");
+
+} // namespace
+
+//------------------------------------------------------------------------------
+//! Constructor creates an object with all times and counts zero.
+//
+CInstrumentation::CInstrumentation() {
+    Clear();
+}
+
+//------------------------------------------------------------------------------
+//! Function sets all times and counts to zero.
+//
+void CInstrumentation::Clear() {
+    for (size_t Ix = 0; Ix < static_cast<size_t>(EPhase::Count); ++Ix) {
+        mNs[Ix] = 0;
+        mCalls[Ix] = 0;
+    }
+    for (uint64_t &Count : mCounts)
+        Count = 0;
+    mTotalNs = 0;
+}
+
+//------------------------------------------------------------------------------
+//! Function adds time spent in a phase, and the number of times it was
+//! entered.
+//
+void CInstrumentation::Add(EPhase phase, uint64_t ns, uint64_t calls) {
+    size_t Ix = static_cast<size_t>(phase);
+    mNs[Ix] += ns;
+    mCalls[Ix] += calls;
+    mTotalNs += ns;
+}
+
+//------------------------------------------------------------------------------
+//! Function adds the times and counts of another object, such as one used by
+//! another thread.
+//
+void CInstrumentation::Merge(const CInstrumentation &other) {
+    for (size_t Ix = 0; Ix < static_cast<size_t>(EPhase::Count); ++Ix)
+        Add(static_cast<EPhase>(Ix), other.mNs[Ix], other.mCalls[Ix]);
+    for (size_t Ix = 0; Ix < static_cast<size_t>(ECounter::Count); ++Ix)
+        mCounts[Ix] += other.mCounts[Ix];
+}
+
+//------------------------------------------------------------------------------
+//! Function writes the phase times, in milliseconds, and the counters as a
+//! JSON object.
+//
+void CInstrumentation::Json(std::ostream &stream) const {
+    std::ostringstream Text;
+    Text << "{" << std::endl << "  \"phases\": {" << std::endl;
+    for (size_t Ix = 0; Ix < static_cast<size_t>(EPhase::Count); ++Ix) {
+        Text << "    \"" << sPhaseNames[Ix] << "\": { \"calls\": "
+            << mCalls[Ix] << ", \"ms\": " << std::fixed
+            << std::setprecision(3) << mNs[Ix] / 1e6 << " }"
+            << (Ix + 1 < static_cast<size_t>(EPhase::Count) ? "," : "")
+            << std::endl;
+    }
+    Text << "  }," << std::endl << "  \"counters\": {" << std::endl;
+    for (size_t Ix = 0; Ix < static_cast<size_t>(ECounter::Count); ++Ix) {
+        Text << "    \"" << sCounterNames[Ix] << "\": " << mCounts[Ix]
+            << (Ix + 1 < static_cast<size_t>(ECounter::Count) ? "," : "")
+            << std::endl;
+    }
+    Text << "  }" << std::endl << "}" << std::endl;
+    stream << Text.str();
+}
+
+//------------------------------------------------------------------------------
+//! Static function returns a monotonic time in nanoseconds.
+//
+uint64_t CInstrumentation::Now() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<
+        std::chrono::nanoseconds>(std::chrono::steady_clock::now()
+        .time_since_epoch()).count());
+}
+
+//##############################################################################
+
+//------------------------------------------------------------------------------
+//! Function tests CInstrumentation by timing nested phases, and checking that
+//! inner phases are not counted in outer ones, that nothing is timed without
+//! an object, and that merged objects add up.
+//
+uint32_t InstrumentationTest(std::vector<std::string> &report) {
+    uint32_t NErrors = 0;
+    report.push_back("");
+    report.push_back("Instrumentation Test:");
+
+    CInstrumentation Instrumentation;
+    {
+        CPhaseTimer Outer(&Instrumentation, EPhase::Parse);
+        for (size_t Ix = 0; Ix < 3; ++Ix) {
+            CPhaseTimer Inner(&Instrumentation, EPhase::Decode);
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        CPhaseTimer Unused(nullptr, EPhase::Lookup);
+    }
+    // The parse phase itself does next to nothing
+    if (Instrumentation.Calls(EPhase::Parse) != 1 ||
+        Instrumentation.Calls(EPhase::Decode) != 3 ||
+        Instrumentation.Calls(EPhase::Lookup) != 0 ||
+        Instrumentation.Ns(EPhase::Decode) < 30000000 ||
+        Instrumentation.Ns(EPhase::Parse) >
+        Instrumentation.Ns(EPhase::Decode) / 10 ||
+        Instrumentation.TotalNs() != Instrumentation.Ns(EPhase::Parse) +
+        Instrumentation.Ns(EPhase::Decode)) {
+        report.push_back("  Incorrect nested phases: parse " +
+            std::to_string(Instrumentation.Ns(EPhase::Parse)) +
+            " ns, decode " + std::to_string(Instrumentation.Ns(
+            EPhase::Decode)) + " ns.");
+        ++NErrors;
+    }
+
+    CInstrumentation Other;
+    Other.Add(EPhase::Decode, 5, 2);
+    Other.Add(ECounter::Rows, 7);
+    uint64_t DecodeNs = Instrumentation.Ns(EPhase::Decode);
+    Instrumentation.Merge(Other);
+    Instrumentation.Add(ECounter::Rows, 1);
+    std::ostringstream Json;
+    Instrumentation.Json(Json);
+    if (Instrumentation.Ns(EPhase::Decode) != DecodeNs + 5 ||
+        Instrumentation.Calls(EPhase::Decode) != 5 ||
+        Instrumentation.Count(ECounter::Rows) != 8 ||
+        Json.str().find("\"decode\": { \"calls\": 5,") == std::string::npos ||
+        Json.str().find("\"rows\": 8,") == std::string::npos) {
+        report.push_back("  Incorrect merge or JSON.");
+        ++NErrors;
+    }
+
+    return NErrors;
+}
@@ -0,0 +1,134 @@
+//#pragma once
+
+#ifndef INSTRUMENTATION_HPP
+#define INSTRUMENTATION_HPP
+
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+//##############################################################################
+// EPhase, ECounter
+//##############################################################################
+//! Phases of loading and using a messages file that are timed, and quantities
+//! that are counted, by CInstrumentation.
+//##############################################################################
+
+enum class EPhase {
+    Open,       // Opening and mapping the file
+    Read,       // Reading chunks from a stream
+    Parse,      // Splitting records into values
+    Decode,     // Converting values from UTF-8
+    MessageAdd, // Adding messages to a catalog
+    Lookup,     // Looking translations up
+    Count
+};
+
+enum class ECounter {
+    Rows,         // Records parsed, including the heading
+    Bytes,        // Bytes of input parsed
+    Fields,       // Values in the records parsed
+    QuotedFields, // Values that were quoted
+    Count
+};
+
+//##############################################################################
+// CInstrumentation
+//##############################################################################
+//! Accumulates the time spent in each phase, and the number of times it was
+//! entered, and a set of counters, and writes them as a JSON summary.  Phases
+//! are timed by CPhaseTimer objects, and nest: the time of an inner phase is
+//! not counted in the outer one, so the phase times add up to the time
+//! measured.  Functions that support instrumentation take a pointer to a
+//! CInstrumentation object and do nothing extra if it is nullptr.  An object
+//! belongs to one thread; a function using several threads gives each its own
+//! and merges them, so the time of a phase may exceed the elapsed time.
+//##############################################################################
+
+class CInstrumentation {
+public:
+    CInstrumentation();
+
+    void Clear();
+    void Add(EPhase phase, uint64_t ns, uint64_t calls = 1);
+    void Add(ECounter counter, uint64_t count) {
+        mCounts[static_cast<size_t>(counter)] += count;
+    }
+    void Merge(const CInstrumentation &other);
+
+    uint64_t Ns(EPhase phase) const {
+        return mNs[static_cast<size_t>(phase)];
+    }
+    uint64_t Calls(EPhase phase) const {
+        return mCalls[static_cast<size_t>(phase)];
+    }
+    uint64_t Count(ECounter counter) const {
+        return mCounts[static_cast<size_t>(counter)];
+    }
+    uint64_t TotalNs() const { return mTotalNs; }
+    void     Json(std::ostream &stream) const;
+
+    static uint64_t Now();
+
+private:
+    uint64_t mNs[static_cast<size_t>(EPhase::Count)];
+    uint64_t mCalls[static_cast<size_t>(EPhase::Count)];
+    uint64_t mCounts[static_cast<size_t>(ECounter::Count)];
+    uint64_t mTotalNs; // Of all phases
+};
+
+//##############################################################################
+// CPhaseTimer
+//##############################################################################
+//! Times a phase from its construction to its destruction, or to Stop() if
+//! that is called first, less the time of any phases timed within it, if it is
+//! given a CInstrumentation object.
+//##############################################################################
+
+class CPhaseTimer {
+public:
+    CPhaseTimer(CInstrumentation *pinstrumentation, EPhase phase);
+    CPhaseTimer(const CPhaseTimer &other) = delete;
+    CPhaseTimer &operator=(const CPhaseTimer &other) = delete;
+    ~CPhaseTimer() { Stop(); }
+
+    void Stop();
+
+private:
+    CInstrumentation *mpInstrumentation;
+    EPhase            mPhase;
+    uint64_t          mStart;
+    uint64_t          mNestedStart; // Total time of all phases at the start
+};
+
+//------------------------------------------------------------------------------
+//! Constructor starts timing the phase, if there is an object to add it to.
+//
+inline CPhaseTimer::CPhaseTimer(CInstrumentation *pinstrumentation,
+    EPhase phase) : mpInstrumentation(pinstrumentation), mPhase(phase),
+    mStart(0), mNestedStart(0) {
+    if (mpInstrumentation != nullptr) {
+        mNestedStart = mpInstrumentation->TotalNs();
+        mStart = CInstrumentation::Now();
+    }
+}
+
+//------------------------------------------------------------------------------
+//! Function ends the phase, adding its time less that of nested phases.
+//
+inline void CPhaseTimer::Stop() {
+    if (mpInstrumentation != nullptr) {
+        uint64_t Elapsed = CInstrumentation::Now() - mStart;
+        uint64_t Nested = mpInstrumentation->TotalNs() - mNestedStart;
+        mpInstrumentation->Add(mPhase, Elapsed > Nested ? Elapsed - Nested
+            : 0);
+        mpInstrumentation = nullptr;
+    }
+}
+
+//##############################################################################
+
+uint32_t InstrumentationTest(std::vector<std::string> &report);
+
+#endif // INSTRUMENTATION_HPP
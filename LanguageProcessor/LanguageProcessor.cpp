@@ -2,6 +2,7 @@
 
 #include <iostream>
 #include <iomanip>
+#include <algorithm>
 #include <fstream>
 #include <vector>
 #include <string>
@@ -10,100 +11,209 @@
 
 #include "Utils.hpp"
 #include "TextTable.hpp"
+#include "TextPushParser.hpp"
+#include "TextWriter.hpp"
 #include "Messages.hpp"
-#include "Switches.hpp""
+#include "MessagesFile.hpp"
+#include "CompiledMessages.hpp"
+#include "MessagesHeader.hpp"
+#include "ColumnarMessages.hpp"
+#include "CatalogHandle.hpp"
+#include "TranslationContext.hpp"
+#include "Arena.hpp"
+#include "StringPool.hpp"
+#include "Instrumentation.hpp"
+#include "AllocationTracker.hpp"
+#include "Switches.hpp"
 
 #define VERBOSE
 
 int main(int argc, char** argv) {
-    static const size_t NameIx = 0;
-    static const size_t DescIx = 1;
-    static const size_t TypeIx = 2;
-    static const size_t LangIx = 3;
     static const CSwitchSpec SwitchSpecs[] = {
+        { "-c",    ESwitchID::Compile,  1, 1 },
+        { "-e",    ESwitchID::Export,   1, 1 },
         { "-h",    ESwitchID::Help,     0, 0 },
         { "-?",    ESwitchID::Help,     0, 0 },
+        { "-i",    ESwitchID::Input,    1, 1 },
         { "-l",    ESwitchID::Language, 1, 4 },
+        { "-m",    ESwitchID::Memory,   0, 0 },
         { "-p",    ESwitchID::Pause,    0, 0 },
+        { "-t",    ESwitchID::Threads,  0, 1 },
+        { "-u",    ESwitchID::Utf8,     0, 0 },
         { "-v",    ESwitchID::Verbose,  0, 0 },
         { nullptr, ESwitchID::None,     0, 0 } // Terminator
     };
 
     int ExitCode = 0;
     CSwitches Switches(SwitchSpecs);
+    CInstrumentation Instrumentation;
+    CInstrumentation *pInstrumentation = nullptr; // Set by -v
 
     try {
         Switches.ExecPath(argv[0]);
         for (int Ix = 1; Ix < argc; ++Ix)
             Switches.ItemAdd(argv[Ix]);
         Switches.Check();
-        if (Switches.Exists(ESwitchID::Verbose))
+        if (Switches.Exists(ESwitchID::Verbose)) {
             Switches.Show();
+            pInstrumentation = &Instrumentation;
+        }
 
-        char Buf[256];
-        CTextTable TextTable;
         CMessages Messages;
+        CCompiledMessages CompiledMessages;
+        CColumnarMessages ColumnarMessages;
+        CUtf8ColumnarMessages Utf8ColumnarMessages;
+        bool IsUtf8 = Switches.Exists(ESwitchID::Utf8);
+        bool IsMemory = Switches.Exists(ESwitchID::Memory);
         std::string MessagesFileName("Messages.txt");
+        std::vector<std::string> Parameters;
+        if (Switches.Parameters(ESwitchID::Input, Parameters))
+            MessagesFileName = Parameters[0];
+        bool IsCompiled = MessagesFileName.size() >= 4 &&
+            MessagesFileName.compare(MessagesFileName.size() - 4, 4,
+            ".lpc") == 0;
 
-        std::ifstream InStream(MessagesFileName, std::ifstream::in);
-        if (!InStream.good()) {
-            std::string Message("Failed to open \"");
-            Message += MessagesFileName;
-            Message += "\".";
-            throw std::runtime_error(Message);
-        }
-
-        // Read and capture the heading line
         std::cout << std::endl;
-        InStream.getline(Buf, sizeof(Buf) - 1);
-        {
-            std::wstring Line(Utf8ToWStr(Buf));
-            std::cout << "\"" << Buf << "\"" << std::endl;
-            std::vector<std::wstring> Values;
-            TextTable.Parse(Line, Values);
-            size_t Count = Values.size();
-            for (size_t Ix = LangIx; Ix < Count; ++Ix)
-                Messages.LanguageAdd(Values[Ix]);
+        if (IsCompiled) {
+            // Map the compiled messages
+            CPhaseTimer Timer(pInstrumentation, EPhase::Open);
+            CompiledMessages.Open(MessagesFileName);
         }
-
-        // Read and capture the translations
-        while (!InStream.eof()) {
-            InStream.getline(Buf, sizeof(Buf) - 1);
-            if (*Buf != '\0') {
-                std::cout << "\"" << Buf << "\"" << std::endl;
-                std::wstring Line(Utf8ToWStr(Buf));
-                std::vector<std::wstring> Values;
-                TextTable.Parse(Line, Values);
-                if (Values.size() < LangIx) {
-                    std::stringstream Message;
-                    Message << "Invalid record: \"" << Buf << "\".";
-                    throw std::exception(Message.str().c_str());
+        else {
+            // Read the heading line and translations
+            CMessagesFile MessagesFile;
+            MessagesFile.Instrumentation(pInstrumentation);
+            bool IsThreaded = Switches.Parameters(ESwitchID::Threads,
+                Parameters);
+            if (IsThreaded)
+                MessagesFile.Threads(Parameters.empty()
+                    ? 0 : std::stoul(Parameters[0]));
+            else
+                MessagesFile.Echo(&std::cout);
+            if (Switches.Parameters(ESwitchID::Language, Parameters)) {
+                std::vector<std::wstring> Languages;
+                for (const std::string &Parameter : Parameters)
+                    Languages.push_back(Utf8ToWStr(Parameter));
+                MessagesFile.Languages(Languages);
+            }
+            if (IsThreaded || IsMemory ||
+                Switches.Exists(ESwitchID::Compile) ||
+                Switches.Exists(ESwitchID::Export)) {
+                // Track the allocations of the load alone with -m
+                CAllocationTracker::Enable(IsMemory);
+                MessagesFile.Load(MessagesFileName, Messages);
+                CAllocationTracker::Enable(false);
+                if (IsMemory) {
+                    CMessagesMemory Memory;
+                    Messages.MemoryUsed(Memory);
+                    double NMessages = static_cast<double>(
+                        std::max<size_t>(Messages.MessageCount(), 1));
+                    if (CAllocationTracker::IsAvailable()) {
+                        std::cout << std::endl
+                            << "Allocations while loading:" << std::endl;
+                        CAllocationTracker::Report(std::cout);
+                    } else {
+                        std::cout << std::endl << "Allocations are counted "
+                            "only if built with ALLOCATION_TRACKING."
+                            << std::endl;
+                    }
+                    std::cout << std::endl << "Bytes per message: name "
+                        << std::fixed << std::setprecision(1)
+                        << Memory.Names / NMessages << ", description "
+                        << Memory.Descriptions / NMessages
+                        << ", translations " << Memory.Translations /
+                        NMessages << ", index " << Memory.Index / NMessages
+                        << ", other " << Memory.Other / NMessages
+                        << ", total " << Memory.Total() / NMessages
+                        << std::endl;
                 }
-                CMessage Message;
-                Message.Name(Values[NameIx]);
-                Message.Description(Values[DescIx]);
-                Message.Translate(Values[TypeIx] == L"T");
-                size_t Count = Values.size();
-                for (size_t Ix = LangIx; Ix < Count; ++Ix)
-                    Message.TranslationAdd(Values[Ix]);
-                Messages.MessageAdd(Message);
+                if (Switches.Parameters(ESwitchID::Compile, Parameters))
+                    CCompiledMessages::Compile(Messages, Parameters[0]);
+                if (Switches.Parameters(ESwitchID::Export, Parameters))
+                    MessagesFile.Save(Parameters[0], Messages);
+
+                // Copy the messages into interned columns for listing
+                if (IsUtf8)
+                    Utf8ColumnarMessages.Assign(Messages);
+                else
+                    ColumnarMessages.Assign(Messages);
+            }
+            else {
+                // Only listing, so load straight into interned columns,
+                // keeping the text as UTF-8 with -u
+                if (IsUtf8)
+                    MessagesFile.Load(MessagesFileName, Utf8ColumnarMessages);
+                else
+                    MessagesFile.Load(MessagesFileName, ColumnarMessages);
+            }
+            auto StatisticsShow = [&](const auto &columns) {
+                const auto &Pool = columns.Pool();
+                std::cout << std::endl << "Strings: " << Pool.References()
+                    << " interned as " << Pool.Strings() << ", "
+                    << Pool.AddedLen() << " characters stored as "
+                    << Pool.PoolLen() << " (dedup ratio " << std::fixed
+                    << std::setprecision(2) << static_cast<double>(
+                    Pool.AddedLen()) / std::max<size_t>(Pool.PoolLen(), 1)
+                    << ")" << std::endl;
+                std::cout << "Memory: " << columns.MemoryUsed()
+                    << " bytes as columns";
+                if (Messages.MessageCount() > 0)
+                    std::cout << ", " << Messages.MemoryUsed()
+                        << " bytes as messages";
+                std::cout << std::endl;
+            };
+            if (Switches.Exists(ESwitchID::Verbose)) {
+                if (IsUtf8)
+                    StatisticsShow(Utf8ColumnarMessages);
+                else
+                    StatisticsShow(ColumnarMessages);
             }
         }
 
-        InStream.close();
-
 #ifdef VERBOSE
         // List translations for each language
-        std::vector<std::wstring> Languages;
-        Messages.Languages(Languages);
-        for (std::wstring Language : Languages) {
-            std::cout << std::endl << WStrToUtf8(Language) << ":" << std::endl;
-            std::vector<std::wstring> Translations;
-            Messages.Translations(Language, Translations);
-            for (std::wstring Translation : Translations)
-                std::cout << "  \"" << WStrToUtf8(Translation) << "\""
-                << std::endl;
-        }
+        auto TranslationsShow = [&](const auto &messages) {
+            std::vector<std::wstring> Languages;
+            messages.Languages(Languages);
+            for (std::wstring Language : Languages) {
+                std::cout << std::endl << WStrToUtf8(Language) << ":"
+                    << std::endl;
+                std::vector<std::wstring> Translations;
+                {
+                    CPhaseTimer Timer(pInstrumentation, EPhase::Lookup);
+                    messages.Translations(Language, Translations);
+                }
+                for (std::wstring Translation : Translations)
+                    std::cout << "  \"" << WStrToUtf8(Translation) << "\""
+                    << std::endl;
+            }
+        };
+        // UTF-8 columns are written out as they are, without conversion
+        auto Utf8TranslationsShow = [&](const CUtf8ColumnarMessages &messages) {
+            std::vector<std::wstring> Languages;
+            messages.Languages(Languages);
+            std::vector<CUtf8Field> Translations;
+            for (const std::wstring &Language : Languages) {
+                std::cout << std::endl << WStrToUtf8(Language) << ":"
+                    << std::endl;
+                {
+                    CPhaseTimer Timer(pInstrumentation, EPhase::Lookup);
+                    messages.Translations(messages.Language(Language),
+                        Translations);
+                }
+                for (const CUtf8Field &Translation : Translations) {
+                    std::cout << "  \"";
+                    std::cout.write(Translation.pText, Translation.Len);
+                    std::cout << "\"" << std::endl;
+                }
+            }
+        };
+        if (IsCompiled)
+            TranslationsShow(CompiledMessages);
+        else if (IsUtf8)
+            Utf8TranslationsShow(Utf8ColumnarMessages);
+        else
+            TranslationsShow(ColumnarMessages);
 #endif // VERBOSE
 
         std::cout << std::endl;
@@ -133,7 +243,20 @@ int main(int argc, char** argv) {
             std::vector<std::string> Report;
 
             NErrors += UtilsTest(Report);
+            NErrors += TextTableTest(Report);
+            NErrors += TextPushParserTest(Report);
+            NErrors += TextWriterTest(Report);
             NErrors += MessagesTest(Report);
+            NErrors += MessagesFileTest(Report);
+            NErrors += ArenaTest(Report);
+            NErrors += StringPoolTest(Report);
+            NErrors += CompiledMessagesTest(Report);
+            NErrors += ColumnarMessagesTest(Report);
+            NErrors += CatalogHandleTest(Report);
+            NErrors += TranslationContextTest(Report);
+            NErrors += InstrumentationTest(Report);
+            NErrors += AllocationTrackerTest(Report);
+            NErrors += MessagesHeaderTest(Report);
 
             std::cout << std::endl;
             for (std::string ReportLine : Report)
@@ -148,6 +271,12 @@ int main(int argc, char** argv) {
         ExitCode = -1;
     }
 
+    // Summarize the phases and counters, even after an error
+    if (pInstrumentation != nullptr) {
+        std::cout << std::endl << "Instrumentation:" << std::endl;
+        pInstrumentation->Json(std::cout);
+    }
+
     if (Switches.Exists(ESwitchID::Pause)) {
         std::cout << std::endl << "Press ENTER to exit..." << std::endl;
         std::cin.get();
@@ -0,0 +1,130 @@
+#include "stdafx.h"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "MappedFile.hpp"
+
+//##############################################################################
+// CMappedFile
+//##############################################################################
+//! Maps an entire file read-only into the address space of the process, so
+//! that its content can be walked in place without copying it into a buffer.
+//##############################################################################
+
+//------------------------------------------------------------------------------
+//! Default constructor creates an object with no file mapped.
+//
+CMappedFile::CMappedFile() : mpData(nullptr), mSize(0), mIsOpen(false),
+#ifdef _WIN32
+    mhFile(INVALID_HANDLE_VALUE), mhMapping(nullptr) {
+#else
+    mFD(-1) {
+#endif
+}
+
+//------------------------------------------------------------------------------
+//! Constructor maps the specified file.
+//
+CMappedFile::CMappedFile(const std::string &fileName) : CMappedFile() {
+    Open(fileName);
+}
+
+//------------------------------------------------------------------------------
+//! Destructor unmaps the file, if any.
+//
+CMappedFile::~CMappedFile() {
+    Close();
+}
+
+//------------------------------------------------------------------------------
+//! Function maps the specified file, replacing any file mapped previously.  An
+//! empty file is opened successfully but has no data.
+//
+void CMappedFile::Open(const std::string &fileName) {
+    Close();
+    mFileName = fileName;
+
+    std::string Message("Failed to open \"");
+    Message += fileName;
+    Message += "\".";
+
+#ifdef _WIN32
+    mhFile = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ,
+        nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (mhFile == INVALID_HANDLE_VALUE)
+        throw std::runtime_error(Message);
+    LARGE_INTEGER FileSize;
+    if (!GetFileSizeEx(mhFile, &FileSize)) {
+        Close();
+        throw std::runtime_error(Message);
+    }
+    mSize = static_cast<size_t>(FileSize.QuadPart);
+    if (mSize > 0) {
+        mhMapping = CreateFileMappingA(mhFile, nullptr, PAGE_READONLY, 0, 0,
+            nullptr);
+        if (mhMapping != nullptr)
+            mpData = static_cast<const char *>(
+                MapViewOfFile(mhMapping, FILE_MAP_READ, 0, 0, 0));
+        if (mpData == nullptr) {
+            Close();
+            throw std::runtime_error(Message);
+        }
+    }
+#else
+    mFD = open(fileName.c_str(), O_RDONLY);
+    if (mFD < 0)
+        throw std::runtime_error(Message);
+    struct stat Stat;
+    if (fstat(mFD, &Stat) != 0) {
+        Close();
+        throw std::runtime_error(Message);
+    }
+    mSize = static_cast<size_t>(Stat.st_size);
+    if (mSize > 0) {
+        void *pData = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, mFD, 0);
+        if (pData == MAP_FAILED) {
+            Close();
+            throw std::runtime_error(Message);
+        }
+        madvise(pData, mSize, MADV_SEQUENTIAL);
+        mpData = static_cast<const char *>(pData);
+    }
+#endif
+    mIsOpen = true;
+}
+
+//------------------------------------------------------------------------------
+//! Function unmaps the file, if any, and releases all associated handles.
+//
+void CMappedFile::Close() {
+#ifdef _WIN32
+    if (mpData != nullptr)
+        UnmapViewOfFile(mpData);
+    if (mhMapping != nullptr)
+        CloseHandle(mhMapping);
+    if (mhFile != INVALID_HANDLE_VALUE)
+        CloseHandle(mhFile);
+    mhMapping = nullptr;
+    mhFile = INVALID_HANDLE_VALUE;
+#else
+    if (mpData != nullptr)
+        munmap(const_cast<char *>(mpData), mSize);
+    if (mFD >= 0)
+        close(mFD);
+    mFD = -1;
+#endif
+    mpData = nullptr;
+    mSize = 0;
+    mIsOpen = false;
+}
@@ -0,0 +1,49 @@
+//#pragma once
+
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <string>
+
+//##############################################################################
+// CMappedFile
+//##############################################################################
+//! Maps an entire file read-only into the address space of the process, so
+//! that its content can be walked in place without copying it into a buffer.
+//##############################################################################
+
+class CMappedFile {
+public:
+    CMappedFile();
+    CMappedFile(const std::string &fileName);
+    CMappedFile(const CMappedFile &other) = delete;
+    CMappedFile(CMappedFile &&other) = delete;
+    CMappedFile &operator=(const CMappedFile &other) = delete;
+    CMappedFile &operator=(CMappedFile &&other) = delete;
+    ~CMappedFile();
+
+    void Open(const std::string &fileName);
+    void Close();
+
+    bool        IsOpen() const { return mIsOpen; }
+    const char *Data() const { return mpData; }
+    size_t      Size() const { return mSize; }
+    std::string FileName() const { return mFileName; }
+
+private:
+    std::string mFileName;
+    const char *mpData;
+    size_t      mSize;
+    bool        mIsOpen;
+#ifdef _WIN32
+    void       *mhFile;
+    void       *mhMapping;
+#else
+    int         mFD;
+#endif
+};
+
+//##############################################################################
+
+#endif // MAPPED_FILE_HPP
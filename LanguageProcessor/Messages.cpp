@@ -76,6 +76,26 @@ void CMessage::TranslationAdd(const std::vector<std::wstring> &translations) {
         mTranslations.push_back(*TransIt++);
 }
 
+namespace {
+
+const std::wstring sEmpty;
+
+} // namespace
+
+//------------------------------------------------------------------------------
+//! Functions return the translation that every catalog type gives for an
+//! unknown message or language, as wide text or as UTF-8.
+//
+const std::wstring &UnknownTranslation() {
+    static const std::wstring Unknown(L"???");
+    return Unknown;
+}
+
+const std::string &UnknownUtf8Translation() {
+    static const std::string Unknown(WStrToUtf8(UnknownTranslation()));
+    return Unknown;
+}
+
 //------------------------------------------------------------------------------
 //! Function gets the translation associated with the specified languagei, whose
 //! location is determined from the specified list of languages.
@@ -87,10 +107,20 @@ std::wstring CMessage::Translation(const std::vector<std::wstring> &languages,
     while (Ix < Count && languages[Ix] != language)
         ++Ix;
     if (Ix >= Count) // If language not found
-        return L"???";
-    if (!DoTranslate()) // If do not translate
-        Ix = 0;
-    return (Ix < mTranslations.size()) ? mTranslations[Ix] : std::wstring(L"");
+        return UnknownTranslation();
+    return Translation(static_cast<ELanguage>(Ix));
+}
+
+//------------------------------------------------------------------------------
+//! Function gets the translation associated with the specified language
+//! handle, "???" if the language is not known, or the first translation if the
+//! message is not to be translated.
+// 
+const std::wstring &CMessage::Translation(ELanguage language) const {
+    if (language == ELanguage::Invalid) // If language not found
+        return UnknownTranslation();
+    size_t Ix = DoTranslate() ? static_cast<size_t>(language) : 0;
+    return (Ix < mTranslations.size()) ? mTranslations[Ix] : sEmpty;
 }
 
 //##############################################################################
@@ -103,7 +133,44 @@ std::wstring CMessage::Translation(const std::vector<std::wstring> &languages,
 //! Default constructor does nothing beyond the autmatic construction of
 //! mLanguages and mTranslations.
 //
-CMessages::CMessages() {
+CMessages::CMessages() : mIndex(EmptySlot) {
+}
+
+//------------------------------------------------------------------------------
+//! Function returns the handle of the specified language, or ELanguage::Invalid
+//! if it is not known.
+//
+ELanguage CMessages::Language(const std::wstring &language) const {
+    size_t Count = mLanguages.size();
+    for (size_t Ix = 0; Ix < Count; ++Ix)
+        if (mLanguages[Ix] == language)
+            return static_cast<ELanguage>(Ix);
+    return ELanguage::Invalid;
+}
+
+//------------------------------------------------------------------------------
+//! Function returns the translation of the message at the specified position
+//! into the language with the specified handle.
+//
+const std::wstring &CMessages::Translation(size_t ix,
+    ELanguage language) const {
+    if (static_cast<size_t>(language) >= mLanguages.size())
+        language = ELanguage::Invalid;
+    return mMessages.at(ix).Translation(language);
+}
+
+//------------------------------------------------------------------------------
+//! Function returns the translations for the language with the specified
+//! handle.
+//
+void CMessages::Translations(ELanguage language,
+    std::vector<std::wstring> &translations) const {
+    if (static_cast<size_t>(language) >= mLanguages.size())
+        language = ELanguage::Invalid;
+    translations.clear();
+    translations.reserve(mMessages.size());
+    for (const CMessage &Message : mMessages)
+        translations.push_back(Message.Translation(language));
 }
 
 //------------------------------------------------------------------------------
@@ -111,9 +178,93 @@ CMessages::CMessages() {
 //
 void CMessages::Translations(const std::wstring &language,
     std::vector<std::wstring> &translations) const {
-    translations.clear();
-    for (auto MsgIt = mMessages.begin(); MsgIt != mMessages.end(); ++MsgIt)
-        translations.push_back(MsgIt->Translation(mLanguages, language));
+    Translations(Language(language), translations);
+}
+
+//------------------------------------------------------------------------------
+//! Function returns the position of the first message with the specified
+//! name, or NotFound if there is none.
+//
+size_t CMessages::Find(const std::wstring &name) const {
+    uint32_t Ix = mIndex.Find(TextHash(name.data(), name.size()),
+        [&](uint32_t ix) { return mMessages[ix].Name() == name; });
+    return (Ix == EmptySlot) ? NotFound : Ix;
+}
+
+//------------------------------------------------------------------------------
+//! Function returns the translation of the first message with the specified
+//! name into the language with the specified handle, as CMessage::Translation()
+//! does, or "???" if there is no such message.
+//
+const std::wstring &CMessages::Lookup(const std::wstring &name,
+    ELanguage language) const {
+    size_t Ix = Find(name);
+    return (Ix == NotFound) ? UnknownTranslation()
+        : Translation(Ix, language);
+}
+
+//------------------------------------------------------------------------------
+//! Function returns the translation of the first message with the specified
+//! name into the specified language.  Callers making many lookups should
+//! resolve the language to a handle once instead.
+//
+std::wstring CMessages::Lookup(const std::wstring &name,
+    const std::wstring &language) const {
+    return Lookup(name, Language(language));
+}
+
+//------------------------------------------------------------------------------
+//! Function returns an estimate of the number of bytes of heap memory held by
+//! the messages, counting each string whose text does not fit in the string
+//! object itself.
+//
+size_t CMessages::MemoryUsed() const {
+    CMessagesMemory Memory;
+    MemoryUsed(Memory);
+    return Memory.Total();
+}
+
+//------------------------------------------------------------------------------
+//! Function sets memory to the bytes held by the messages, estimated as by
+//! MemoryUsed(), by the part of the messages that holds them.
+//
+void CMessages::MemoryUsed(CMessagesMemory &memory) const {
+    static const size_t LocalCapacity = std::wstring().capacity();
+    auto StrBytes = [](const std::wstring &str) {
+        return (str.capacity() > LocalCapacity)
+            ? (str.capacity() + 1) * sizeof(wchar_t) : 0;
+    };
+    size_t NMessages = mMessages.size();
+    memory.Names = NMessages * sizeof(std::wstring);
+    memory.Descriptions = NMessages * sizeof(std::wstring);
+    memory.Translations = NMessages * sizeof(std::vector<std::wstring>);
+    memory.Index = mIndex.MemoryUsed();
+    memory.Other = mLanguages.capacity() * sizeof(std::wstring) +
+        mMessages.capacity() * sizeof(CMessage) - memory.Names -
+        memory.Descriptions - memory.Translations;
+    for (const CMessage &Message : mMessages) {
+        memory.Names += StrBytes(Message.Name());
+        memory.Descriptions += StrBytes(Message.Description());
+        memory.Translations += Message.Translations().capacity() *
+            sizeof(std::wstring);
+        for (const std::wstring &Translation : Message.Translations())
+            memory.Translations += StrBytes(Translation);
+    }
+}
+
+//------------------------------------------------------------------------------
+//! Private function adds the message at the specified position to the index,
+//! unless a message of the same name is already there, in which case the
+//! first message of the name is still the one found.
+//
+void CMessages::IndexAdd(size_t ix) {
+    if (ix >= EmptySlot)
+        throw std::runtime_error("CMessages::MessageAdd(): Too many "
+            "messages.");
+    const std::wstring &Name = mMessages[ix].Name();
+    mIndex.Insert(TextHash(Name.data(), Name.size()),
+        [&](uint32_t other) { return mMessages[other].Name() == Name; },
+        [ix]() { return static_cast<uint32_t>(ix); });
 }
 
 //------------------------------------------------------------------------------
@@ -148,7 +299,8 @@ uint32_t MessagesTest(std::vector<std::string> &report) {
     // Read Translations
     for (size_t Ix = 1; Ix < FileTableLen; ++Ix) {
         CMessage Message;
-        Message.Translate(FileTable[Ix].Translate);
+        Message.Name(L"Msg" + std::to_wstring(Ix % 3)); // Msg1 repeats
+        Message.Translate(FileTable[Ix].Translate ? L'T' : L'F');
         for (size_t Iy = 0; FileTable[Ix].Items[Iy] != nullptr; ++Iy)
             Message.TranslationAdd(FileTable[Ix].Items[Iy]);
         Messages.MessageAdd(Message);
@@ -178,5 +330,66 @@ uint32_t MessagesTest(std::vector<std::string> &report) {
         ++Ix;
     }
 
+    // Check lookups by name, where the first of several messages with the
+    // same name is found
+    struct CLookupTable {
+        const wchar_t *Name;
+        const wchar_t *Language;
+        const wchar_t *Translation;
+    };
+    static const CLookupTable LookupTable[] = {
+        { L"Msg1", L"German",  L"German" },
+        { L"Msg2", L"French",  L"Fr1" },
+        { L"Msg0", L"French",  L"Eng2" },
+        { L"Msg1", L"Klingon", L"???" },
+        { L"Msg9", L"English", L"???" },
+    };
+    for (const CLookupTable &Entry : LookupTable) {
+        std::wstring Translation = Messages.Lookup(Entry.Name, Entry.Language);
+        if (Translation != Entry.Translation) {
+            report.push_back("  Lookup(" + WStrToUtf8(Entry.Name) + ", " +
+                WStrToUtf8(Entry.Language) + ") gave \"" +
+                WStrToUtf8(Translation) + "\".");
+            ++NErrors;
+        }
+    }
+    if (Messages.Language(L"French") != static_cast<ELanguage>(2) ||
+        Messages.Language(L"Klingon") != ELanguage::Invalid ||
+        Messages.Translation(1, Messages.Language(L"German")) != L"Ger1" ||
+        Messages.Translation(1, static_cast<ELanguage>(7)) != L"???") {
+        report.push_back("  Incorrect language handle translation.");
+        ++NErrors;
+    }
+
+    CMessages Many;
+    for (size_t Ix = 0; Ix < 1000; ++Ix) {
+        CMessage Message;
+        Message.Name(std::to_wstring(Ix % 700));
+        Many.MessageAdd(Message);
+    }
+    for (size_t Ix = 0; Ix < 700; ++Ix) {
+        if (Many.Find(std::to_wstring(Ix)) != Ix) {
+            report.push_back("  Find() failed for message " +
+                std::to_string(Ix) + ".");
+            ++NErrors;
+        }
+    }
+    if (Many.Find(L"700") != CMessages::NotFound) {
+        report.push_back("  Find() found a missing message.");
+        ++NErrors;
+    }
+
+    // Names are short enough to be held in their string objects
+    CMessagesMemory Memory;
+    Many.MemoryUsed(Memory);
+    if (Memory.Total() != Many.MemoryUsed() ||
+        Memory.Names != 1000 * sizeof(std::wstring) ||
+        Memory.Descriptions != 1000 * sizeof(std::wstring) ||
+        Memory.Translations != 1000 * sizeof(std::vector<std::wstring>) ||
+        Memory.Index == 0) {
+        report.push_back("  Incorrect memory breakdown.");
+        ++NErrors;
+    }
+
     return NErrors;
 }
@@ -3,9 +3,27 @@
 #ifndef MESSAGES_HPP
 #define MESSAGES_HPP
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
+#include "Utils.hpp"
+#include "AllocationTracker.hpp"
+
+//##############################################################################
+// ELanguage
+//##############################################################################
+//! Handle of a language within a CMessages object, resolved once from its name
+//! by CMessages::Language(), so that translations can be fetched by position
+//! rather than by comparing names.  ELanguage::Invalid stands for a language
+//! that is not known.
+//##############################################################################
+
+enum class ELanguage : uint32_t { Invalid = 0xffffffff };
+
+const std::wstring &UnknownTranslation();
+const std::string  &UnknownUtf8Translation();
+
 //##############################################################################
 // CMessage
 //##############################################################################
@@ -21,20 +39,24 @@ public:
     CMessage &operator=(const CMessage &other);
     CMessage &operator=(CMessage &&other);
 
-    std::wstring Name() const { return mName; }
-    void         Name(const std::wstring &name) { mName = name; }
-    std::wstring Description() const { return mDescription; }
-    void         Description(const std::wstring &description) {
+    const std::wstring &Name() const { return mName; }
+    void                Name(const std::wstring &name) { mName = name; }
+    const std::wstring &Description() const { return mDescription; }
+    void                Description(const std::wstring &description) {
         mDescription = description;
     }
-    wchar_t      Translate() const { return mTranslate; }
-    void         Translate(wchar_t translate) { mTranslate = translate; }
-    bool         DoTranslate() const;
+    wchar_t             Translate() const { return mTranslate; }
+    void                Translate(wchar_t translate) { mTranslate = translate; }
+    bool                DoTranslate() const;
 
     void TranslationAdd(const std::wstring &translation);
     void TranslationAdd(const std::vector<std::wstring> &translations);
+    const std::vector<std::wstring> &Translations() const {
+        return mTranslations;
+    }
     std::wstring Translation(const std::vector<std::wstring> &languages,
         const std::wstring &language) const;
+    const std::wstring &Translation(ELanguage language) const;
 
 private:
     std::wstring mName;
@@ -47,14 +69,39 @@ inline bool CMessage::DoTranslate() const {
     return (mTranslate != L'F');
 }
 
+//##############################################################################
+// CMessagesMemory
+//##############################################################################
+//! Bytes held by a CMessages object, by what they hold.  Each message part
+//! counts its string or vector objects as well as the heap memory they own.
+//##############################################################################
+
+struct CMessagesMemory {
+    size_t Names;
+    size_t Descriptions;
+    size_t Translations;
+    size_t Index;
+    size_t Other;        // Languages, flags and unused message capacity
+
+    size_t Total() const {
+        return Names + Descriptions + Translations + Index + Other;
+    }
+};
+
 //##############################################################################
 // CMessages
 //##############################################################################
 //! Contains the all messages and a list of languages common to all messages.
+//! Messages are indexed by name as they are added, in an open addressing hash
+//! table, so that a single message can be found without scanning them all.
+//! Where several messages share a name, the first one added is the one found;
+//! the others remain in the list and are reached only by position.
 //##############################################################################
 
 class CMessages {
 public:
+    static const size_t NotFound = static_cast<size_t>(-1);
+
     CMessages();
     CMessages(const std::vector<std::wstring> &languages);
     CMessages(const CMessages &other) = delete;
@@ -64,22 +111,44 @@ public:
 
     void LanguageAdd(const std::wstring &language);
     void Languages(std::vector<std::wstring> &languages) const;
+    ELanguage Language(const std::wstring &language) const;
     void MessageAdd(const CMessage &message);
+    void MessageAdd(CMessage &&message);
+    size_t MessageCount() const { return mMessages.size(); }
+    const CMessage &Message(size_t ix) const { return mMessages.at(ix); }
+    size_t Find(const std::wstring &name) const;
+    const std::wstring &Translation(size_t ix, ELanguage language) const;
+    const std::wstring &Lookup(const std::wstring &name,
+        ELanguage language) const;
+    std::wstring Lookup(const std::wstring &name,
+        const std::wstring &language) const;
+    void Translations(ELanguage language,
+        std::vector<std::wstring> &translations) const;
     void Translations(const std::wstring &language,
         std::vector<std::wstring> &translations) const;
+    size_t MemoryUsed() const;
+    void MemoryUsed(CMessagesMemory &memory) const;
 
 private:
+    static const uint32_t EmptySlot = 0xffffffff;
+
     std::vector<std::wstring> mLanguages;
     std::vector<CMessage> mMessages;
+    CHashIndex<uint32_t> mIndex; // Of positions in mMessages, by name
+
+    void IndexAdd(size_t ix);
 };
 
 //! Sets the languages for the translations 
-inline CMessages::CMessages(const std::vector<std::wstring> &languages) {
+inline CMessages::CMessages(const std::vector<std::wstring> &languages) :
+    mIndex(EmptySlot) {
+    CAllocationScope Scope(ESubsystem::Catalog);
     mLanguages = languages;
 }
 
 //! Adds a language for the translations 
 inline void CMessages::LanguageAdd(const std::wstring &language) {
+    CAllocationScope Scope(ESubsystem::Catalog);
     mLanguages.push_back(language);
 }
 
@@ -91,7 +160,17 @@ inline void CMessages::Languages(std::vector<std::wstring> &languages) const {
 
 //! Add a message, containing all translations, to the message list. 
 inline void CMessages::MessageAdd(const CMessage &message) {
+    CAllocationScope Scope(ESubsystem::Catalog);
     mMessages.push_back(message);
+    IndexAdd(mMessages.size() - 1);
+}
+
+//! Add a message, containing all translations, to the message list by taking
+//! its content rather than copying it.
+inline void CMessages::MessageAdd(CMessage &&message) {
+    CAllocationScope Scope(ESubsystem::Catalog);
+    mMessages.push_back(std::move(message));
+    IndexAdd(mMessages.size() - 1);
 }
 
 //##############################################################################
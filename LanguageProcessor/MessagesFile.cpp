@@ -0,0 +1,1116 @@
+#include "stdafx.h"
+
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "Utils.hpp"
+#include "MappedFile.hpp"
+#include "TextWriter.hpp"
+#include "Instrumentation.hpp"
+#include "AllocationTracker.hpp"
+#include "CatalogHandle.hpp"
+#include "MessagesFile.hpp"
+
+//##############################################################################
+// CMessagesFile
+//##############################################################################
+//! Loads a messages file into a CMessages object, or saves one to a file.
+//##############################################################################
+
+namespace {
+
+//------------------------------------------------------------------------------
+//! Functions return a value as text to be stored in a columnar catalog:
+//! decoded into buffer, which must outlive the result, for wide text, or
+//! checked and returned as it is for UTF-8 text.
+//
+inline CTextField FieldDecode(const CUtf8Field &field, std::wstring &buffer) {
+    Utf8ToWStr(field.pText, field.Len, buffer);
+    CTextField Field = { buffer.data(), buffer.size() };
+    return Field;
+}
+
+inline CUtf8Field FieldDecode(const CUtf8Field &field, std::string &) {
+    Utf8Check(field.pText, field.Len);
+    return field;
+}
+
+//------------------------------------------------------------------------------
+//! Function skips the UTF-8 byte order mark at the start of text, if any.
+//
+void ByteOrderMarkSkip(const char *&pdata, size_t &size) {
+    if (size >= 3 && std::memcmp(pdata, "\xef\xbb\xbf", 3) == 0) {
+        pdata += 3;
+        size -= 3;
+    }
+}
+
+//------------------------------------------------------------------------------
+//! Function adds the records, values and quoted values counted by a parser,
+//! and the number of bytes it was fed, to the counters, if instrumented.
+//
+void ParserCount(const CTextPushParser &parser, size_t bytes,
+    CInstrumentation *pinstrumentation) {
+    if (pinstrumentation == nullptr)
+        return;
+    pinstrumentation->Add(ECounter::Rows, parser.Records());
+    pinstrumentation->Add(ECounter::Bytes, bytes);
+    pinstrumentation->Add(ECounter::Fields, parser.Fields());
+    pinstrumentation->Add(ECounter::QuotedFields, parser.QuotedFields());
+}
+
+//------------------------------------------------------------------------------
+//! Function feeds the whole of a file held in memory to a parser, timing the
+//! parse and counting what was parsed, if instrumented.
+//
+void ParserFeed(CTextPushParser &parser, const char *pdata, size_t size,
+    CInstrumentation *pinstrumentation) {
+    {
+        CPhaseTimer Timer(pinstrumentation, EPhase::Parse);
+        parser.Feed(pdata, size, true);
+    }
+    ParserCount(parser, size, pinstrumentation);
+}
+
+} // namespace
+
+const size_t CMessagesFile::NameIx;
+const size_t CMessagesFile::DescIx;
+const size_t CMessagesFile::TypeIx;
+const size_t CMessagesFile::LangIx;
+const size_t CMessagesFile::ChunkSize;
+const size_t CMessagesFile::MinThreadSize;
+
+//------------------------------------------------------------------------------
+//! Constructor sets the text table, which defines the delimiter and quote
+//! characters used to split records into values.
+//
+CMessagesFile::CMessagesFile(const CTextTable &textTable) :
+    mTextTable(textTable), mpEcho(nullptr), mpInstrumentation(nullptr),
+    mThreads(1) {
+}
+
+//------------------------------------------------------------------------------
+//! Private function opens and maps the specified file, timing it if
+//! instrumented.
+//
+void CMessagesFile::FileOpen(const std::string &fileName,
+    CMappedFile &file) const {
+    CAllocationScope Scope(ESubsystem::Loader);
+    CPhaseTimer Timer(mpInstrumentation, EPhase::Open);
+    file.Open(fileName);
+}
+
+//------------------------------------------------------------------------------
+//! Function maps the specified file and adds its languages and messages to
+//! messages.
+//
+void CMessagesFile::Load(const std::string &fileName, CMessages &messages) {
+    CMappedFile File;
+    FileOpen(fileName, File);
+    Load(File.Data(), File.Size(), messages);
+}
+
+//------------------------------------------------------------------------------
+//! Function parses a messages file held in memory and adds its languages and
+//! messages to messages.
+//
+void CMessagesFile::Load(const char *pdata, size_t size,
+    CMessages &messages) {
+    CAllocationScope Scope(ESubsystem::Loader);
+
+    ByteOrderMarkSkip(pdata, size);
+
+    size_t NThreads = Threads();
+    if (NThreads > 1 && mpEcho == nullptr &&
+        size >= NThreads * MinThreadSize &&
+        LoadParallel(pdata, size, NThreads, messages))
+        return;
+
+    std::vector<size_t> Columns;
+    CTextPushParser Parser([&](const CTextRecord &record) {
+        RecordAdd(record, Parser, Columns, messages);
+    }, mTextTable.Delimiter(), mTextTable.Quote());
+    ParserFeed(Parser, pdata, size, mpInstrumentation);
+}
+
+//------------------------------------------------------------------------------
+//! Function returns the number of threads used to load files, resolving zero
+//! to the number of hardware threads.
+//
+size_t CMessagesFile::Threads() const {
+    if (mThreads != 0)
+        return mThreads;
+    size_t NThreads = std::thread::hardware_concurrency();
+    return (NThreads > 0) ? NThreads : 1;
+}
+
+//------------------------------------------------------------------------------
+//! Private function loads a messages file held in memory using nThreads
+//! threads and returns true, or returns false if the file must be loaded
+//! serially instead.  The file is split into one chunk per thread at record
+//! boundaries.  Each thread parses and decodes its chunk into a list of
+//! messages, and the lists are then added to messages in order, so the result
+//! is identical to a serial load.
+//!
+//! Record boundaries depend on the quote state, which is found by counting the
+//! quotes before each boundary.  That count is misled by quotes within
+//! unquoted values, so every thread also checks that its chunk ends at a
+//! record boundary by the rules of the parser.  If any check fails, the
+//! chunks are discarded and false is returned.  Errors are reported with
+//! records numbered from the start of the file, as by a serial load.
+//
+bool CMessagesFile::LoadParallel(const char *pdata, size_t size,
+    size_t nThreads, CMessages &messages) const {
+    struct CChunk {
+        size_t                    Start;
+        size_t                    End;
+        uint64_t                  InQuote; // All ones if Start is quoted
+        bool                      AtBoundary;
+        size_t                    Records;
+        std::exception_ptr        pException;
+        std::vector<CMessage>     Messages;
+        CInstrumentation          Instrumentation;
+    };
+    std::vector<CChunk> Chunks(nThreads);
+    for (size_t Ix = 0; Ix < nThreads; ++Ix) {
+        Chunks[Ix].Start = size / nThreads * Ix;
+        Chunks[Ix].End = (Ix + 1 < nThreads) ? size / nThreads * (Ix + 1)
+            : size;
+        Chunks[Ix].AtBoundary = false;
+        Chunks[Ix].Records = 0;
+    }
+    auto RunAll = [&](const std::function<void(CChunk &chunk)> &function) {
+        std::vector<std::thread> Threads;
+        for (CChunk &Chunk : Chunks)
+            Threads.push_back(std::thread(function, std::ref(Chunk)));
+        for (std::thread &Thread : Threads)
+            Thread.join();
+    };
+    CTextScanner Scanner(mTextTable.Delimiter(), mTextTable.Quote());
+    CPhaseTimer SplitTimer(mpInstrumentation, EPhase::Parse);
+
+    // Read the languages from the heading first, a piece at a time until it
+    // is complete, so that every chunk skips the values of languages that
+    // were not selected
+    std::vector<std::wstring> Languages;
+    std::vector<size_t> Columns;
+    {
+        bool IsHeading = false;
+        CTextPushParser Parser([&](const CTextRecord &record) {
+            if (!IsHeading)
+                ColumnsSelect(record, Parser, Languages, Columns);
+            IsHeading = true;
+        }, mTextTable.Delimiter(), mTextTable.Quote());
+        for (size_t Pos = 0; !IsHeading && Pos < size; Pos += ChunkSize)
+            Parser.Feed(pdata + Pos, std::min(size - Pos, ChunkSize),
+                size - Pos <= ChunkSize);
+    }
+
+    // Count the quotes in each chunk and so find the quote state at its start
+    RunAll([&](CChunk &chunk) {
+        uint64_t NQuotes = 0;
+        for (size_t Pos = chunk.Start; Pos < chunk.End;
+            Pos += CTextScanner::BlockLen) {
+            CTextMasks Masks;
+            Scanner.Scan(pdata + Pos, std::min(chunk.End - Pos,
+                CTextScanner::BlockLen), Masks);
+            NQuotes += CTextScanner::BitCount(Masks.Quotes);
+        }
+        chunk.InQuote = NQuotes & 1;
+    });
+    uint64_t InQuote = 0;
+    for (CChunk &Chunk : Chunks) {
+        uint64_t NextInQuote = InQuote ^ Chunk.InQuote;
+        Chunk.InQuote = InQuote ? ~static_cast<uint64_t>(0) : 0;
+        InQuote = NextInQuote;
+    }
+
+    // Move the start of each chunk after the first to the next unquoted
+    // newline, and then parse all chunks
+    RunAll([&](CChunk &chunk) {
+        size_t Start = chunk.Start;
+        if (Start != 0) {
+            size_t Pos = Start;
+            Start = size;
+            for (; Pos < size; Pos += CTextScanner::BlockLen) {
+                CTextMasks Masks;
+                Scanner.Scan(pdata + Pos, std::min(size - Pos,
+                    CTextScanner::BlockLen), Masks);
+                uint64_t Newlines = Masks.Newlines &
+                    ~CTextScanner::QuotedMask(Masks.Quotes, chunk.InQuote);
+                if (Newlines != 0) {
+                    Start = Pos + CTextScanner::FirstBit(Newlines) + 1;
+                    break;
+                }
+            }
+        }
+        chunk.Start = Start;
+    });
+    for (size_t Ix = 0; Ix < nThreads; ++Ix) {
+        if (Ix > 0 && Chunks[Ix].Start < Chunks[Ix - 1].Start)
+            Chunks[Ix].Start = Chunks[Ix - 1].Start;
+        if (Ix > 0)
+            Chunks[Ix - 1].End = Chunks[Ix].Start;
+    }
+    SplitTimer.Stop();
+
+    // Parse a chunk, numbering its records from the specified record
+    auto ChunkParse = [&](CChunk &chunk, size_t firstRecord) {
+        bool IsFirst = (chunk.Start == 0);
+        CInstrumentation *pInstrumentation = (mpInstrumentation != nullptr)
+            ? &chunk.Instrumentation : nullptr;
+        CTextPushParser Parser([&](const CTextRecord &record) {
+            if (!IsFirst || record.Number != 0) { // If not heading
+                CPhaseTimer Timer(pInstrumentation, EPhase::Decode);
+                CMessage Message;
+                if (MessageMake(record, Columns, Message))
+                    chunk.Messages.push_back(std::move(Message));
+            }
+        }, mTextTable.Delimiter(), mTextTable.Quote());
+        FieldsKeep(Columns, Parser);
+        Parser.Records(firstRecord);
+        {
+            CPhaseTimer Timer(pInstrumentation, EPhase::Parse);
+            Parser.Feed(pdata + chunk.Start, chunk.End - chunk.Start,
+                chunk.End == size);
+        }
+        ParserCount(Parser, chunk.End - chunk.Start, pInstrumentation);
+        chunk.Records = Parser.Records() - firstRecord;
+        chunk.AtBoundary = (chunk.End == size) || Parser.AtRecordStart();
+    };
+    RunAll([&](CChunk &chunk) {
+        CAllocationScope Scope(ESubsystem::Loader);
+        try {
+            ChunkParse(chunk, 0);
+        }
+        catch (...) {
+            chunk.pException = std::current_exception();
+        }
+    });
+
+    // Check the chunks in order.  A chunk that failed starts where the chunk
+    // before it ended at a record boundary, so its error is genuine, but its
+    // records were numbered from the start of the chunk.  It is parsed again,
+    // numbering them from the start of the file, to report the error as a
+    // serial load would.  Otherwise fall back on a serial load if a chunk
+    // boundary is wrong, or else add the messages in order.
+    size_t FirstRecord = 0;
+    for (CChunk &Chunk : Chunks) {
+        if (Chunk.pException) {
+            Chunk.Messages.clear();
+            ChunkParse(Chunk, FirstRecord);
+            std::rethrow_exception(Chunk.pException);
+        }
+        if (!Chunk.AtBoundary)
+            return false;
+        FirstRecord += Chunk.Records;
+    }
+    if (mpInstrumentation != nullptr)
+        for (const CChunk &Chunk : Chunks)
+            mpInstrumentation->Merge(Chunk.Instrumentation);
+    CPhaseTimer Timer(mpInstrumentation, EPhase::MessageAdd);
+    for (const std::wstring &Language : Languages)
+        messages.LanguageAdd(Language);
+    for (CChunk &Chunk : Chunks)
+        for (CMessage &Message : Chunk.Messages)
+            messages.MessageAdd(std::move(Message));
+    return true;
+}
+
+//------------------------------------------------------------------------------
+//! Function reads a messages file from a stream, such as a pipe, a chunk at a
+//! time and adds its languages and messages to messages.  Records are added as
+//! soon as they are complete, so the file is never held in memory as a whole.
+//
+void CMessagesFile::Load(std::istream &stream, CMessages &messages) {
+    CAllocationScope Scope(ESubsystem::Loader);
+    std::vector<size_t> Columns;
+    CTextPushParser Parser([&](const CTextRecord &record) {
+        RecordAdd(record, Parser, Columns, messages);
+    }, mTextTable.Delimiter(), mTextTable.Quote());
+
+    std::vector<char> Chunk(ChunkSize);
+    bool IsFirst = true;
+    size_t Bytes = 0;
+    while (stream) {
+        {
+            CPhaseTimer Timer(mpInstrumentation, EPhase::Read);
+            stream.read(Chunk.data(), Chunk.size());
+        }
+        size_t Size = static_cast<size_t>(stream.gcount());
+        const char *pData = Chunk.data();
+        if (IsFirst)
+            ByteOrderMarkSkip(pData, Size);
+        IsFirst = false;
+        CPhaseTimer Timer(mpInstrumentation, EPhase::Parse);
+        Parser.Feed(pData, Size);
+        Bytes += Size;
+    }
+    {
+        CPhaseTimer Timer(mpInstrumentation, EPhase::Parse);
+        Parser.Finish();
+    }
+    ParserCount(Parser, Bytes, mpInstrumentation);
+}
+
+//------------------------------------------------------------------------------
+//! Functions load the specified file straight into a columnar catalog of wide
+//! or UTF-8 text.
+//
+void CMessagesFile::Load(const std::string &fileName,
+    CColumnarMessages &messages) {
+    CMappedFile File;
+    FileOpen(fileName, File);
+    LoadColumns(File.Data(), File.Size(), messages);
+}
+
+void CMessagesFile::Load(const std::string &fileName,
+    CUtf8ColumnarMessages &messages) {
+    CMappedFile File;
+    FileOpen(fileName, File);
+    LoadColumns(File.Data(), File.Size(), messages);
+}
+
+//------------------------------------------------------------------------------
+//! Functions load messages from memory straight into a columnar catalog of
+//! wide or UTF-8 text.
+//
+void CMessagesFile::Load(const char *pdata, size_t size,
+    CColumnarMessages &messages) {
+    LoadColumns(pdata, size, messages);
+}
+
+void CMessagesFile::Load(const char *pdata, size_t size,
+    CUtf8ColumnarMessages &messages) {
+    LoadColumns(pdata, size, messages);
+}
+
+//------------------------------------------------------------------------------
+//! Private function loads messages from memory straight into a columnar
+//! catalog, without making a CMessage of each record.  For wide text, the
+//! values of each record are converted into strings kept from one record to
+//! the next, so their storage is reused once it is large enough.  UTF-8 text
+//! is only checked, and interned as it is.
+//
+template <typename TChar>
+void CMessagesFile::LoadColumns(const char *pdata, size_t size,
+    CBasicColumnarMessages<TChar> &messages) {
+    CAllocationScope Scope(ESubsystem::Loader);
+
+    ByteOrderMarkSkip(pdata, size);
+
+    std::vector<size_t> Columns;
+    std::vector<std::basic_string<TChar>> Values;
+    std::vector<CBasicField<TChar>> Translations;
+    CTextPushParser Parser([&](const CTextRecord &record) {
+        if (record.Number == 0) { // If heading
+            EchoRecord(record);
+            std::vector<std::wstring> Languages;
+            ColumnsSelect(record, Parser, Languages, Columns);
+            for (const std::wstring &Language : Languages)
+                messages.LanguageAdd(Language);
+            return;
+        }
+        RecordAdd(record, Columns, messages, Values, Translations);
+    }, mTextTable.Delimiter(), mTextTable.Quote());
+    ParserFeed(Parser, pdata, size, mpInstrumentation);
+}
+
+//------------------------------------------------------------------------------
+//! Functions load the specified file into a columnar catalog, copying the
+//! messages it shares with a catalog loaded from an earlier version of it, and
+//! return the number of records decoded.
+//
+size_t CMessagesFile::Reload(const std::string &fileName,
+    const CColumnarMessages &previous, CColumnarMessages &messages) {
+    CMappedFile File;
+    FileOpen(fileName, File);
+    return ReloadColumns(File.Data(), File.Size(), previous, messages);
+}
+
+size_t CMessagesFile::Reload(const std::string &fileName,
+    const CUtf8ColumnarMessages &previous, CUtf8ColumnarMessages &messages) {
+    CMappedFile File;
+    FileOpen(fileName, File);
+    return ReloadColumns(File.Data(), File.Size(), previous, messages);
+}
+
+//------------------------------------------------------------------------------
+//! Functions load a messages file held in memory into a columnar catalog,
+//! copying the messages it shares with a catalog loaded from an earlier
+//! version of it, and return the number of records decoded.
+//
+size_t CMessagesFile::Reload(const char *pdata, size_t size,
+    const CColumnarMessages &previous, CColumnarMessages &messages) {
+    return ReloadColumns(pdata, size, previous, messages);
+}
+
+size_t CMessagesFile::Reload(const char *pdata, size_t size,
+    const CUtf8ColumnarMessages &previous, CUtf8ColumnarMessages &messages) {
+    return ReloadColumns(pdata, size, previous, messages);
+}
+
+//------------------------------------------------------------------------------
+//! Private function loads a messages file held in memory into a columnar
+//! catalog, replacing its content, and returns the number of records decoded.
+//! Records are still split into values to find where they end, but one whose
+//! fingerprint matches a message of the previous catalog, loaded from an
+//! earlier version of the file, is not decoded; the message is copied instead.
+//! The result is the same as loading the file into an empty catalog, and holds
+//! none of the text of the messages no longer in the file.  The previous
+//! catalog is only read, so if the file cannot be loaded it is left as it was
+//! and only the new catalog is incomplete.  Messages are looked for first at
+//! the position following the last one copied, so an unchanged run of
+//! messages costs a comparison each.  If the languages have changed, or a
+//! different selection of them is loaded, nothing can be copied and the file
+//! is loaded afresh.
+//
+template <typename TChar>
+size_t CMessagesFile::ReloadColumns(const char *pdata, size_t size,
+    const CBasicColumnarMessages<TChar> &previous,
+    CBasicColumnarMessages<TChar> &messages) {
+    CAllocationScope Scope(ESubsystem::Loader);
+    if (&previous == &messages)
+        throw std::runtime_error("CMessagesFile::Reload(): The previous "
+            "catalog may not be reloaded into itself.");
+
+    ByteOrderMarkSkip(pdata, size);
+
+    messages.Clear();
+    size_t NOld = previous.MessageCount();
+    size_t NextIx = 0; // Position expected to hold the next record
+    bool IsIndexed = false;
+    std::unordered_map<uint64_t, size_t> OldIxs; // Made at the first change
+    size_t NDecoded = 0;
+    std::vector<size_t> Columns;
+    std::vector<std::basic_string<TChar>> Values;
+    std::vector<CBasicField<TChar>> Translations;
+    CTextPushParser Parser([&](const CTextRecord &record) {
+        if (record.Number == 0) { // If heading
+            std::vector<std::wstring> Languages, OldLanguages;
+            ColumnsSelect(record, Parser, Languages, Columns);
+            previous.Languages(OldLanguages);
+            if (Languages != OldLanguages) {
+                EchoRecord(record);
+                NOld = 0;
+            }
+            for (const std::wstring &Language : Languages)
+                messages.LanguageAdd(Language);
+            return;
+        }
+        if (record.Fields.empty())
+            return;
+
+        uint64_t Fingerprint = RecordFingerprint(record);
+        if (Fingerprint != 0) {
+            if (NextIx < NOld && previous.Fingerprint(NextIx) == Fingerprint) {
+                CPhaseTimer Timer(mpInstrumentation, EPhase::MessageAdd);
+                messages.MessageCopy(previous, NextIx++);
+                return;
+            }
+            if (!IsIndexed) {
+                for (size_t Ix = NOld; Ix-- > 0;) // First of equals wins
+                    OldIxs[previous.Fingerprint(Ix)] = Ix;
+                IsIndexed = true;
+            }
+            auto Found = OldIxs.find(Fingerprint);
+            if (Found != OldIxs.end()) {
+                CPhaseTimer Timer(mpInstrumentation, EPhase::MessageAdd);
+                messages.MessageCopy(previous, Found->second);
+                NextIx = Found->second + 1;
+                return;
+            }
+        }
+        RecordAdd(record, Columns, messages, Values, Translations);
+        ++NDecoded;
+    }, mTextTable.Delimiter(), mTextTable.Quote());
+    ParserFeed(Parser, pdata, size, mpInstrumentation);
+    return NDecoded;
+}
+
+//------------------------------------------------------------------------------
+//! Function writes messages to the specified file in the format read by Load().
+//
+void CMessagesFile::Save(const std::string &fileName,
+    const CMessages &messages) const {
+    std::ofstream File(fileName, std::ios::binary | std::ios::trunc);
+    if (!File)
+        throw std::runtime_error("Failed to create \"" + fileName + "\".");
+    Save(File, messages);
+    if (!File.flush())
+        throw std::runtime_error("Failed to write \"" + fileName + "\".");
+}
+
+//------------------------------------------------------------------------------
+//! Function writes messages to a stream in the format read by Load(), a
+//! heading record followed by one record per message.  Each value is escaped
+//! straight into the output buffer of a CTextWriter, so no intermediate
+//! strings are built.
+//
+void CMessagesFile::Save(std::ostream &stream,
+    const CMessages &messages) const {
+    CTextWriter Writer(stream, mTextTable.Delimiter(), mTextTable.Quote());
+
+    std::vector<std::wstring> Languages;
+    messages.Languages(Languages);
+    Writer.Add("Name", 4);
+    Writer.Add("Description", 11);
+    Writer.Add("Type", 4);
+    Writer.Add(Languages);
+    Writer.RecordEnd();
+
+    size_t NMessages = messages.MessageCount();
+    for (size_t Ix = 0; Ix < NMessages; ++Ix) {
+        const CMessage &Message = messages.Message(Ix);
+        Writer.Add(Message.Name());
+        Writer.Add(Message.Description());
+        Writer.Add(Message.DoTranslate() ? "T" : "F", 1);
+        Writer.Add(Message.Translations());
+        Writer.RecordEnd();
+    }
+    Writer.Flush();
+}
+
+//------------------------------------------------------------------------------
+//! Private function adds the languages selected from the heading record,
+//! which is the first record, setting columns to the positions of their
+//! values as ColumnsSelect() does, or else the message defined by a record.
+//
+void CMessagesFile::RecordAdd(const CTextRecord &record,
+    CTextPushParser &parser, std::vector<size_t> &columns,
+    CMessages &messages) {
+    if (record.Number == 0) { // If heading
+        EchoRecord(record);
+        std::vector<std::wstring> Languages;
+        ColumnsSelect(record, parser, Languages, columns);
+        for (const std::wstring &Language : Languages)
+            messages.LanguageAdd(Language);
+        return;
+    }
+
+    CMessage Message;
+    bool IsMessage;
+    {
+        CPhaseTimer Timer(mpInstrumentation, EPhase::Decode);
+        IsMessage = MessageMake(record, columns, Message);
+    }
+    if (IsMessage) {
+        EchoRecord(record);
+        CPhaseTimer Timer(mpInstrumentation, EPhase::MessageAdd);
+        messages.MessageAdd(std::move(Message));
+    }
+}
+
+//------------------------------------------------------------------------------
+//! Private function finds the languages to load from the heading record,
+//! which are all of them unless some were selected by Languages(), and sets
+//! languages to their names and columns to the positions of their values.
+//! Columns is left empty if all languages are loaded.  Otherwise the parser
+//! is told to skip the values of other languages, except the first, which is
+//! needed by messages that are not to be translated.  A selected language
+//! that is not in the heading throws an exception.
+//
+void CMessagesFile::ColumnsSelect(const CTextRecord &heading,
+    CTextPushParser &parser, std::vector<std::wstring> &languages,
+    std::vector<size_t> &columns) const {
+    LanguagesMake(heading, languages);
+    columns.clear();
+    if (mLanguages.empty())
+        return;
+
+    for (const std::wstring &Language : mLanguages)
+        if (std::find(languages.begin(), languages.end(), Language) ==
+            languages.end())
+            throw std::runtime_error("Language \"" + WStrToUtf8(Language) +
+                "\" not found.");
+    std::vector<std::wstring> Selected;
+    size_t Count = languages.size();
+    for (size_t Ix = 0; Ix < Count; ++Ix) {
+        if (std::find(mLanguages.begin(), mLanguages.end(), languages[Ix]) ==
+            mLanguages.end())
+            continue;
+        Selected.push_back(languages[Ix]);
+        columns.push_back(LangIx + Ix);
+    }
+    languages.swap(Selected);
+    FieldsKeep(columns, parser);
+}
+
+//------------------------------------------------------------------------------
+//! Private static function tells the parser to skip the values of languages
+//! not in columns, apart from the first language, if columns is not empty.
+//
+void CMessagesFile::FieldsKeep(const std::vector<size_t> &columns,
+    CTextPushParser &parser) {
+    if (columns.empty())
+        return;
+    std::vector<bool> Keep(LangIx + 1, true);
+    for (size_t Ix : columns) {
+        Keep.resize(std::max(Keep.size(), Ix + 1), false);
+        Keep[Ix] = true;
+    }
+    parser.FieldsKeep(Keep);
+}
+
+//------------------------------------------------------------------------------
+//! Private function adds the message defined by a record, other than the
+//! heading, to a columnar catalog, along with the fingerprint of the record.
+//! Only the values to be stored are decoded: the translations at the
+//! specified positions, or all of them if there are none, or just the first
+//! if the message is not to be translated.  Wide text is converted into the
+//! specified strings, which are kept from one record to the next so their
+//! storage is reused, and UTF-8 text is checked.
+//
+template <typename TChar>
+void CMessagesFile::RecordAdd(const CTextRecord &record,
+    const std::vector<size_t> &columns,
+    CBasicColumnarMessages<TChar> &messages,
+    std::vector<std::basic_string<TChar>> &values,
+    std::vector<CBasicField<TChar>> &translations) const {
+    const std::vector<CUtf8Field> &Fields = record.Fields;
+    if (Fields.empty())
+        return;
+    if (Fields.size() < LangIx)
+        throw std::runtime_error("Invalid record: \"" + RecordText(record) +
+            "\".");
+
+    CPhaseTimer Timer(mpInstrumentation, EPhase::Decode);
+    size_t Count = Fields.size();
+    if (values.size() < Count)
+        values.resize(Count);
+    auto Decode = [&](size_t ix) {
+        return FieldDecode(Fields[ix], values[ix]);
+    };
+    bool IsFixed = Fields[TypeIx].Equals("F");
+    translations.clear();
+    if (IsFixed) {
+        if (LangIx < Count)
+            translations.push_back(Decode(LangIx));
+    }
+    else if (columns.empty()) {
+        for (size_t Ix = LangIx; Ix < Count; ++Ix)
+            translations.push_back(Decode(Ix));
+    }
+    else {
+        for (size_t Ix : columns) {
+            if (Ix >= Count)
+                break;
+            translations.push_back(Decode(Ix));
+        }
+    }
+    CBasicField<TChar> Name = Decode(NameIx);
+    CBasicField<TChar> Description = Decode(DescIx);
+    Timer.Stop();
+    EchoRecord(record);
+    CPhaseTimer AddTimer(mpInstrumentation, EPhase::MessageAdd);
+    messages.MessageAdd(Name, Description, IsFixed ? L'F' : L'T',
+        translations, RecordFingerprint(record));
+}
+
+//------------------------------------------------------------------------------
+//! Private static function returns the fingerprint of the raw bytes of a
+//! record, which is never zero, or zero if the raw bytes are not available.
+//
+uint64_t CMessagesFile::RecordFingerprint(const CTextRecord &record) {
+    if (record.pRaw == nullptr)
+        return 0;
+    uint64_t Fingerprint = Fingerprint64(record.pRaw, record.RawLen);
+    return (Fingerprint != 0) ? Fingerprint : 1;
+}
+
+//------------------------------------------------------------------------------
+//! Private function sets languages to the languages named in a heading record.
+//
+void CMessagesFile::LanguagesMake(const CTextRecord &record,
+    std::vector<std::wstring> &languages) const {
+    const std::vector<CUtf8Field> &Fields = record.Fields;
+    languages.clear();
+    size_t Count = Fields.size();
+    for (size_t Ix = LangIx; Ix < Count; ++Ix)
+        languages.push_back(Utf8ToWStr(Fields[Ix].pText, Fields[Ix].Len));
+}
+
+//------------------------------------------------------------------------------
+//! Private function sets message to the message defined by a record and
+//! returns true, or returns false if the record is empty.  If columns is not
+//! empty, only the translations at those positions are kept, or just the
+//! first translation of a message that is not to be translated.  A record
+//! with too few values throws an exception.
+//
+bool CMessagesFile::MessageMake(const CTextRecord &record,
+    const std::vector<size_t> &columns, CMessage &message) const {
+    const std::vector<CUtf8Field> &Fields = record.Fields;
+    if (Fields.empty())
+        return false;
+    if (Fields.size() < LangIx)
+        throw std::runtime_error("Invalid record: \"" + RecordText(record) +
+            "\".");
+
+    message.Name(Utf8ToWStr(Fields[NameIx].pText, Fields[NameIx].Len));
+    message.Description(Utf8ToWStr(Fields[DescIx].pText, Fields[DescIx].Len));
+    message.Translate(Fields[TypeIx].Equals("F") ? L'F' : L'T');
+    size_t Count = Fields.size();
+    if (columns.empty()) {
+        for (size_t Ix = LangIx; Ix < Count; ++Ix)
+            message.TranslationAdd(Utf8ToWStr(Fields[Ix].pText,
+                Fields[Ix].Len));
+    }
+    else if (!message.DoTranslate()) {
+        if (LangIx < Count)
+            message.TranslationAdd(Utf8ToWStr(Fields[LangIx].pText,
+                Fields[LangIx].Len));
+    }
+    else {
+        for (size_t Ix : columns) {
+            if (Ix >= Count)
+                break;
+            message.TranslationAdd(Utf8ToWStr(Fields[Ix].pText,
+                Fields[Ix].Len));
+        }
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------
+//! Private function echoes a record, if echoing is enabled.
+//
+void CMessagesFile::EchoRecord(const CTextRecord &record) const {
+    if (mpEcho != nullptr)
+        *mpEcho << "\"" << RecordText(record) << "\"" << std::endl;
+}
+
+//------------------------------------------------------------------------------
+//! Private function returns the raw text of a record if it is available, or
+//! else its values separated by delimiters.
+//
+std::string CMessagesFile::RecordText(const CTextRecord &record) const {
+    if (record.pRaw != nullptr)
+        return std::string(record.pRaw, record.RawLen);
+    std::string Text;
+    for (const CUtf8Field &Field : record.Fields) {
+        if (!Text.empty())
+            Text += static_cast<char>(mTextTable.Delimiter());
+        Text.append(Field.pText, Field.Len);
+    }
+    return Text;
+}
+
+//##############################################################################
+
+//------------------------------------------------------------------------------
+//! Function tests CMessagesFile by saving messages with awkward values to a
+//! stream, loading them back, into messages and into wide and UTF-8 columns,
+//! and checking that nothing has changed and that the load was counted.
+//
+uint32_t MessagesFileTest(std::vector<std::string> &report) {
+    static const wchar_t *Table[][6] = {
+        { L"Plain",   L"Plain text", L"T", L"One",       L"Eins",   L"Un" },
+        { L"Comma",   L"a, b",       L"F", L"1,2",       L"",       L"" },
+        { L"Quote",   L"\"q\"",      L"T", L"Say \"Hi\"", L"\"",    L"\"\"" },
+        { L"Lines",   L"Two\nlines", L"T", L"A\r\nB",    L"\n",     L"\xe9" },
+        { L"",        L"",           L"T", L"",          L"",       L"" },
+    };
+
+    uint32_t NErrors = 0;
+    report.push_back("");
+    report.push_back("MessagesFile Test:");
+
+    std::vector<std::wstring> Languages = { L"English", L"German", L"French" };
+    CMessages Messages(Languages);
+    for (const auto &Row : Table) {
+        CMessage Message;
+        Message.Name(Row[0]);
+        Message.Description(Row[1]);
+        Message.Translate(Row[2][0]);
+        for (size_t Ix = 3; Ix < 6; ++Ix)
+            Message.TranslationAdd(Row[Ix]);
+        Messages.MessageAdd(Message);
+    }
+
+    std::stringstream Stream;
+    CMessagesFile MessagesFile;
+    CMessages Loaded;
+    try {
+        MessagesFile.Save(Stream, Messages);
+        MessagesFile.Load(Stream, Loaded);
+    }
+    catch (std::exception &e) {
+        report.push_back(std::string("  ") + e.what());
+        return NErrors + 1;
+    }
+
+    std::vector<std::wstring> LoadedLanguages;
+    Loaded.Languages(LoadedLanguages);
+    if (LoadedLanguages != Languages) {
+        report.push_back("  Incorrect languages.");
+        ++NErrors;
+    }
+    if (Loaded.MessageCount() != Messages.MessageCount()) {
+        report.push_back("  Incorrect number of messages.");
+        return NErrors + 1;
+    }
+    for (size_t Ix = 0; Ix < Messages.MessageCount(); ++Ix) {
+        const CMessage &Expected = Messages.Message(Ix);
+        const CMessage &Actual = Loaded.Message(Ix);
+        if (Actual.Name() != Expected.Name() ||
+            Actual.Description() != Expected.Description() ||
+            Actual.Translate() != Expected.Translate() ||
+            Actual.Translations() != Expected.Translations()) {
+            report.push_back("  Incorrect message " + std::to_string(Ix) +
+                ".");
+            ++NErrors;
+        }
+    }
+
+    // Load the same text straight into columns, counting what is parsed
+    CColumnarMessages Columns;
+    std::string Text(Stream.str());
+    CInstrumentation Instrumentation;
+    MessagesFile.Instrumentation(&Instrumentation);
+    MessagesFile.Load(Text.data(), Text.size(), Columns);
+    MessagesFile.Instrumentation(nullptr);
+    if (Instrumentation.Count(ECounter::Rows) != 6 ||
+        Instrumentation.Count(ECounter::Bytes) != Text.size() ||
+        Instrumentation.Count(ECounter::Fields) != 36 ||
+        Instrumentation.Count(ECounter::QuotedFields) != 10 ||
+        Instrumentation.Calls(EPhase::Parse) != 1 ||
+        Instrumentation.Calls(EPhase::Decode) != 5 ||
+        Instrumentation.Calls(EPhase::MessageAdd) != 5) {
+        report.push_back("  Incorrect instrumentation counts.");
+        ++NErrors;
+    }
+    for (const std::wstring &Language : Languages) {
+        std::vector<std::wstring> Expected, Actual;
+        Messages.Translations(Language, Expected);
+        Columns.Translations(Language, Actual);
+        if (Actual != Expected) {
+            report.push_back("  Incorrect columnar translations for " +
+                WStrToUtf8(Language) + ".");
+            ++NErrors;
+        }
+    }
+
+    // Load only the last language, which for a message not to be translated
+    // is its first translation
+    {
+        CMessagesFile Selective;
+        Selective.Languages(std::vector<std::wstring>(1, L"French"));
+        CColumnarMessages French;
+        Selective.Load(Text.data(), Text.size(), French);
+        std::vector<std::wstring> Expected, Actual;
+        Messages.Translations(L"French", Expected);
+        French.Translations(L"French", Actual);
+        if (French.LanguageCount() != 1 || Actual != Expected) {
+            report.push_back("  Incorrect translations loading French only.");
+            ++NErrors;
+        }
+        CMessages Mapped;
+        Selective.Load(Text.data(), Text.size(), Mapped);
+        std::istringstream FrenchStream(Text);
+        CMessages Streamed;
+        Selective.Load(FrenchStream, Streamed);
+        for (const CMessages *pLoaded : { &Mapped, &Streamed }) {
+            pLoaded->Translations(L"French", Actual);
+            if (pLoaded->MessageCount() != Messages.MessageCount() ||
+                pLoaded->Message(0).Translations().size() != 1 ||
+                Actual != Expected) {
+                report.push_back("  Incorrect messages loading French only.");
+                ++NErrors;
+            }
+        }
+        Selective.Languages(std::vector<std::wstring>(1, L"Klingon"));
+        try {
+            CColumnarMessages Klingon;
+            Selective.Load(Text.data(), Text.size(), Klingon);
+            report.push_back("  No error for an unknown language.");
+            ++NErrors;
+        }
+        catch (std::runtime_error &) {
+        }
+    }
+
+    // Change, remove, reorder and add messages, and check that a reload decodes
+    // only the changed and added ones, gives the same result as a load, pool
+    // text included, and leaves the previous catalog as it was
+    CMessages Changed(Languages);
+    static const size_t Order[] = { 0, 3, 2, 4 };
+    for (size_t Ix : Order) {
+        CMessage Message(Messages.Message(Ix));
+        if (Ix == 0)
+            Message.Description(L"Changed");
+        Changed.MessageAdd(Message);
+    }
+    CMessage Added;
+    Added.Name(L"Added");
+    Added.TranslationAdd(L"New");
+    Changed.MessageAdd(Added);
+    std::stringstream ChangedStream;
+    MessagesFile.Save(ChangedStream, Changed);
+    std::string ChangedText(ChangedStream.str());
+    auto IsEqual = [&Languages](const CColumnarMessages &columns,
+        const CColumnarMessages &expected) {
+        bool IsSame = (columns.MessageCount() == expected.MessageCount() &&
+            columns.Pool().Strings() == expected.Pool().Strings());
+        for (size_t Ix = 0; IsSame && Ix < columns.MessageCount(); ++Ix) {
+            IsSame = columns.Name(Ix).Str() == expected.Name(Ix).Str() &&
+                columns.Description(Ix).Str() ==
+                    expected.Description(Ix).Str() &&
+                columns.Fingerprint(Ix) == expected.Fingerprint(Ix);
+        }
+        for (const std::wstring &Language : Languages) {
+            std::vector<std::wstring> Expected, Actual;
+            expected.Translations(Language, Expected);
+            columns.Translations(Language, Actual);
+            IsSame = IsSame && (Actual == Expected);
+        }
+        return IsSame;
+    };
+    CColumnarMessages Original;
+    MessagesFile.Load(Text.data(), Text.size(), Original);
+    CColumnarMessages Updated;
+    size_t NDecoded = MessagesFile.Reload(ChangedText.data(),
+        ChangedText.size(), Columns, Updated);
+    CColumnarMessages Reloaded;
+    MessagesFile.Load(ChangedText.data(), ChangedText.size(), Reloaded);
+    if (NDecoded != 2) {
+        report.push_back("  Reload decoded " + std::to_string(NDecoded) +
+            " records instead of 2.");
+        ++NErrors;
+    }
+    if (!IsEqual(Updated, Reloaded) || !IsEqual(Columns, Original)) {
+        report.push_back("  Reload differs from load.");
+        ++NErrors;
+    }
+
+    // A reload into a new catalog is published only if it succeeds, so a file
+    // with an invalid record leaves the current catalog in use and unchanged
+    {
+        typedef CCatalogHandle<CColumnarMessages> CHandle;
+        CHandle Handle;
+        std::unique_ptr<CColumnarMessages> pLoaded(new CColumnarMessages);
+        MessagesFile.Load(Text.data(), Text.size(), *pLoaded);
+        Handle.Publish(std::move(pLoaded));
+        std::string Invalid(ChangedText + "Bad,\"x\"y,T,Bad\n");
+        for (const std::string *pText : { &Invalid, &ChangedText }) {
+            CHandle::CSnapshot Current = Handle.Acquire();
+            std::unique_ptr<CColumnarMessages> pNew(new CColumnarMessages);
+            try {
+                MessagesFile.Reload(pText->data(), pText->size(), *Current,
+                    *pNew);
+                Handle.Publish(std::move(pNew));
+            }
+            catch (std::runtime_error &) {
+            }
+            bool IsValid = (pText == &ChangedText);
+            CHandle::CSnapshot Published = Handle.Acquire();
+            if (Handle.Version() != (IsValid ? 2 : 1) ||
+                !IsEqual(*Current, Original) ||
+                !IsEqual(*Published, IsValid ? Reloaded : Original)) {
+                report.push_back(std::string("  Incorrect catalog after ") +
+                    (IsValid ? "a reload." : "a failed reload."));
+                ++NErrors;
+            }
+        }
+    }
+
+    // Load and reload the same text into UTF-8 columns
+    CUtf8ColumnarMessages Utf8Columns;
+    MessagesFile.Load(Text.data(), Text.size(), Utf8Columns);
+    CUtf8ColumnarMessages Utf8Updated;
+    NDecoded = MessagesFile.Reload(ChangedText.data(), ChangedText.size(),
+        Utf8Columns, Utf8Updated);
+    bool IsSame = (NDecoded == 2 &&
+        Utf8Updated.MessageCount() == Reloaded.MessageCount() &&
+        Utf8Columns.MessageCount() == Original.MessageCount());
+    for (const std::wstring &Language : Languages) {
+        std::vector<std::wstring> Expected, Actual;
+        Reloaded.Translations(Language, Expected);
+        Utf8Updated.Translations(Language, Actual);
+        IsSame = IsSame && (Actual == Expected);
+    }
+    if (!IsSame) {
+        report.push_back("  UTF-8 reload differs from load.");
+        ++NErrors;
+    }
+    try {
+        std::string Invalid(Text);
+        Invalid.replace(Invalid.find("Eins"), 1, 1, '\xff');
+        MessagesFile.Load(Invalid.data(), Invalid.size(), Utf8Columns);
+        report.push_back("  No error for invalid UTF-8.");
+        ++NErrors;
+    }
+    catch (std::runtime_error &) {
+    }
+
+    // An error found by a parallel load names the same record as it does in a
+    // serial load, although it is not in the first chunk
+    {
+        std::string Big("Name,Description,Type,English\n");
+        for (size_t Ix = 1; Ix < 30000; ++Ix)
+            Big += (Ix == 25000) ? std::string("Bad,\"x\"y,T,Bad\n")
+                : "Msg" + std::to_string(Ix) + ",Description,T,Text\n";
+        std::string Errors[2];
+        for (size_t Ix = 0; Ix < 2; ++Ix) {
+            CMessagesFile Loader;
+            Loader.Threads(Ix == 0 ? 1 : 4);
+            CMessages Ignored;
+            try {
+                Loader.Load(Big.data(), Big.size(), Ignored);
+            }
+            catch (std::runtime_error &e) {
+                Errors[Ix] = e.what();
+            }
+        }
+        if (Errors[0].find("record 25001.") == std::string::npos ||
+            Errors[1] != Errors[0]) {
+            report.push_back("  Incorrect parallel error: \"" + Errors[1] +
+                "\".");
+            ++NErrors;
+        }
+    }
+
+    // A parallel load restricted to some languages gives the same messages as
+    // a serial one
+    try {
+        std::string Big("Name,Description,Type,English,French\n");
+        for (size_t Ix = 1; Ix < 30000; ++Ix)
+            Big += "Msg" + std::to_string(Ix) + ",Description,T,One,Un" +
+                std::to_string(Ix) + "\n";
+        CMessages Loaded[2];
+        for (size_t Ix = 0; Ix < 2; ++Ix) {
+            CMessagesFile Loader;
+            Loader.Threads(Ix == 0 ? 1 : 4);
+            Loader.Languages(std::vector<std::wstring>(1, L"French"));
+            Loader.Load(Big.data(), Big.size(), Loaded[Ix]);
+        }
+        std::vector<std::wstring> Languages, Serial, Parallel;
+        Loaded[1].Languages(Languages);
+        Loaded[0].Translations(L"French", Serial);
+        Loaded[1].Translations(L"French", Parallel);
+        if (Languages.size() != 1 ||
+            Loaded[1].Message(7).Translations().size() != 1 ||
+            Parallel.size() != 29999 || Parallel[7] != L"Un8" ||
+            Parallel != Serial) {
+            report.push_back("  Incorrect parallel load of French only.");
+            ++NErrors;
+        }
+    }
+    catch (std::exception &e) {
+        report.push_back(std::string("  ") + e.what());
+        ++NErrors;
+    }
+
+    return NErrors;
+}
@@ -0,0 +1,139 @@
+//#pragma once
+
+#ifndef MESSAGES_FILE_HPP
+#define MESSAGES_FILE_HPP
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include "TextTable.hpp"
+#include "TextPushParser.hpp"
+#include "Messages.hpp"
+#include "ColumnarMessages.hpp"
+
+class CInstrumentation;
+class CMappedFile;
+
+//##############################################################################
+// CMessagesFile
+//##############################################################################
+//! Loads a messages file into a CMessages object, or saves one.  The file
+//! consists of a heading record naming the columns, followed by one record per
+//! message:
+//!
+//!   Name,Description,Type,<Language 1>,<Language 2>,...
+//!
+//! Files are memory mapped and parsed directly from the mapped pages, while
+//! streams are parsed a chunk at a time as they are read.  Either way, there
+//! is no limit on the length of a record and quoted values may span lines.
+//! Files may be loaded by several threads, one chunk of the file each, which
+//! gives the same result as loading them serially.  Loading is serial by
+//! default; Threads(0) selects one thread per hardware thread.  Saving a
+//! CMessages object and loading the file back gives the same messages.
+//! Memory may also be loaded serially straight into a CColumnarMessages
+//! object, converting each record in buffers reused from record to record, so
+//! that the only allocations are those of the catalog's arena, or into a
+//! CUtf8ColumnarMessages object, which keeps the text of the file unconverted.
+//! Such a catalog keeps a fingerprint of the raw bytes of each record, and may
+//! be reloaded from a changed version of its file by Reload(), which builds a
+//! new catalog, copying the messages whose records the previous catalog holds
+//! and decoding only the others.  The previous catalog is not changed, so it
+//! may be a snapshot published by a CCatalogHandle and stays in use if the
+//! reload fails.  Any load
+//! may be restricted to some languages by Languages(), in which case the
+//! values of the other languages are skipped by the parser and never copied
+//! or decoded, apart from the first translation of messages that are not to
+//! be translated, which stands for every language.
+//! If given a CInstrumentation object by Instrumentation(), loads time their
+//! phases and count the records, bytes and values parsed.
+//##############################################################################
+
+class CMessagesFile {
+public:
+    static const size_t NameIx = 0;
+    static const size_t DescIx = 1;
+    static const size_t TypeIx = 2;
+    static const size_t LangIx = 3;
+    static const size_t ChunkSize = 0x10000;
+    static const size_t MinThreadSize = 0x10000;
+
+    CMessagesFile(const CTextTable &textTable = CTextTable());
+    CMessagesFile(const CMessagesFile &other) = delete;
+    CMessagesFile &operator=(const CMessagesFile &other) = delete;
+
+    void   Echo(std::ostream *pecho) { mpEcho = pecho; }
+    void   Instrumentation(CInstrumentation *pinstrumentation) {
+        mpInstrumentation = pinstrumentation;
+    }
+    size_t Threads() const;
+    void   Threads(size_t threads) { mThreads = threads; }
+    const std::vector<std::wstring> &Languages() const { return mLanguages; }
+    void   Languages(const std::vector<std::wstring> &languages) {
+        mLanguages = languages;
+    }
+    void Load(const std::string &fileName, CMessages &messages);
+    void Load(const char *pdata, size_t size, CMessages &messages);
+    void Load(std::istream &stream, CMessages &messages);
+    void Load(const std::string &fileName, CColumnarMessages &messages);
+    void Load(const std::string &fileName, CUtf8ColumnarMessages &messages);
+    void Load(const char *pdata, size_t size, CColumnarMessages &messages);
+    void Load(const char *pdata, size_t size,
+        CUtf8ColumnarMessages &messages);
+    size_t Reload(const std::string &fileName,
+        const CColumnarMessages &previous, CColumnarMessages &messages);
+    size_t Reload(const std::string &fileName,
+        const CUtf8ColumnarMessages &previous,
+        CUtf8ColumnarMessages &messages);
+    size_t Reload(const char *pdata, size_t size,
+        const CColumnarMessages &previous, CColumnarMessages &messages);
+    size_t Reload(const char *pdata, size_t size,
+        const CUtf8ColumnarMessages &previous,
+        CUtf8ColumnarMessages &messages);
+    void Save(const std::string &fileName, const CMessages &messages) const;
+    void Save(std::ostream &stream, const CMessages &messages) const;
+
+private:
+    CTextTable        mTextTable;
+    std::ostream     *mpEcho;
+    CInstrumentation *mpInstrumentation;
+    size_t            mThreads;
+    std::vector<std::wstring> mLanguages; // Selected, or empty for all
+
+    void FileOpen(const std::string &fileName, CMappedFile &file) const;
+    bool LoadParallel(const char *pdata, size_t size, size_t nThreads,
+        CMessages &messages) const;
+    template <typename TChar>
+    void LoadColumns(const char *pdata, size_t size,
+        CBasicColumnarMessages<TChar> &messages);
+    template <typename TChar>
+    size_t ReloadColumns(const char *pdata, size_t size,
+        const CBasicColumnarMessages<TChar> &previous,
+        CBasicColumnarMessages<TChar> &messages);
+    void RecordAdd(const CTextRecord &record, CTextPushParser &parser,
+        std::vector<size_t> &columns, CMessages &messages);
+    void ColumnsSelect(const CTextRecord &heading, CTextPushParser &parser,
+        std::vector<std::wstring> &languages,
+        std::vector<size_t> &columns) const;
+    static void FieldsKeep(const std::vector<size_t> &columns,
+        CTextPushParser &parser);
+    template <typename TChar>
+    void RecordAdd(const CTextRecord &record,
+        const std::vector<size_t> &columns,
+        CBasicColumnarMessages<TChar> &messages,
+        std::vector<std::basic_string<TChar>> &values,
+        std::vector<CBasicField<TChar>> &translations) const;
+    static uint64_t RecordFingerprint(const CTextRecord &record);
+    void LanguagesMake(const CTextRecord &record,
+        std::vector<std::wstring> &languages) const;
+    bool MessageMake(const CTextRecord &record,
+        const std::vector<size_t> &columns, CMessage &message) const;
+    void EchoRecord(const CTextRecord &record) const;
+    std::string RecordText(const CTextRecord &record) const;
+};
+
+//##############################################################################
+
+uint32_t MessagesFileTest(std::vector<std::string> &report);
+
+#endif // MESSAGES_FILE_HPP
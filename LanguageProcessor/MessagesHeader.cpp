@@ -0,0 +1,320 @@
+#include "stdafx.h"
+
+#include <cctype>
+#include <cstdio>
+#include <fstream>
+#include <ostream>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+
+#include "MessagesHeader.hpp"
+
+//##############################################################################
+// CMessagesHeader
+//##############################################################################
+//! Writes a CMessages object as a C++ header of constant tables.
+//##############################################################################
+
+namespace {
+
+const char *const sKeywords[] = {
+    "alignas", "alignof", "and", "and_eq", "asm", "auto", "bitand", "bitor",
+    "bool", "break", "case", "catch", "char", "char16_t", "char32_t", "class",
+    "compl", "const", "constexpr", "const_cast", "continue", "decltype",
+    "default", "delete", "do", "double", "dynamic_cast", "else", "enum",
+    "explicit", "export", "extern", "false", "float", "for", "friend", "goto",
+    "if", "inline", "int", "long", "mutable", "namespace", "new", "noexcept",
+    "not", "not_eq", "nullptr", "operator", "or", "or_eq", "private",
+    "protected", "public", "register", "reinterpret_cast", "return", "short",
+    "signed", "sizeof", "static", "static_assert", "static_cast", "struct",
+    "switch", "template", "this", "thread_local", "throw", "true", "try",
+    "typedef", "typeid", "typename", "union", "unsigned", "using", "virtual",
+    "void", "volatile", "wchar_t", "while", "xor", "xor_eq"
+};
+
+const size_t sLiteralPieceLen = 1000; // Well inside compiler literal limits
+
+} // namespace
+
+//------------------------------------------------------------------------------
+//! Static function writes the messages as a header guarded by the specified
+//! macro, declaring everything within the specified namespace.
+//
+void CMessagesHeader::Write(const CMessages &messages, std::ostream &stream,
+    const std::string &nameSpace, const std::string &guard) {
+    std::vector<std::wstring> Languages;
+    messages.Languages(Languages);
+    size_t NLanguages = Languages.size();
+    size_t NMessages = messages.MessageCount();
+    std::vector<std::wstring> Names;
+    for (size_t Ix = 0; Ix < NMessages; ++Ix)
+        Names.push_back(messages.Message(Ix).Name());
+    std::vector<std::string> LanguageIDs, MessageIDs;
+    Identifiers(Languages, "Count", LanguageIDs);
+    Identifiers(Names, "Count", MessageIDs);
+
+    std::ostringstream Text;
+    Text << "// Generated from a messages file by MessagesGenerator; do not "
+        "edit.\n\n";
+    Text << "#ifndef " << guard << "\n#define " << guard << "\n\n";
+    Text << "#include <cstddef>\n#include <cstdint>\n\n";
+    Text << "namespace " << nameSpace << " {\n\n";
+
+    Text << "enum class ELanguageID : std::uint32_t {\n";
+    for (const std::string &ID : LanguageIDs)
+        Text << "    " << ID << ",\n";
+    Text << "    Count\n};\n\n";
+    Text << "enum class EMessageID : std::uint32_t {\n";
+    for (const std::string &ID : MessageIDs)
+        Text << "    " << ID << ",\n";
+    Text << "    Count\n};\n\n";
+    Text << "constexpr std::size_t LanguageCount = " << NLanguages << ";\n";
+    Text << "constexpr std::size_t MessageCount = " << NMessages << ";\n\n";
+
+    // Arrays may not be empty, so an empty table gets a placeholder
+    Text << "constexpr bool DoTranslate[] = {\n";
+    for (size_t Ix = 0; Ix < NMessages; ++Ix)
+        Text << "    " << (messages.Message(Ix).DoTranslate() ? "true, " :
+            "false,") << " // " << MessageIDs[Ix] << "\n";
+    if (NMessages == 0)
+        Text << "    false  // Placeholder\n";
+    Text << "};\n\n";
+
+    Text << "namespace Text {\n\n";
+    for (size_t Iy = 0; Iy < NLanguages; ++Iy) {
+        Text << "constexpr const wchar_t *const " << LanguageIDs[Iy] <<
+            "[] = {\n";
+        ELanguage Language = static_cast<ELanguage>(Iy);
+        for (size_t Ix = 0; Ix < NMessages; ++Ix)
+            Text << "    " << Literal(messages.Translation(Ix, Language))
+                << ", // " << MessageIDs[Ix] << "\n";
+        if (NMessages == 0)
+            Text << "    nullptr // Placeholder\n";
+        Text << "};\n\n";
+    }
+    Text << "} // namespace Text\n\n";
+
+    Text << "constexpr const wchar_t *const *const Translations[] = {\n";
+    for (const std::string &ID : LanguageIDs)
+        Text << "    Text::" << ID << ",\n";
+    if (NLanguages == 0)
+        Text << "    nullptr // Placeholder\n";
+    Text << "};\n\n";
+
+    Text << "//! Returns the translation of a message into a language, or its "
+        "first\n//! translation if it is not to be translated.\n";
+    Text << "constexpr const wchar_t *Translation(EMessageID id, "
+        "ELanguageID language) {\n";
+    Text << "    return Translations[static_cast<std::size_t>(language)]\n";
+    Text << "        [static_cast<std::size_t>(id)];\n}\n\n";
+
+    Text << "} // namespace " << nameSpace << "\n\n";
+    Text << "#endif // " << guard << "\n";
+
+    std::string Out(Text.str());
+    if (!stream.write(Out.data(), Out.size()))
+        throw std::runtime_error("CMessagesHeader: Failed to write.");
+}
+
+//------------------------------------------------------------------------------
+//! Static function writes the messages as a header file, guarded by a macro
+//! made from the name of the file.
+//
+void CMessagesHeader::Save(const CMessages &messages,
+    const std::string &fileName, const std::string &nameSpace) {
+    std::string Guard(fileName.substr(fileName.find_last_of("/\\") + 1));
+    for (char &Ch : Guard)
+        Ch = std::isalnum(static_cast<unsigned char>(Ch))
+            ? static_cast<char>(std::toupper(static_cast<unsigned char>(Ch)))
+            : '_';
+    if (Guard.empty() || std::isdigit(static_cast<unsigned char>(Guard[0])))
+        Guard.insert(0, "H_");
+
+    std::ofstream File(fileName, std::ios::binary | std::ios::trunc);
+    if (!File)
+        throw std::runtime_error("Failed to create \"" + fileName + "\".");
+    Write(messages, File, nameSpace, Guard);
+    if (!File.flush())
+        throw std::runtime_error("Failed to write \"" + fileName + "\".");
+}
+
+//------------------------------------------------------------------------------
+//! Static function makes a name into a C++ identifier: characters other than
+//! ASCII letters and digits become underscores, runs of underscores are
+//! shortened to one, and a name that is empty or starts with a digit or an
+//! underscore is prefixed with X.  Keywords have an underscore appended.
+//
+std::string CMessagesHeader::Identifier(const std::wstring &name) {
+    std::string Result;
+    for (wchar_t Ch : name) {
+        bool IsAlnum = (Ch >= L'a' && Ch <= L'z') || (Ch >= L'A' &&
+            Ch <= L'Z') || (Ch >= L'0' && Ch <= L'9');
+        char Out = IsAlnum ? static_cast<char>(Ch) : '_';
+        if (Out != '_' || Result.empty() || Result.back() != '_')
+            Result += Out;
+    }
+    if (Result.empty() || Result[0] == '_' ||
+        (Result[0] >= '0' && Result[0] <= '9'))
+        Result.insert(0, "X");
+    for (const char *pKeyword : sKeywords)
+        if (Result == pKeyword)
+            return Result + "_";
+    return Result;
+}
+
+//------------------------------------------------------------------------------
+//! Static function returns a wide string literal for the specified text.
+//! Quotes, backslashes and question marks are escaped, control characters are
+//! written in octal, and non-ASCII characters as universal character names,
+//! combining surrogate pairs and replacing lone surrogates with U+FFFD.  Long
+//! text is split into several adjacent literals.
+//
+std::string CMessagesHeader::Literal(const std::wstring &text) {
+    std::string Result("L\"");
+    size_t PieceLen = 0;
+    size_t Len = text.size();
+    for (size_t Ix = 0; Ix < Len; ++Ix) {
+        if (PieceLen >= sLiteralPieceLen) {
+            Result += "\" L\"";
+            PieceLen = 0;
+        }
+        uint32_t Ch = static_cast<uint32_t>(text[Ix]);
+        char Escape[16];
+        switch (Ch) {
+        case '"':  Result += "\\\""; break;
+        case '\\': Result += "\\\\"; break;
+        case '?':  Result += "\\?"; break;
+        case '\n': Result += "\\n"; break;
+        case '\r': Result += "\\r"; break;
+        case '\t': Result += "\\t"; break;
+        default:
+            if (Ch < 0x20 || Ch == 0x7f) {
+                std::snprintf(Escape, sizeof(Escape), "\\%03o", Ch);
+                Result += Escape;
+            }
+            else if (Ch < 0x80)
+                Result += static_cast<char>(Ch);
+            else {
+                if (Ch >= 0xd800 && Ch < 0xdc00 && Ix + 1 < Len &&
+                    text[Ix + 1] >= 0xdc00 && text[Ix + 1] < 0xe000)
+                    Ch = 0x10000 + ((Ch - 0xd800) << 10) +
+                        (static_cast<uint32_t>(text[++Ix]) - 0xdc00);
+                else if ((Ch >= 0xd800 && Ch < 0xe000) || Ch > 0x10ffff)
+                    Ch = 0xfffd;
+                std::snprintf(Escape, sizeof(Escape),
+                    (Ch < 0x10000) ? "\\u%04X" : "\\U%08X", Ch);
+                Result += Escape;
+            }
+            break;
+        }
+        ++PieceLen;
+    }
+    return Result + "\"";
+}
+
+//------------------------------------------------------------------------------
+//! Private static function makes identifiers of the specified names that are
+//! distinct from each other and from preserved, appending _2, _3 and so on
+//! where necessary.
+//
+void CMessagesHeader::Identifiers(const std::vector<std::wstring> &names,
+    const char *preserved, std::vector<std::string> &identifiers) {
+    std::set<std::string> Used;
+    Used.insert(preserved);
+    identifiers.clear();
+    for (const std::wstring &Name : names) {
+        std::string Base(Identifier(Name));
+        std::string ID(Base);
+        for (size_t Suffix = 2; !Used.insert(ID).second; ++Suffix)
+            ID = Base + "_" + std::to_string(Suffix);
+        identifiers.push_back(ID);
+    }
+}
+
+//##############################################################################
+
+//------------------------------------------------------------------------------
+//! Function tests CMessagesHeader by writing awkward messages and checking
+//! the identifiers, literals and tables in the header.
+//
+uint32_t MessagesHeaderTest(std::vector<std::string> &report) {
+    uint32_t NErrors = 0;
+    report.push_back("");
+    report.push_back("MessagesHeader Test:");
+
+    struct CCase {
+        const wchar_t *pText;
+        const char    *pExpected;
+    };
+    static const CCase Literals[] = {
+        { L"Plain",              "L\"Plain\"" },
+        { L"\"a\\b?\"",          "L\"\\\"a\\\\b\\?\\\"\"" },
+        { L"1\r\n2\t\x1f",       "L\"1\\r\\n2\\t\\037\"" },
+        { L"Caf\x00e9\x4e2d",    "L\"Caf\\u00E9\\u4E2D\"" },
+        { L"\xd83d\xde00",       "L\"\\U0001F600\"" },
+        { L"\xdc00",             "L\"\\uFFFD\"" },
+    };
+    for (const CCase &Case : Literals) {
+        std::string Actual(CMessagesHeader::Literal(Case.pText));
+        if (Actual != Case.pExpected) {
+            report.push_back("  Incorrect literal: " + Actual + ".");
+            ++NErrors;
+        }
+    }
+    static const CCase Identifiers[] = {
+        { L"Hello World", "Hello_World" },
+        { L"a -- b",      "a_b" },
+        { L"3D",          "X3D" },
+        { L"__Init",      "X_Init" },
+        { L"",            "X" },
+        { L"delete",      "delete_" },
+        { L"Caf\x00e9",   "Caf_" },
+    };
+    for (const CCase &Case : Identifiers) {
+        std::string Actual(CMessagesHeader::Identifier(Case.pText));
+        if (Actual != Case.pExpected) {
+            report.push_back("  Incorrect identifier: " + Actual + ".");
+            ++NErrors;
+        }
+    }
+
+    CMessages Messages(std::vector<std::wstring>{ L"English", L"German" });
+    auto MessageAdd = [&Messages](const wchar_t *pname, wchar_t translate,
+        const wchar_t *penglish, const wchar_t *pgerman) {
+        CMessage Message;
+        Message.Name(pname);
+        Message.Translate(translate);
+        Message.TranslationAdd(penglish);
+        Message.TranslationAdd(pgerman);
+        Messages.MessageAdd(Message);
+    };
+    MessageAdd(L"Hello", L'T', L"Hello", L"Hallo");
+    MessageAdd(L"Hello", L'T', L"Hi", L"Servus");
+    MessageAdd(L"Count", L'F', L"OK", L"Okay");
+    std::ostringstream Stream;
+    CMessagesHeader::Write(Messages, Stream, "Msg", "MSG_HPP");
+    std::string Header(Stream.str());
+    static const char *const Expected[] = {
+        "#ifndef MSG_HPP\n",
+        "namespace Msg {\n",
+        "enum class ELanguageID : std::uint32_t {\n    English,\n    German,\n"
+            "    Count\n};\n",
+        "enum class EMessageID : std::uint32_t {\n    Hello,\n    Hello_2,\n"
+            "    Count_2,\n    Count\n};\n",
+        "constexpr bool DoTranslate[] = {\n    true,  // Hello\n"
+            "    true,  // Hello_2\n    false, // Count_2\n};\n",
+        "constexpr const wchar_t *const German[] = {\n"
+            "    L\"Hallo\", // Hello\n    L\"Servus\", // Hello_2\n"
+            "    L\"OK\", // Count_2\n};\n",
+        "    Text::English,\n    Text::German,\n};\n",
+    };
+    for (const char *pExpected : Expected) {
+        if (Header.find(pExpected) == std::string::npos) {
+            report.push_back(std::string("  Header lacks: ") + pExpected);
+            ++NErrors;
+        }
+    }
+
+    return NErrors;
+}
@@ -0,0 +1,55 @@
+//#pragma once
+
+#ifndef MESSAGES_HEADER_HPP
+#define MESSAGES_HEADER_HPP
+
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include "Messages.hpp"
+
+//##############################################################################
+// CMessagesHeader
+//##############################################################################
+//! Writes a CMessages object as a self-contained C++ header, so that a program
+//! may carry its messages as constant data instead of parsing a messages file
+//! at run time.  Within the specified namespace the header declares:
+//!
+//!   enum class ELanguageID  One enumerator per language, then Count
+//!   enum class EMessageID   One enumerator per message, then Count
+//!   DoTranslate[]           Whether each message is to be translated
+//!   Text::<Language>[]      The translations into each language
+//!   Translations[]          The language arrays, indexed by ELanguageID
+//!   Translation(id, lang)   A constexpr lookup, a pair of array indexes
+//!
+//! As in CMessage::Translation(), a message that is not to be translated has
+//! its first translation in every language array, and missing translations
+//! are empty.  Names are made into identifiers by replacing other characters
+//! with underscores and appending a suffix where they would clash with each
+//! other or with a keyword.  Text is written as wide string literals with
+//! non-ASCII characters as universal character names, so the header does not
+//! depend on the encoding of the source files that include it.
+//##############################################################################
+
+class CMessagesHeader {
+public:
+    static void Write(const CMessages &messages, std::ostream &stream,
+        const std::string &nameSpace, const std::string &guard);
+    static void Save(const CMessages &messages, const std::string &fileName,
+        const std::string &nameSpace);
+
+    static std::string Identifier(const std::wstring &name);
+    static std::string Literal(const std::wstring &text);
+
+private:
+    static void Identifiers(const std::vector<std::wstring> &names,
+        const char *preserved, std::vector<std::string> &identifiers);
+};
+
+//##############################################################################
+
+uint32_t MessagesHeaderTest(std::vector<std::string> &report);
+
+#endif // MESSAGES_HEADER_HPP
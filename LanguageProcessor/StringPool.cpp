@@ -0,0 +1,168 @@
+#include "stdafx.h"
+
+#include <stdexcept>
+
+#include "StringPool.hpp"
+
+//##############################################################################
+// CBasicStringPool
+//##############################################################################
+//! Interns strings into a pool of text held in an arena, storing each
+//! distinct string once.  The functions are instantiated below for wide and
+//! UTF-8 text.
+//##############################################################################
+
+//------------------------------------------------------------------------------
+//! Default constructor creates an empty pool.
+//
+template <typename TChar>
+CBasicStringPool<TChar>::CBasicStringPool() :
+    mArena(4 * SlotLen * sizeof(TChar)), mUsed(0),
+    mIndex(CSpan{ EmptySlot, 0 }, 64), mReferences(0), mStrings(0),
+    mAddedLen(0), mPoolLen(0) {
+}
+
+//------------------------------------------------------------------------------
+//! Function removes all strings and frees the arena holding them.
+//
+template <typename TChar>
+void CBasicStringPool<TChar>::Clear() {
+    std::vector<TChar *>().swap(mSlots);
+    mUsed = 0;
+    mIndex.Clear();
+    mArena.Reset();
+    mReferences = 0;
+    mStrings = 0;
+    mAddedLen = 0;
+    mPoolLen = 0;
+}
+
+//------------------------------------------------------------------------------
+//! Function returns the span of the specified string, adding it to the pool
+//! unless an identical string is already there.  Empty strings all share the
+//! empty span and are not stored.
+//
+template <typename TChar>
+typename CBasicStringPool<TChar>::CSpan CBasicStringPool<TChar>::Add(
+    const TChar *ptext, size_t len) {
+    ++mReferences;
+    mAddedLen += len;
+    CSpan Span = { 0, 0 };
+    if (len == 0)
+        return Span;
+
+    return mIndex.Insert(TextHash(ptext, len), [&](CSpan other) {
+        return other.Len == len && std::char_traits<TChar>::compare(
+            Text(other.Offset), ptext, len) == 0;
+    }, [&]() {
+        if (mUsed + len > mSlots.size() * SlotLen) { // Start new slots
+            size_t NSlots = (len + SlotLen - 1) >> SlotBits;
+            if (mSlots.size() + NSlots > (EmptySlot >> SlotBits))
+                throw std::runtime_error("CStringPool::Add(): Pool exceeds "
+                    "4G characters.");
+            TChar *pText = static_cast<TChar *>(mArena.Allocate(
+                NSlots * SlotLen * sizeof(TChar), alignof(TChar)));
+            mUsed = mSlots.size() * SlotLen;
+            for (size_t Ix = 0; Ix < NSlots; ++Ix)
+                mSlots.push_back(pText + Ix * SlotLen);
+        }
+        CSpan Added = { static_cast<uint32_t>(mUsed),
+            static_cast<uint32_t>(len) };
+        std::char_traits<TChar>::copy(mSlots[mUsed >> SlotBits] +
+            (mUsed & (SlotLen - 1)), ptext, len);
+        mUsed += len;
+        ++mStrings;
+        mPoolLen += len;
+        return Added;
+    });
+}
+
+//------------------------------------------------------------------------------
+//! Function returns a view of the string with the specified span.
+//
+template <typename TChar>
+typename CBasicStringPool<TChar>::TField CBasicStringPool<TChar>::Field(
+    CSpan span) const {
+    static const TChar Empty[1] = { 0 };
+    TField Field = { Empty, 0 };
+    if (span.Len == 0)
+        return Field;
+    if (static_cast<size_t>(span.Offset) + span.Len > mUsed)
+        throw std::out_of_range("CStringPool::Field(): Invalid span.");
+    Field.pText = Text(span.Offset);
+    Field.Len = span.Len;
+    return Field;
+}
+
+//------------------------------------------------------------------------------
+//! Function returns the number of bytes of heap memory held by the pool: the
+//! blocks of its arena, its list of slots and its index.
+//
+template <typename TChar>
+size_t CBasicStringPool<TChar>::MemoryUsed() const {
+    return mArena.Reserved() + mSlots.capacity() * sizeof(TChar *) +
+        mIndex.MemoryUsed();
+}
+
+template class CBasicStringPool<wchar_t>;
+template class CBasicStringPool<char>;
+
+//##############################################################################
+
+//------------------------------------------------------------------------------
+//! Function tests CStringPool by adding strings with many repeats, and strings
+//! longer than a slot, and checking that each distinct string is stored once
+//! and read back unchanged.
+//
+uint32_t StringPoolTest(std::vector<std::string> &report) {
+    uint32_t NErrors = 0;
+    report.push_back("");
+    report.push_back("StringPool Test:");
+
+    CStringPool Pool;
+    std::vector<std::wstring> Texts;
+    std::vector<CStringPool::CSpan> Spans;
+    size_t AddedLen = 0;
+    for (size_t Ix = 0; Ix < 3000; ++Ix) {
+        std::wstring Text = (Ix % 10 == 0) ? std::wstring()
+            : L"Text " + std::to_wstring(Ix % 700);
+        if (Ix % 700 == 333) // Crosses slot boundaries
+            Text += std::wstring(CStringPool::SlotLen + 100, L'x');
+        Texts.push_back(Text);
+        Spans.push_back(Pool.Add(Text));
+        AddedLen += Text.size();
+    }
+
+    for (size_t Ix = 0; Ix < Texts.size(); ++Ix) {
+        if (Pool.Field(Spans[Ix]).Str() != Texts[Ix]) {
+            report.push_back("  Incorrect string " + std::to_string(Ix) +
+                ".");
+            ++NErrors;
+        }
+    }
+    CStringPool::CSpan Again = Pool.Add(Texts[1]);
+    if (Again.Offset != Spans[1].Offset || Again.Len != Spans[1].Len) {
+        report.push_back("  Repeated string stored again.");
+        ++NErrors;
+    }
+    // 700 values of Ix % 700, less the 70 that are only ever empty
+    if (Pool.References() != Texts.size() + 1 || Pool.Strings() != 630 ||
+        Pool.AddedLen() != AddedLen + Texts[1].size()) {
+        report.push_back("  Incorrect counts.");
+        ++NErrors;
+    }
+
+    // UTF-8 text is pooled the same way, byte by byte
+    CUtf8StringPool Utf8Pool;
+    CUtf8StringPool::CSpan First = Utf8Pool.Add("Gr\xc3\xbc\xc3\x9f" "e");
+    CUtf8StringPool::CSpan Second = Utf8Pool.Add(std::string("Gr\xc3\xbc"
+        "\xc3\x9f" "e"));
+    if (First.Offset != Second.Offset || First.Len != 7 ||
+        !Utf8Pool.Field(Second).Equals("Gr\xc3\xbc\xc3\x9f" "e") ||
+        Utf8Pool.Strings() != 1) {
+        report.push_back("  Incorrect UTF-8 pool.");
+        ++NErrors;
+    }
+
+    return NErrors;
+}
@@ -0,0 +1,93 @@
+//#pragma once
+
+#ifndef STRING_POOL_HPP
+#define STRING_POOL_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Utils.hpp"
+#include "Arena.hpp"
+#include "TextTable.hpp"
+
+//##############################################################################
+// CBasicStringPool
+//##############################################################################
+//! Interns strings into a pool of text, so that a string added any number of
+//! times is stored once.  Each string added is identified by a span (offset
+//! and length) of the pool; identical strings get identical spans.  Strings
+//! are found by an open addressing hash table of the spans, kept at most half
+//! full.
+//!
+//! The text is held in an arena, in slots of SlotLen characters, and a span's
+//! offset selects a slot by its upper bits.  A string that does not fit in
+//! what is left of the current slots starts new ones, allocated together so
+//! that a long string may cross slot boundaries.  Text is therefore never
+//! moved as the pool grows, views returned by Field() stay valid until the
+//! pool is cleared, and clearing or destroying the pool frees a few arena
+//! blocks however many strings it holds.
+//!
+//! CStringPool holds wide text and CUtf8StringPool holds UTF-8 bytes, the
+//! lengths of both being counted in their own characters.
+//##############################################################################
+
+template <typename TChar>
+class CBasicStringPool {
+public:
+    typedef CBasicField<TChar> TField;
+
+    static const uint32_t SlotBits = 10;
+    static const uint32_t SlotLen = 1 << SlotBits;
+
+    struct CSpan {
+        uint32_t Offset;
+        uint32_t Len;
+
+        bool operator==(const CSpan &other) const {
+            return Offset == other.Offset && Len == other.Len;
+        }
+    };
+
+    CBasicStringPool();
+    CBasicStringPool(const CBasicStringPool &other) = delete;
+    CBasicStringPool &operator=(const CBasicStringPool &other) = delete;
+
+    void   Clear();
+    CSpan  Add(const TChar *ptext, size_t len);
+    CSpan  Add(const std::basic_string<TChar> &text) {
+        return Add(text.data(), text.size());
+    }
+    TField Field(CSpan span) const;
+
+    size_t References() const { return mReferences; }
+    size_t Strings() const { return mStrings; }
+    size_t AddedLen() const { return mAddedLen; }
+    size_t PoolLen() const { return mPoolLen; }
+    size_t MemoryUsed() const;
+
+private:
+    static const uint32_t EmptySlot = 0xffffffff;
+
+    CArena                  mArena;
+    std::vector<TChar *>    mSlots;    // Start of each slot of text
+    size_t                  mUsed;     // Offset of the next character
+    CHashIndex<CSpan>       mIndex;    // Of spans, by text
+    size_t                  mReferences;
+    size_t                  mStrings;
+    size_t                  mAddedLen;
+    size_t                  mPoolLen;
+
+    const TChar *Text(uint32_t offset) const {
+        return mSlots[offset >> SlotBits] + (offset & (SlotLen - 1));
+    }
+};
+
+typedef CBasicStringPool<wchar_t> CStringPool;
+typedef CBasicStringPool<char>    CUtf8StringPool;
+
+//##############################################################################
+
+uint32_t StringPoolTest(std::vector<std::string> &report);
+
+#endif // STRING_POOL_HPP
@@ -6,7 +6,11 @@
 #include <string>
 #include <vector>
 
-enum class ESwitchID { None, Help, Verbose, Pause, Language };
+enum class ESwitchID {
+    None, Help, Verbose, Pause, Language, Threads, Input, Compile, Export,
+    Output, Namespace, Utf8, Filter, Rows, Seed, Length, Special, NonAscii,
+    Untranslated, Memory
+};
 
 //##############################################################################
 
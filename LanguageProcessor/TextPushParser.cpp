@@ -0,0 +1,370 @@
+#include "stdafx.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "TextPushParser.hpp"
+
+//##############################################################################
+// CTextPushParser
+//##############################################################################
+//! Parses UTF-8 text fed to it in chunks and passes each record to a handler
+//! as soon as it is complete.
+//##############################################################################
+
+//------------------------------------------------------------------------------
+//! Constructor sets the record handler and the delimiter and quote characters,
+//! which must both be ASCII characters other than CR and LF.
+//
+CTextPushParser::CTextPushParser(const TRecordHandler &handler,
+    wchar_t delimiter, wchar_t quote) : mHandler(handler),
+    mDelimiter(static_cast<char>(delimiter)), mQuote(static_cast<char>(quote)),
+    mScanner(delimiter, quote) {
+    if (delimiter >= 0x80 || quote >= 0x80 || delimiter == L'\n' ||
+        delimiter == L'\r' || quote == L'\n' || quote == L'\r')
+        throw std::runtime_error("CTextPushParser: The delimiter and quote "
+            "must be ASCII characters other than CR and LF.");
+    Reset();
+}
+
+//------------------------------------------------------------------------------
+//! Function discards any partial record and restarts the record count, so
+//! that the parser can be reused for new input.
+//
+void CTextPushParser::Reset() {
+    mState = EState::FieldStart;
+    mRecordStarted = false;
+    mpRecordStart = nullptr;
+    mBuffer.clear();
+    mFieldEnds.clear();
+    mRecord.Fields.clear();
+    mRecord.Number = 0;
+    mFields = 0;
+    mQuotedFields = 0;
+    KeepUpdate();
+}
+
+//------------------------------------------------------------------------------
+//! Function selects the values to keep by their positions within a record,
+//! from the next value on.  Values at positions marked false, or beyond the
+//! end of keep, are passed to the handler as empty values and cost no more
+//! than scanning them.  If keep is empty, all values are kept.  The handler
+//! may call this function, for example to choose columns by their headings.
+//
+void CTextPushParser::FieldsKeep(const std::vector<bool> &keep) {
+    mKeep = keep;
+    KeepUpdate();
+}
+
+//------------------------------------------------------------------------------
+//! Function parses the next chunk of input, calling the record handler for
+//! every record the chunk completes.  The chunk may end anywhere, even within
+//! a multi-byte character, and its content need not outlive the call.  If
+//! isLast is true, the chunk is the end of the input, as for Finish().
+//
+void CTextPushParser::Feed(const char *pdata, size_t size, bool isLast) {
+    const char *p = pdata;
+    const char *pend = pdata + size;
+    mpRecordStart = AtRecordStart() ? p : nullptr;
+
+    while (p < pend) {
+        char Ch = *p;
+        switch (mState) {
+        case EState::FieldStart:
+            if (Ch == mQuote) {
+                mRecordStarted = true;
+                mState = EState::Quoted;
+                ++mQuotedFields;
+                ++p;
+            }
+            else if (Ch == mDelimiter) {
+                mRecordStarted = true;
+                FieldEnd();
+                ++p;
+            }
+            else if (Ch == '\n') {
+                RecordEnd(p++);
+            }
+            else if (Ch == '\r') {
+                mState = EState::FieldCR;
+                ++p;
+            }
+            else {
+                mRecordStarted = true;
+                mState = EState::Plain;
+            }
+            break;
+
+        case EState::FieldCR:
+            if (Ch == '\n') {
+                RecordEnd(p++);
+            }
+            else { // The CR is part of the value
+                if (mIsKeeping)
+                    mBuffer += '\r';
+                mRecordStarted = true;
+                mState = EState::Plain;
+            }
+            break;
+
+        case EState::Plain: {
+            const char *pstop = Run(p, pend, false);
+            if (mIsKeeping)
+                mBuffer.append(p, pstop);
+            p = pstop;
+            if (p < pend) {
+                if (*p == mDelimiter) {
+                    FieldEnd();
+                    mState = EState::FieldStart;
+                }
+                else { // Newline, which drops a preceding CR
+                    size_t Start = mFieldEnds.empty() ? 0 : mFieldEnds.back();
+                    if (mBuffer.size() > Start && mBuffer.back() == '\r')
+                        mBuffer.pop_back();
+                    RecordEnd(p);
+                }
+                ++p;
+            }
+            break;
+        }
+
+        case EState::Quoted: {
+            const char *pstop = Run(p, pend, true);
+            if (mIsKeeping)
+                mBuffer.append(p, pstop);
+            p = pstop;
+            if (p < pend) {
+                mState = EState::QuoteSeen;
+                ++p;
+            }
+            break;
+        }
+
+        case EState::QuoteSeen:
+            if (Ch == mQuote) { // Doubled quote
+                if (mIsKeeping)
+                    mBuffer += mQuote;
+                mState = EState::Quoted;
+            }
+            else if (Ch == mDelimiter) {
+                FieldEnd();
+                mState = EState::FieldStart;
+            }
+            else if (Ch == '\n')
+                RecordEnd(p);
+            else if (Ch == '\r')
+                mState = EState::QuoteCR;
+            else
+                throw std::runtime_error("CTextPushParser: Mismatched quote in "
+                    "record " + std::to_string(mRecord.Number + 1) + ".");
+            ++p;
+            break;
+
+        case EState::QuoteCR:
+            if (Ch != '\n')
+                throw std::runtime_error("CTextPushParser: Mismatched quote in "
+                    "record " + std::to_string(mRecord.Number + 1) + ".");
+            RecordEnd(p++);
+            break;
+        }
+    }
+    if (isLast)
+        InputEnd(pend);
+}
+
+//------------------------------------------------------------------------------
+//! Function signals the end of the input, completing the last record if it is
+//! not terminated.  An unclosed quoted value throws an exception.
+//
+void CTextPushParser::Finish() {
+    mpRecordStart = nullptr;
+    InputEnd(nullptr);
+}
+
+//------------------------------------------------------------------------------
+//! Private function returns the first position from p up to pend that holds a
+//! quote, if quoted, or a delimiter or newline otherwise.  It returns pend if
+//! there is no such position.
+//
+const char *CTextPushParser::Run(const char *p, const char *pend,
+    bool quoted) const {
+    while (p < pend) {
+        size_t Len = pend - p;
+        if (Len > CTextScanner::BlockLen)
+            Len = CTextScanner::BlockLen;
+        CTextMasks Masks;
+        mScanner.Scan(p, Len, Masks);
+        uint64_t Stops = quoted
+            ? Masks.Quotes : (Masks.Delimiters | Masks.Newlines);
+        if (Stops != 0)
+            return p + CTextScanner::FirstBit(Stops);
+        p += Len;
+    }
+    return pend;
+}
+
+//------------------------------------------------------------------------------
+//! Private function completes the last record at the end of the input, which
+//! is at pend within the last chunk, or unknown if pend is nullptr.
+//
+void CTextPushParser::InputEnd(const char *pend) {
+    switch (mState) {
+    case EState::FieldStart:
+    case EState::FieldCR:
+        if (mRecordStarted)
+            RecordEnd(pend);
+        break;
+    case EState::Plain: {
+        size_t Start = mFieldEnds.empty() ? 0 : mFieldEnds.back();
+        if (mBuffer.size() > Start && mBuffer.back() == '\r')
+            mBuffer.pop_back();
+        RecordEnd(pend);
+        break;
+    }
+    case EState::Quoted:
+        throw std::runtime_error("CTextPushParser: Mismatched quote in "
+            "record " + std::to_string(mRecord.Number + 1) + ".");
+    default:
+        RecordEnd(pend);
+        break;
+    }
+    mState = EState::FieldStart;
+    mRecordStarted = false;
+    mpRecordStart = nullptr;
+}
+
+//------------------------------------------------------------------------------
+//! Private function completes the current value.
+//
+void CTextPushParser::FieldEnd() {
+    mFieldEnds.push_back(mBuffer.size());
+    KeepUpdate();
+}
+
+//------------------------------------------------------------------------------
+//! Private function completes the current record, whose end is at pterm
+//! within the current chunk, or unknown if pterm is nullptr, and passes it to
+//! the handler.  A record without any characters has no values.
+//
+void CTextPushParser::RecordEnd(const char *pterm) {
+    if (mRecordStarted)
+        FieldEnd();
+
+    mRecord.Fields.clear();
+    size_t Start = 0;
+    for (size_t End : mFieldEnds) {
+        CUtf8Field Field = { mBuffer.data() + Start, End - Start };
+        mRecord.Fields.push_back(Field);
+        Start = End;
+    }
+    mRecord.pRaw = nullptr;
+    mRecord.RawLen = 0;
+    if (mpRecordStart != nullptr && pterm != nullptr) {
+        mRecord.pRaw = mpRecordStart;
+        mRecord.RawLen = pterm - mpRecordStart;
+        if (mRecord.RawLen > 0 && pterm[-1] == '\r')
+            --mRecord.RawLen;
+    }
+
+    mHandler(mRecord);
+
+    ++mRecord.Number;
+    mFields += mRecord.Fields.size();
+    mBuffer.clear();
+    mFieldEnds.clear();
+    KeepUpdate();
+    mRecordStarted = false;
+    mState = EState::FieldStart;
+    mpRecordStart = (pterm != nullptr) ? pterm + 1 : nullptr;
+}
+
+//##############################################################################
+
+//------------------------------------------------------------------------------
+//! Function tests CTextPushParser by feeding it input containing multi-line
+//! values, CR LF terminators and empty records in chunks of every size from
+//! one byte to the whole input, and checks that malformed input is rejected.
+//
+uint32_t TextPushParserTest(std::vector<std::string> &report) {
+    static const char Input[] =
+        "Name,Text\r\n"
+        "A,\"Line 1\nLine 2\"\n"
+        "\n"
+        "B,\"Say \"\"Hi\"\",\r\nBye\"\r\n"
+        "C,,\"\"\n"
+        "D,x\"y";
+    static const char *Expected[] = {
+        "[Name][Text]",
+        "[A][Line 1\nLine 2]",
+        "",
+        "[B][Say \"Hi\",\r\nBye]",
+        "[C][][]",
+        "[D][x\"y]",
+    };
+    static const char *KeptFirst[] = {
+        "[Name][]", "[A][]", "", "[B][]", "[C][][]", "[D][]",
+    };
+    static const char *BadInputs[] = {
+        "A,\"B", "A,\"B\"C\n", "\"A\"\rB",
+    };
+    static const size_t InputLen = sizeof(Input) - 1;
+    static const size_t NExpected = sizeof(Expected) / sizeof(*Expected);
+
+    uint32_t NErrors = 0;
+    report.push_back("");
+    report.push_back("TextPushParser Test:");
+
+    std::vector<std::string> Records;
+    CTextPushParser Parser([&Records](const CTextRecord &record) {
+        std::string Text;
+        for (const CUtf8Field &Field : record.Fields)
+            Text += "[" + Field.Str() + "]";
+        Records.push_back(Text);
+    });
+
+    for (size_t ChunkSize = 1; ChunkSize <= InputLen; ++ChunkSize) {
+        Records.clear();
+        Parser.Reset();
+        for (size_t Pos = 0; Pos < InputLen; Pos += ChunkSize)
+            Parser.Feed(Input + Pos, std::min(ChunkSize, InputLen - Pos));
+        Parser.Finish();
+        if (Records != std::vector<std::string>(Expected,
+            Expected + NExpected)) {
+            report.push_back("  Incorrect records for chunk size " +
+                std::to_string(ChunkSize) + ".");
+            ++NErrors;
+        }
+        if (Parser.Records() != NExpected || Parser.Fields() != 11 ||
+            Parser.QuotedFields() != 3) {
+            report.push_back("  Incorrect counts for chunk size " +
+                std::to_string(ChunkSize) + ".");
+            ++NErrors;
+        }
+    }
+
+    // Keep only the first value of each record
+    Records.clear();
+    Parser.Reset();
+    Parser.FieldsKeep(std::vector<bool>(1, true));
+    Parser.Feed(Input, InputLen, true);
+    Parser.FieldsKeep(std::vector<bool>());
+    if (Records != std::vector<std::string>(KeptFirst,
+        KeptFirst + NExpected)) {
+        report.push_back("  Incorrect records keeping the first values.");
+        ++NErrors;
+    }
+
+    for (const char *pInput : BadInputs) {
+        Parser.Reset();
+        try {
+            Parser.Feed(pInput, std::char_traits<char>::length(pInput), true);
+            report.push_back("  No error for \"" + std::string(pInput) +
+                "\".");
+            ++NErrors;
+        }
+        catch (std::runtime_error &) {
+        }
+    }
+
+    return NErrors;
+}
@@ -0,0 +1,115 @@
+//#pragma once
+
+#ifndef TEXT_PUSH_PARSER_HPP
+#define TEXT_PUSH_PARSER_HPP
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "TextScanner.hpp"
+#include "TextTable.hpp"
+
+//##############################################################################
+// CTextRecord
+//##############################################################################
+//! A single record completed by CTextPushParser.  The fields refer to memory
+//! owned by the parser and are valid only during the record handler call.
+//##############################################################################
+
+struct CTextRecord {
+    std::vector<CUtf8Field> Fields;
+    const char *pRaw;   // Raw record without terminator, or nullptr if the
+    size_t      RawLen; // record did not arrive within a single chunk
+    size_t      Number; // Zero based record number
+};
+
+//##############################################################################
+// CTextPushParser
+//##############################################################################
+//! Parses UTF-8 text fed to it in chunks of any size, such as blocks read from
+//! a pipe or windows of a memory mapped file, and passes each record to a
+//! handler as soon as it is complete.  The quoting rules are those of
+//! CTextTable, except that quoted values may also contain line breaks.
+//! Records end with LF or CR LF.  Only the current record is buffered, so
+//! memory use does not depend on the size of the input.  Values that the
+//! handler does not need may be skipped by FieldsKeep(): they are still
+//! scanned to find where they end, but are passed as empty values without
+//! being copied.  The records and values parsed, and the values that were
+//! quoted, are counted from construction or the last Reset().  Records are
+//! numbered from zero, or from the number set by Records() for input that
+//! continues text parsed elsewhere.
+//##############################################################################
+
+class CTextPushParser {
+public:
+    typedef std::function<void(const CTextRecord &record)> TRecordHandler;
+
+    CTextPushParser(const TRecordHandler &handler,
+        wchar_t delimiter = L',', wchar_t quote = L'"');
+    CTextPushParser(const CTextPushParser &other) = delete;
+    CTextPushParser &operator=(const CTextPushParser &other) = delete;
+
+    void   Feed(const char *pdata, size_t size, bool isLast = false);
+    void   Finish();
+    void   Reset();
+    void   FieldsKeep(const std::vector<bool> &keep);
+    bool   AtRecordStart() const;
+    size_t Records() const { return mRecord.Number; }
+    void   Records(size_t records) { mRecord.Number = records; }
+    size_t Fields() const { return mFields; }
+    size_t QuotedFields() const { return mQuotedFields; }
+
+private:
+    enum class EState {
+        FieldStart, // Before the first character of a value
+        FieldCR,    // After a CR at the start of a value
+        Plain,      // Within an unquoted value
+        Quoted,     // Within a quoted value
+        QuoteSeen,  // After a quote within a quoted value
+        QuoteCR     // After a CR following a closing quote
+    };
+
+    TRecordHandler      mHandler;
+    char                mDelimiter;
+    char                mQuote;
+    CTextScanner        mScanner;
+    EState              mState;
+    bool                mRecordStarted;
+    bool                mIsKeeping;     // Whether the current value is kept
+    std::vector<bool>   mKeep;          // By position, or empty to keep all
+    const char         *mpRecordStart;
+    std::string         mBuffer;
+    std::vector<size_t> mFieldEnds;
+    CTextRecord         mRecord;
+    size_t              mFields;        // In the records completed
+    size_t              mQuotedFields;  // Quoted values begun
+
+    const char *Run(const char *p, const char *pend, bool quoted) const;
+    void InputEnd(const char *pend);
+    void FieldEnd();
+    void KeepUpdate();
+    void RecordEnd(const char *pterm);
+};
+
+//------------------------------------------------------------------------------
+//! Function returns true if the parser is between records, that is, the input
+//! fed so far ends with a record terminator or is empty.
+//
+inline bool CTextPushParser::AtRecordStart() const {
+    return mState == EState::FieldStart && !mRecordStarted;
+}
+
+//------------------------------------------------------------------------------
+//! Private function sets whether the value starting next is kept.
+//
+inline void CTextPushParser::KeepUpdate() {
+    size_t Ix = mFieldEnds.size();
+    mIsKeeping = mKeep.empty() || (Ix < mKeep.size() && mKeep[Ix]);
+}
+
+//##############################################################################
+
+uint32_t TextPushParserTest(std::vector<std::string> &report);
+
+#endif // TEXT_PUSH_PARSER_HPP
@@ -0,0 +1,381 @@
+#include "stdafx.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include "TextScanner.hpp"
+
+#ifdef TEXT_SCANNER_X86
+#include <immintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+#define AVX2_TARGET __attribute__((target("avx2")))
+#else
+#define AVX2_TARGET
+#endif
+#endif
+
+//##############################################################################
+// Kernels
+//##############################################################################
+//! Each kernel classifies the first BlockLen characters at ptext.  When fewer
+//! than BlockLen characters remain, the SIMD kernels work on a zero padded
+//! copy and the padding is masked off the results.
+//##############################################################################
+
+namespace {
+
+const size_t BlockLen = CTextScanner::BlockLen;
+
+//------------------------------------------------------------------------------
+//! Function returns a mask with one bit set for each of the first len
+//! characters of a block.
+//
+inline uint64_t ValidMask(size_t len) {
+    return (len < BlockLen)
+        ? (static_cast<uint64_t>(1) << len) - 1 : ~static_cast<uint64_t>(0);
+}
+
+//------------------------------------------------------------------------------
+//! Scalar kernel examines one character at a time.  It is the reference for
+//! all other kernels.
+//
+template <typename TChar>
+void ScanScalar(const TChar *ptext, size_t len, TChar delimiter, TChar quote,
+    CTextMasks &masks) {
+    if (len > BlockLen)
+        len = BlockLen;
+    uint64_t Delimiters = 0;
+    uint64_t Quotes = 0;
+    uint64_t Newlines = 0;
+    for (size_t Ix = 0; Ix < len; ++Ix) {
+        uint64_t Bit = static_cast<uint64_t>(1) << Ix;
+        TChar Ch = ptext[Ix];
+        if (Ch == delimiter)
+            Delimiters |= Bit;
+        if (Ch == quote)
+            Quotes |= Bit;
+        if (Ch == static_cast<TChar>('\n'))
+            Newlines |= Bit;
+    }
+    masks.Delimiters = Delimiters;
+    masks.Quotes = Quotes;
+    masks.Newlines = Newlines;
+}
+
+#ifdef TEXT_SCANNER_X86
+
+//------------------------------------------------------------------------------
+//! SSE2 groups hold 16 characters of Size bytes each.  Match() compares them
+//! with a needle and returns one bit per character, narrowing wide compare
+//! results with saturating packs, which keep 0 and -1 intact.
+//
+template <size_t Size> struct CSse2Group;
+
+template <> struct CSse2Group<1> {
+    __m128i V0;
+    CSse2Group(const char *p) {
+        V0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    }
+    static __m128i Set(uint32_t ch) {
+        return _mm_set1_epi8(static_cast<char>(ch));
+    }
+    uint32_t Match(__m128i needle) const {
+        return static_cast<uint32_t>(
+            _mm_movemask_epi8(_mm_cmpeq_epi8(V0, needle)));
+    }
+};
+
+template <> struct CSse2Group<2> {
+    __m128i V0, V1;
+    CSse2Group(const char *p) {
+        V0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        V1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 16));
+    }
+    static __m128i Set(uint32_t ch) {
+        return _mm_set1_epi16(static_cast<short>(ch));
+    }
+    uint32_t Match(__m128i needle) const {
+        __m128i Eq = _mm_packs_epi16(_mm_cmpeq_epi16(V0, needle),
+            _mm_cmpeq_epi16(V1, needle));
+        return static_cast<uint32_t>(_mm_movemask_epi8(Eq));
+    }
+};
+
+template <> struct CSse2Group<4> {
+    __m128i V0, V1, V2, V3;
+    CSse2Group(const char *p) {
+        V0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        V1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 16));
+        V2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 32));
+        V3 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 48));
+    }
+    static __m128i Set(uint32_t ch) {
+        return _mm_set1_epi32(static_cast<int>(ch));
+    }
+    uint32_t Match(__m128i needle) const {
+        __m128i Lo = _mm_packs_epi32(_mm_cmpeq_epi32(V0, needle),
+            _mm_cmpeq_epi32(V1, needle));
+        __m128i Hi = _mm_packs_epi32(_mm_cmpeq_epi32(V2, needle),
+            _mm_cmpeq_epi32(V3, needle));
+        return static_cast<uint32_t>(
+            _mm_movemask_epi8(_mm_packs_epi16(Lo, Hi)));
+    }
+};
+
+//------------------------------------------------------------------------------
+//! SSE2 kernel classifies 16 characters per step.
+//
+template <typename TChar>
+void ScanSSE2(const TChar *ptext, size_t len, TChar delimiter, TChar quote,
+    CTextMasks &masks) {
+    typedef CSse2Group<sizeof(TChar)> CGroup;
+    TChar Pad[BlockLen];
+    if (len < BlockLen) {
+        std::memset(Pad, 0, sizeof(Pad));
+        std::memcpy(Pad, ptext, len * sizeof(TChar));
+        ptext = Pad;
+    }
+
+    __m128i Delimiter = CGroup::Set(static_cast<uint32_t>(delimiter));
+    __m128i Quote = CGroup::Set(static_cast<uint32_t>(quote));
+    __m128i Newline = CGroup::Set('\n');
+    uint64_t Delimiters = 0;
+    uint64_t Quotes = 0;
+    uint64_t Newlines = 0;
+    for (size_t Ix = 0; Ix < BlockLen; Ix += 16) {
+        CGroup Group(reinterpret_cast<const char *>(ptext + Ix));
+        Delimiters |= static_cast<uint64_t>(Group.Match(Delimiter)) << Ix;
+        Quotes |= static_cast<uint64_t>(Group.Match(Quote)) << Ix;
+        Newlines |= static_cast<uint64_t>(Group.Match(Newline)) << Ix;
+    }
+
+    uint64_t Valid = ValidMask(len);
+    masks.Delimiters = Delimiters & Valid;
+    masks.Quotes = Quotes & Valid;
+    masks.Newlines = Newlines & Valid;
+}
+
+//------------------------------------------------------------------------------
+//! AVX2 groups hold 32 characters of Size bytes each.  The AVX2 packs work
+//! within each 128-bit lane, so every pack is followed by a permutation that
+//! restores the order of the characters.
+//
+template <size_t Size> struct CAvx2Group;
+
+template <> struct CAvx2Group<1> {
+    __m256i V0;
+    AVX2_TARGET CAvx2Group(const char *p) {
+        V0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    }
+    AVX2_TARGET static __m256i Set(uint32_t ch) {
+        return _mm256_set1_epi8(static_cast<char>(ch));
+    }
+    AVX2_TARGET uint32_t Match(__m256i needle) const {
+        return static_cast<uint32_t>(
+            _mm256_movemask_epi8(_mm256_cmpeq_epi8(V0, needle)));
+    }
+};
+
+template <> struct CAvx2Group<2> {
+    __m256i V0, V1;
+    AVX2_TARGET CAvx2Group(const char *p) {
+        V0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        V1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 32));
+    }
+    AVX2_TARGET static __m256i Set(uint32_t ch) {
+        return _mm256_set1_epi16(static_cast<short>(ch));
+    }
+    AVX2_TARGET uint32_t Match(__m256i needle) const {
+        __m256i Eq = _mm256_packs_epi16(_mm256_cmpeq_epi16(V0, needle),
+            _mm256_cmpeq_epi16(V1, needle));
+        Eq = _mm256_permute4x64_epi64(Eq, 0xd8);
+        return static_cast<uint32_t>(_mm256_movemask_epi8(Eq));
+    }
+};
+
+template <> struct CAvx2Group<4> {
+    __m256i V0, V1, V2, V3;
+    AVX2_TARGET CAvx2Group(const char *p) {
+        V0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        V1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 32));
+        V2 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 64));
+        V3 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 96));
+    }
+    AVX2_TARGET static __m256i Set(uint32_t ch) {
+        return _mm256_set1_epi32(static_cast<int>(ch));
+    }
+    AVX2_TARGET uint32_t Match(__m256i needle) const {
+        __m256i Lo = _mm256_packs_epi32(_mm256_cmpeq_epi32(V0, needle),
+            _mm256_cmpeq_epi32(V1, needle));
+        __m256i Hi = _mm256_packs_epi32(_mm256_cmpeq_epi32(V2, needle),
+            _mm256_cmpeq_epi32(V3, needle));
+        Lo = _mm256_permute4x64_epi64(Lo, 0xd8);
+        Hi = _mm256_permute4x64_epi64(Hi, 0xd8);
+        __m256i Eq = _mm256_permute4x64_epi64(_mm256_packs_epi16(Lo, Hi),
+            0xd8);
+        return static_cast<uint32_t>(_mm256_movemask_epi8(Eq));
+    }
+};
+
+//------------------------------------------------------------------------------
+//! AVX2 kernel classifies 32 characters per step.
+//
+template <typename TChar>
+AVX2_TARGET void ScanAVX2(const TChar *ptext, size_t len, TChar delimiter,
+    TChar quote, CTextMasks &masks) {
+    typedef CAvx2Group<sizeof(TChar)> CGroup;
+    TChar Pad[BlockLen];
+    if (len < BlockLen) {
+        std::memset(Pad, 0, sizeof(Pad));
+        std::memcpy(Pad, ptext, len * sizeof(TChar));
+        ptext = Pad;
+    }
+
+    __m256i Delimiter = CGroup::Set(static_cast<uint32_t>(delimiter));
+    __m256i Quote = CGroup::Set(static_cast<uint32_t>(quote));
+    __m256i Newline = CGroup::Set('\n');
+    uint64_t Delimiters = 0;
+    uint64_t Quotes = 0;
+    uint64_t Newlines = 0;
+    for (size_t Ix = 0; Ix < BlockLen; Ix += 32) {
+        CGroup Group(reinterpret_cast<const char *>(ptext + Ix));
+        Delimiters |= static_cast<uint64_t>(Group.Match(Delimiter)) << Ix;
+        Quotes |= static_cast<uint64_t>(Group.Match(Quote)) << Ix;
+        Newlines |= static_cast<uint64_t>(Group.Match(Newline)) << Ix;
+    }
+
+    uint64_t Valid = ValidMask(len);
+    masks.Delimiters = Delimiters & Valid;
+    masks.Quotes = Quotes & Valid;
+    masks.Newlines = Newlines & Valid;
+}
+
+//------------------------------------------------------------------------------
+//! Functions report whether the CPU and operating system support SSE2 and
+//! AVX2.
+//
+bool CpuHasSSE2() {
+#ifdef _MSC_VER
+    int Info[4];
+    __cpuid(Info, 1);
+    return (Info[3] & (1 << 26)) != 0;
+#else
+    return __builtin_cpu_supports("sse2") != 0;
+#endif
+}
+
+bool CpuHasAVX2() {
+#ifdef _MSC_VER
+    int Info[4];
+    __cpuid(Info, 0);
+    if (Info[0] < 7)
+        return false;
+    __cpuid(Info, 1);
+    bool HasOSXSave = (Info[2] & (1 << 27)) != 0;
+    bool HasAVX = (Info[2] & (1 << 28)) != 0;
+    if (!HasOSXSave || !HasAVX || (_xgetbv(0) & 0x6) != 0x6)
+        return false;
+    __cpuidex(Info, 7, 0);
+    return (Info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+
+#endif // TEXT_SCANNER_X86
+
+} // namespace
+
+//##############################################################################
+// CTextScanner
+//##############################################################################
+//! Classifies blocks of CTextScanner::BlockLen characters at a time.
+//##############################################################################
+
+const size_t CTextScanner::BlockLen;
+
+//------------------------------------------------------------------------------
+//! Constructor sets the delimiter and quote characters and selects the kernel,
+//! which defaults to the best one the CPU supports.
+//
+CTextScanner::CTextScanner(wchar_t delimiter, wchar_t quote, EKernel kernel) :
+    mDelimiter(delimiter), mQuote(quote) {
+    Kernel(kernel);
+}
+
+//------------------------------------------------------------------------------
+//! Function selects the kernel used for scanning.  EKernel::Auto selects the
+//! best kernel the CPU supports.  Selecting an unsupported kernel throws an
+//! exception.
+//
+void CTextScanner::Kernel(EKernel kernel) {
+    if (kernel == EKernel::Auto)
+        kernel = Best();
+    if (!Supported(kernel)) {
+        std::string Message("CTextScanner::Kernel(): ");
+        Message += KernelName(kernel);
+        Message += " is not supported.";
+        throw std::runtime_error(Message);
+    }
+
+    mKernel = kernel;
+    switch (kernel) {
+#ifdef TEXT_SCANNER_X86
+    case EKernel::AVX2:
+        mpWideScan = ScanAVX2<wchar_t>;
+        mpByteScan = ScanAVX2<char>;
+        break;
+    case EKernel::SSE2:
+        mpWideScan = ScanSSE2<wchar_t>;
+        mpByteScan = ScanSSE2<char>;
+        break;
+#endif
+    default:
+        mpWideScan = ScanScalar<wchar_t>;
+        mpByteScan = ScanScalar<char>;
+        break;
+    }
+}
+
+//------------------------------------------------------------------------------
+//! Function returns the best kernel the CPU supports.  The answer is
+//! determined on first use and cached.
+//
+CTextScanner::EKernel CTextScanner::Best() {
+    static const EKernel sBest = Supported(EKernel::AVX2) ? EKernel::AVX2
+        : Supported(EKernel::SSE2) ? EKernel::SSE2 : EKernel::Scalar;
+    return sBest;
+}
+
+//------------------------------------------------------------------------------
+//! Function returns true if the specified kernel can run on this CPU.
+//
+bool CTextScanner::Supported(EKernel kernel) {
+    switch (kernel) {
+    case EKernel::Auto:
+    case EKernel::Scalar:
+        return true;
+#ifdef TEXT_SCANNER_X86
+    case EKernel::SSE2:
+        return CpuHasSSE2();
+    case EKernel::AVX2:
+        return CpuHasAVX2();
+#endif
+    default:
+        return false;
+    }
+}
+
+//------------------------------------------------------------------------------
+//! Function returns the name of the specified kernel.
+//
+const char *CTextScanner::KernelName(EKernel kernel) {
+    switch (kernel) {
+    case EKernel::Auto:   return "Auto";
+    case EKernel::Scalar: return "Scalar";
+    case EKernel::SSE2:   return "SSE2";
+    case EKernel::AVX2:   return "AVX2";
+    }
+    return "?";
+}
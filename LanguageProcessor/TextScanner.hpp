@@ -0,0 +1,157 @@
+//#pragma once
+
+#ifndef TEXT_SCANNER_HPP
+#define TEXT_SCANNER_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || \
+    defined(__x86_64__)
+#define TEXT_SCANNER_X86
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+//##############################################################################
+// CTextMasks
+//##############################################################################
+//! Bit masks of the structural characters within a block of text.  Bit N of
+//! each mask corresponds to character N of the block.
+//##############################################################################
+
+struct CTextMasks {
+    uint64_t Delimiters;
+    uint64_t Quotes;
+    uint64_t Newlines;
+};
+
+//##############################################################################
+// CTextScanner
+//##############################################################################
+//! Classifies blocks of CTextScanner::BlockLen characters at a time, producing
+//! a mask of delimiter, quote and newline positions for each block.  The work
+//! is done by one of several kernels, chosen at run time according to the
+//! capabilities of the CPU.  All kernels produce identical masks.
+//!
+//! The quoted regions of a block follow from its quote mask by a prefix XOR,
+//! so that delimiters within quotes can be discarded without examining the
+//! characters one at a time.  Byte scans are intended for UTF-8 text and only
+//! find delimiter and quote characters below U+0080.
+//##############################################################################
+
+class CTextScanner {
+public:
+    enum class EKernel { Auto, Scalar, SSE2, AVX2 };
+    static const size_t BlockLen = 64;
+
+    CTextScanner(wchar_t delimiter = L',', wchar_t quote = L'"',
+        EKernel kernel = EKernel::Auto);
+
+    EKernel Kernel() const { return mKernel; }
+    void    Kernel(EKernel kernel);
+    wchar_t Delimiter() const { return mDelimiter; }
+    wchar_t Quote() const { return mQuote; }
+
+    void Scan(const wchar_t *ptext, size_t len, CTextMasks &masks) const;
+    void Scan(const char *ptext, size_t len, CTextMasks &masks) const;
+
+    static EKernel     Best();
+    static bool        Supported(EKernel kernel);
+    static const char *KernelName(EKernel kernel);
+    static uint64_t    QuotedMask(uint64_t quotes, uint64_t &inQuote);
+    static unsigned    FirstBit(uint64_t mask);
+    static unsigned    BitCount(uint64_t mask);
+
+private:
+    typedef void (*TWideScan)(const wchar_t *, size_t, wchar_t, wchar_t,
+        CTextMasks &);
+    typedef void (*TByteScan)(const char *, size_t, char, char,
+        CTextMasks &);
+
+    wchar_t   mDelimiter;
+    wchar_t   mQuote;
+    EKernel   mKernel;
+    TWideScan mpWideScan;
+    TByteScan mpByteScan;
+};
+
+//------------------------------------------------------------------------------
+//! Function classifies up to BlockLen characters of wide text.  Characters
+//! beyond len are treated as absent.
+//
+inline void CTextScanner::Scan(const wchar_t *ptext, size_t len,
+    CTextMasks &masks) const {
+    mpWideScan(ptext, len, mDelimiter, mQuote, masks);
+}
+
+//------------------------------------------------------------------------------
+//! Function classifies up to BlockLen bytes of UTF-8 text.  Bytes beyond len
+//! are treated as absent.
+//
+inline void CTextScanner::Scan(const char *ptext, size_t len,
+    CTextMasks &masks) const {
+    mpByteScan(ptext, len, static_cast<char>(mDelimiter),
+        static_cast<char>(mQuote), masks);
+}
+
+//------------------------------------------------------------------------------
+//! Function converts a quote mask to a mask of the characters within quotes,
+//! counting each opening quote as within and each closing quote as without.
+//! inQuote carries the state from block to block; it is all ones if the block
+//! starts within quotes and all zeros otherwise, and is updated for the next
+//! block.  Doubled quotes toggle the state twice and so leave it unchanged.
+//
+inline uint64_t CTextScanner::QuotedMask(uint64_t quotes, uint64_t &inQuote) {
+    uint64_t Mask = quotes;
+    Mask ^= Mask << 1;
+    Mask ^= Mask << 2;
+    Mask ^= Mask << 4;
+    Mask ^= Mask << 8;
+    Mask ^= Mask << 16;
+    Mask ^= Mask << 32;
+    Mask ^= inQuote;
+    inQuote = (Mask >> 63) ? ~static_cast<uint64_t>(0) : 0;
+    return Mask;
+}
+
+//------------------------------------------------------------------------------
+//! Function returns the index of the lowest set bit of mask, which must not be
+//! zero.
+//
+inline unsigned CTextScanner::FirstBit(uint64_t mask) {
+#if defined(_MSC_VER) && defined(_M_X64)
+    unsigned long Ix;
+    _BitScanForward64(&Ix, mask);
+    return Ix;
+#elif defined(_MSC_VER)
+    unsigned long Ix;
+    if (_BitScanForward(&Ix, static_cast<uint32_t>(mask)))
+        return Ix;
+    _BitScanForward(&Ix, static_cast<uint32_t>(mask >> 32));
+    return Ix + 32;
+#else
+    return static_cast<unsigned>(__builtin_ctzll(mask));
+#endif
+}
+
+//------------------------------------------------------------------------------
+//! Function returns the number of set bits in mask.
+//
+inline unsigned CTextScanner::BitCount(uint64_t mask) {
+#ifdef _MSC_VER
+    mask -= (mask >> 1) & 0x5555555555555555ull;
+    mask = (mask & 0x3333333333333333ull) +
+        ((mask >> 2) & 0x3333333333333333ull);
+    mask = (mask + (mask >> 4)) & 0x0f0f0f0f0f0f0f0full;
+    return static_cast<unsigned>((mask * 0x0101010101010101ull) >> 56);
+#else
+    return static_cast<unsigned>(__builtin_popcountll(mask));
+#endif
+}
+
+//##############################################################################
+
+#endif // TEXT_SCANNER_HPP
@@ -1,9 +1,11 @@
 #include "stdafx.h"
 
+#include <algorithm>
 #include <iostream> //TODO: Remove
 #include <stdexcept>
 
 #include "Utils.hpp"
+#include "AllocationTracker.hpp"
 #include "TextTable.hpp"
 
 //##############################################################################i
@@ -17,10 +19,8 @@
 //  Constructor sets the delimiter and quote characters.
 //
 CTextTable::CTextTable(wchar_t delimiter, wchar_t quote) :
-    mDelimiter(delimiter), mQuote(quote), mQuoteDelimiter(2, quote) {
-    mQuoteDelimiter[1] = mDelimiter;
-    //std::cout << "QuoteDelimiter = \"" << WStrToUtf8(mQuoteDelimiter)
-    //          << "\"" << std::endl;
+    mDelimiter(delimiter), mQuote(quote), mScanner(delimiter, quote),
+    mValues(0) {
 }
 
 //------------------------------------------------------------------------------
@@ -30,8 +30,7 @@ CTextTable::CTextTable(wchar_t delimiter, wchar_t quote) :
 //
 CTextTable::CTextTable(const CTextTable &other) :
     mDelimiter(other.mDelimiter), mQuote(other.mQuote),
-    mQuoteDelimiter(2, other.mQuote) {
-    mQuoteDelimiter[1] = other.mDelimiter;
+    mScanner(other.mScanner), mValues(other.mValues) {
     mLine = other.mLine;
 }
 
@@ -40,10 +39,10 @@ CTextTable::CTextTable(const CTextTable &other) :
 //
 // Move constructor makes an identical object by taking the content of other.
 //
-CTextTable::CTextTable(CTextTable &&other) {
+CTextTable::CTextTable(CTextTable &&other) : mScanner(other.mScanner),
+    mValues(other.mValues) {
     mDelimiter = other.mDelimiter;
     mQuote = other.mQuote;
-    mQuoteDelimiter = std::move(other.mQuoteDelimiter);
     mLine = std::move(other.mLine);
 }
 
@@ -55,7 +54,8 @@ CTextTable::CTextTable(CTextTable &&other) {
 CTextTable &CTextTable::operator=(const CTextTable &other) {
     mDelimiter = other.mDelimiter;
     mQuote = other.mQuote;
-    mQuoteDelimiter = other.mQuoteDelimiter;
+    mScanner = other.mScanner;
+    mValues = other.mValues;
     mLine = other.mLine;
     return *this;
 }
@@ -68,7 +68,8 @@ CTextTable &CTextTable::operator=(const CTextTable &other) {
 CTextTable &CTextTable::operator=(CTextTable &&other) {
     mDelimiter = other.mDelimiter;
     mQuote = other.mQuote;
-    mQuoteDelimiter = std::move(other.mQuoteDelimiter);
+    mScanner = other.mScanner;
+    mValues = other.mValues;
     mLine = std::move(other.mLine);
     return *this;
 }
@@ -77,34 +78,40 @@ CTextTable &CTextTable::operator=(CTextTable &&other) {
 // void CTextTablel::Add(const std::wstring &value)
 //
 // Function adds the specified value to the output line, enclosing it in mQuotes
-// as needed.
+// as needed.  The value is copied in a single pass, doubling any quotes on the
+// way, after the output line is sized for it.
 //
 void CTextTable::Add(const std::wstring &value) {
+    CAllocationScope Scope(ESubsystem::TextTable);
     // Lead with delimiter if not first item 
-    if (!mLine.empty())
+    if (mValues++ > 0)
         mLine.append(1, mDelimiter);
 
-    // Double up quotes if any
-    std::wstring Value(value);
-    size_t OriginalLen = Value.size();
-    if (OriginalLen > 0) {
-        size_t Pos = OriginalLen - 1;
-        Pos = Value.find_last_of(mQuote, Pos);
-        while (Pos != std::wstring::npos) {
-            Value.insert(Pos, 1, mQuote);
-            Pos = (Pos > 0)
-                ? Value.find_last_of(mQuote, Pos - 1) : std::wstring::npos;
-        }
+    // Append value as is unless it needs quoting.  An empty first value is
+    // quoted, or a line of one empty value would be an empty line.
+    const wchar_t *p = value.data();
+    const wchar_t *pend = p + value.size();
+    const wchar_t *pspecial = std::find_if(p, pend, [this](wchar_t ch) {
+        return ch == mQuote || ch == mDelimiter || ch == L'\n' || ch == L'\r';
+    });
+    if (pspecial == pend && (p < pend || mValues > 1)) {
+        mLine.append(p, pend);
+        return;
     }
 
-    // Append value, quoting if necessary    
-    bool NeedQuote = (Value.size() > OriginalLen) || // Has quote(s)
-        (Value.find(mDelimiter) != std::wstring::npos); // Has delimiter(s)
-    if (NeedQuote)
-        mLine.append(1, mQuote);
-    mLine.append(Value);
-    if (NeedQuote)
-        mLine.append(1, mQuote);
+    // Append quoted value, doubling up quotes if any
+    size_t NQuotes = std::count(pspecial, pend, mQuote);
+    mLine.reserve(mLine.size() + value.size() + NQuotes + 2);
+    mLine.append(1, mQuote);
+    while (p < pend) {
+        const wchar_t *pquote = std::find(p, pend, mQuote);
+        mLine.append(p, pquote);
+        if (pquote == pend)
+            break;
+        mLine.append(2, mQuote);
+        p = pquote + 1;
+    }
+    mLine.append(1, mQuote);
 }
 
 //------------------------------------------------------------------------------
@@ -114,7 +121,7 @@ void CTextTable::Add(const std::wstring &value) {
 // mQuotes as needed.
 //
 void CTextTable::Add(const std::vector<std::wstring> &values) {
-    for (auto Value : values) {
+    for (const std::wstring &Value : values) {
         Add(Value);
     }
 }
@@ -129,46 +136,360 @@ void CTextTable::Add(const std::vector<std::wstring> &values) {
 //
 void CTextTable::Parse(const std::wstring &line,
     std::vector<std::wstring> &values) const {
-    values.clear();
+    Parse(line.data(), line.size(), values);
+}
+
+//------------------------------------------------------------------------------
+// void CTextTable::Parse(const wchar_t *pline, size_t len,
+//                    std::vector<std::Wstring> &values) const
+//  
+//  Function parses the specified span of text, which need not be null
+//  terminated, according to the current delimiter and quote character and then
+//  returns the corresponding values as a vector of strings.  Strings already
+//  in values are reused, so their capacity carries over from call to call.
+//
+void CTextTable::Parse(const wchar_t *pline, size_t len,
+    std::vector<std::wstring> &values) const {
+    CAllocationScope Scope(ESubsystem::TextTable);
+    std::vector<CTextField> Fields;
+    std::wstring Scratch;
+    Parse(pline, len, Fields, Scratch);
+    size_t Count = Fields.size();
+    values.resize(Count);
+    for (size_t Ix = 0; Ix < Count; ++Ix)
+        values[Ix].assign(Fields[Ix].pText, Fields[Ix].Len);
+}
+
+//------------------------------------------------------------------------------
+// void CTextTable::Parse(const wchar_t *pline, size_t len,
+//                    std::vector<CTextField> &fields,
+//                    std::wstring &scratch) const
+//  
+//  Function parses the specified span of text without copying it.  Each field
+//  refers to its value within the line unless the value contains doubled
+//  quotes, in which case the value is unescaped into scratch and the field
+//  refers to it there.  The fields remain valid until the line or scratch is
+//  modified.  A value is quoted only if its first character is a quote; the
+//  closing quote must be followed by a delimiter or the end of the line.
+//
+//  The line is classified a block at a time by the SIMD scanner.  Delimiters
+//  within quotes are discarded using the quoted mask of each block, and then
+//  the remaining delimiters split the line into fields.  A quote that does not
+//  open or close a value by the rules above would make the quoted mask
+//  meaningless, so such lines are handed to ParseScalar(), which accepts or
+//  rejects them exactly as it would any other line.
+//
+void CTextTable::Parse(const wchar_t *pline, size_t len,
+    std::vector<CTextField> &fields, std::wstring &scratch) const {
+    CAllocationScope Scope(ESubsystem::TextTable);
+    if (mScanner.Kernel() == CTextScanner::EKernel::Scalar) {
+        ParseScalar(pline, len, fields, scratch);
+        return;
+    }
+
+    fields.clear();
+    scratch.clear();
+    if (len == 0)
+        return;
+
+    uint64_t InQuote = 0;
+    uint64_t CanOpen = 1;   // Bit 0 set if a value may start at the block
+    uint64_t AfterClose = 0; // Bit 0 set if the block follows a closing quote
+    size_t FieldPos = 0;
+    for (size_t Pos = 0; Pos < len; Pos += CTextScanner::BlockLen) {
+        size_t BlockLen = len - Pos;
+        if (BlockLen > CTextScanner::BlockLen)
+            BlockLen = CTextScanner::BlockLen;
+        CTextMasks Masks;
+        mScanner.Scan(pline + Pos, BlockLen, Masks);
 
-    //QuoteDelimiter.append(1, mDelimiter);
-    //std::cout << "Parsing \"" << WStrToUtf8(line) << "\"" << std::endl;
+        uint64_t Quoted = CTextScanner::QuotedMask(Masks.Quotes, InQuote);
+        uint64_t Delimiters = Masks.Delimiters & ~Quoted;
+        uint64_t Opens = Masks.Quotes & Quoted;
+        uint64_t Closes = Masks.Quotes & ~Quoted;
 
-    size_t Pos = 0;
-    size_t Len = line.size();
-    bool Done = (Len == 0);
+        // Opening quotes must start a value or follow a closing quote (which
+        // makes a doubled quote) and closing quotes must be followed by a
+        // delimiter, an opening quote or the end of the line.
+        CanOpen |= (Delimiters | Closes) << 1;
+        AfterClose |= Closes << 1;
+        if (BlockLen < CTextScanner::BlockLen)
+            AfterClose &= (static_cast<uint64_t>(1) << BlockLen) - 1;
+        if ((Opens & ~CanOpen) != 0 ||
+            (AfterClose & ~(Delimiters | Opens)) != 0) {
+            ParseScalar(pline, len, fields, scratch);
+            return;
+        }
+        CanOpen = (Delimiters | Closes) >> 63;
+        AfterClose = Closes >> 63;
+
+        while (Delimiters != 0) {
+            size_t DelimiterPos = Pos + CTextScanner::FirstBit(Delimiters);
+            FieldAdd(pline + FieldPos, pline + DelimiterPos, len, fields,
+                scratch);
+            FieldPos = DelimiterPos + 1;
+            Delimiters &= Delimiters - 1;
+        }
+    }
+    if (InQuote != 0) { // If the last value is not closed
+        ParseScalar(pline, len, fields, scratch);
+        return;
+    }
+    FieldAdd(pline + FieldPos, pline + len, len, fields, scratch);
+}
+
+//------------------------------------------------------------------------------
+// void CTextTable::ParseScalar(const wchar_t *pline, size_t len,
+//                    std::vector<CTextField> &fields,
+//                    std::wstring &scratch) const
+//  
+//  Private function parses the specified span of text in the same way as
+//  Parse(), but searches for delimiters and quotes one value at a time.
+//
+void CTextTable::ParseScalar(const wchar_t *pline, size_t len,
+    std::vector<CTextField> &fields, std::wstring &scratch) const {
+    typedef std::char_traits<wchar_t> Traits;
+    fields.clear();
+    scratch.clear();
+
+    const wchar_t *pend = pline + len;
+    const wchar_t *p = pline;
+    bool Done = (len == 0);
     while (!Done) {
-        size_t NextPos = Len;
-        if (line[Pos] == mQuote) {
-            NextPos = line.find(mQuoteDelimiter, Pos);
-            if (NextPos != std::wstring::npos) {
-                ++NextPos;
+        CTextField Field;
+        const wchar_t *pnext = nullptr;
+        if (p < pend && *p == mQuote) { // If quoted value
+            const wchar_t *pvalue = ++p;
+            size_t NQuotes = 0;
+            for (;;) {
+                p = Traits::find(p, pend - p, mQuote);
+                if (p == nullptr)
+                    throw std::runtime_error("CTextTable::Parse(): "
+                        "Mismatched quote");
+                if (p + 1 < pend && p[1] == mQuote) { // If doubled quote
+                    ++NQuotes;
+                    p += 2;
+                }
+                else
+                    break;
             }
-            else if (line[Len - 1] == mQuote) {
-                NextPos = Len;
-                Done = true;
+            pnext = p + 1;
+            if (pnext < pend && *pnext != mDelimiter)
+                throw std::runtime_error("CTextTable::Parse(): "
+                    "Mismatched quote");
+
+            if (NQuotes == 0) {
+                Field.pText = pvalue;
+                Field.Len = p - pvalue;
             }
             else
-                throw std::runtime_error("CTextTable::Line(): "
-                    "Mismatched quote");
-            //std::cout << "NextPos(1) = " << NextPos << std::endl;
+                Unescape(pvalue, p, len, scratch, Field);
+        }
+        else { // If plain value
+            pnext = Traits::find(p, pend - p, mDelimiter);
+            if (pnext == nullptr)
+                pnext = pend;
+            Field.pText = p;
+            Field.Len = pnext - p;
+        }
+        fields.push_back(Field);
+        Done = (pnext >= pend);
+        p = pnext + 1;
+    }
+}
+
+//------------------------------------------------------------------------------
+// void CTextTable::FieldAdd(const wchar_t *pvalue, const wchar_t *pend,
+//                    size_t len, std::vector<CTextField> &fields,
+//                    std::wstring &scratch) const
+//  
+//  Private function adds the value from pvalue to pend, which is known to be
+//  well formed, to fields, removing its quotes if it is quoted.  len is the
+//  length of the whole line.
+//
+void CTextTable::FieldAdd(const wchar_t *pvalue, const wchar_t *pend,
+    size_t len, std::vector<CTextField> &fields,
+    std::wstring &scratch) const {
+    CTextField Field;
+    Field.pText = pvalue;
+    Field.Len = pend - pvalue;
+    if (pvalue < pend && *pvalue == mQuote) {
+        ++pvalue;
+        --pend;
+        Field.pText = pvalue;
+        Field.Len = pend - pvalue;
+        if (std::char_traits<wchar_t>::find(pvalue, pend - pvalue, mQuote) !=
+            nullptr)
+            Unescape(pvalue, pend, len, scratch, Field);
+    }
+    fields.push_back(Field);
+}
+
+//------------------------------------------------------------------------------
+// void CTextTable::Unescape(const wchar_t *pvalue, const wchar_t *pend,
+//                    size_t len, std::wstring &scratch,
+//                    CTextField &field) const
+//  
+//  Private function copies the quoted value from pvalue to pend, whose quotes
+//  are all doubled, to scratch while undoing the doubled quotes, and then sets
+//  field to refer to the copy.  scratch is reserved for the length of the
+//  whole line, len, so that it never reallocates and invalidates the fields
+//  that already refer to it.
+//
+void CTextTable::Unescape(const wchar_t *pvalue, const wchar_t *pend,
+    size_t len, std::wstring &scratch, CTextField &field) const {
+    if (scratch.capacity() < len)
+        scratch.reserve(len);
+    size_t Start = scratch.size();
+    while (pvalue < pend) {
+        const wchar_t *pquote = std::char_traits<wchar_t>::find(pvalue,
+            pend - pvalue, mQuote);
+        if (pquote == nullptr)
+            pquote = pend - 1;
+        scratch.append(pvalue, pquote + 1);
+        pvalue = pquote + 2;
+    }
+    field.pText = scratch.data() + Start;
+    field.Len = scratch.size() - Start;
+}
+
+//##############################################################################
+
+//------------------------------------------------------------------------------
+// uint32_t TextTableTest(std::vector<std::string> &report)
+//
+// Function tests CTextTable::Parse() with every scan kernel the CPU supports
+// against a table of lines and their expected values, against lines that must
+// be rejected, and against the scalar parser for a set of generated lines full
+// of delimiters and quotes.
+//
+uint32_t TextTableTest(std::vector<std::string> &report) {
+    typedef CTextScanner::EKernel EKernel;
+    struct CParseTable {
+        const wchar_t *Line;
+        const wchar_t *Values[5]; // nullptr terminated
+    };
+    static const CParseTable ParseTable[] = {
+        { L"",                   { nullptr } },
+        { L"a",                  { L"a", nullptr } },
+        { L"a,b,c",              { L"a", L"b", L"c", nullptr } },
+        { L",,",                 { L"", L"", L"", nullptr } },
+        { L"a,",                 { L"a", L"", nullptr } },
+        { L"\"\"",               { L"", nullptr } },
+        { L"\"a,b\",c",          { L"a,b", L"c", nullptr } },
+        { L"a,\"b,c\"",          { L"a", L"b,c", nullptr } },
+        { L"\"a\"\"b\",\"\"\"\"", { L"a\"b", L"\"", nullptr } },
+        { L"\"\"\"a,\"\"\",b",   { L"\"a,\"", L"b", nullptr } },
+        { L"a\"b,c",             { L"a\"b", L"c", nullptr } },
+    };
+    static const wchar_t *BadLines[] = {
+        L"\"a", L"a,\"b", L"\"a\"b,c", L"\"a\"\"",
+    };
+    static const EKernel Kernels[] = {
+        EKernel::Scalar, EKernel::SSE2, EKernel::AVX2
+    };
+    static const wchar_t Alphabet[] = L"ab,,\"\"\"\xe9\x4e2d\n";
+    static const size_t NGenerated = 2000;
+
+    uint32_t NErrors = 0;
+    report.push_back("");
+    report.push_back("TextTable Test:");
+
+    // Parse a line, rendering its values, or the failure, as a single string
+    auto Render = [](const CTextTable &textTable, const std::wstring &line) {
+        std::wstring Result;
+        try {
+            std::vector<std::wstring> Values;
+            textTable.Parse(line, Values);
+            for (const std::wstring &Value : Values)
+                Result += L"[" + Value + L"]";
+        }
+        catch (std::runtime_error &) {
+            Result = L"Error";
+        }
+        return Result;
+    };
+
+    // Generate lines of random lengths from an alphabet rich in delimiters and
+    // quotes, half of them made of well formed values
+    std::vector<std::wstring> Generated;
+    uint32_t Seed = 12345;
+    auto Random = [&Seed](uint32_t range) {
+        Seed = Seed * 1103515245 + 12345;
+        return (Seed >> 8) % range;
+    };
+    CTextTable Writer;
+    for (size_t Ix = 0; Ix < NGenerated; ++Ix) {
+        size_t Len = Random(200);
+        std::wstring Text;
+        for (size_t Iy = 0; Iy < Len; ++Iy)
+            Text += Alphabet[Random(sizeof(Alphabet) / sizeof(*Alphabet) - 1)];
+        if (Ix % 2 == 0) {
+            Writer.Clear();
+            for (size_t Pos = 0; Pos < Text.size(); Pos += 1 + Random(20))
+                Writer.Add(Text.substr(Pos, 1 + Random(20)));
+            Text = Writer.Line();
+        }
+        Generated.push_back(Text);
+    }
+
+    // Check that lines made by Add() parse back to the values added
+    for (size_t Ix = 0; Ix < NGenerated; ++Ix) {
+        std::vector<std::wstring> Values(1 + Random(5));
+        for (std::wstring &Value : Values)
+            for (size_t Len = Random(8); Len > 0; --Len)
+                Value += Alphabet[Random(sizeof(Alphabet) /
+                    sizeof(*Alphabet) - 1)];
+        Writer.Clear();
+        Writer.Add(Values);
+        std::vector<std::wstring> Parsed;
+        Writer.Parse(Writer.Line(), Parsed);
+        if (Parsed != Values) {
+            report.push_back("  Values differ after Add() for \"" +
+                WStrToUtf8(Writer.Line()) + "\".");
+            ++NErrors;
+        }
+    }
+
+    CTextTable Reference;
+    Reference.ScanKernel(EKernel::Scalar);
+    for (EKernel Kernel : Kernels) {
+        if (!CTextScanner::Supported(Kernel))
+            continue;
+        CTextTable TextTable;
+        TextTable.ScanKernel(Kernel);
+        std::string KernelName(CTextScanner::KernelName(Kernel));
+
+        for (const CParseTable &Entry : ParseTable) {
+            std::vector<std::wstring> Expected;
+            for (size_t Ix = 0; Entry.Values[Ix] != nullptr; ++Ix)
+                Expected.push_back(Entry.Values[Ix]);
+
+            std::vector<std::wstring> Values;
+            TextTable.Parse(Entry.Line, Values);
+            if (Values != Expected) {
+                report.push_back("  " + KernelName + ": Incorrect values for "
+                    "\"" + WStrToUtf8(Entry.Line) + "\".");
+                ++NErrors;
+            }
         }
-        else {
-            NextPos = line.find(mDelimiter, Pos);
-            if (NextPos == std::wstring::npos) {
-                NextPos = Len;
-                Done = true;
+
+        for (const wchar_t *pLine : BadLines) {
+            if (Render(TextTable, pLine) != L"Error") {
+                report.push_back("  " + KernelName + ": No error for \"" +
+                    WStrToUtf8(pLine) + "\".");
+                ++NErrors;
             }
-            //std::cout << "NextPos(2) = " << NextPos << std::endl;
         }
-        std::wstring Value(line.substr(Pos, NextPos - Pos));
-        size_t ValueLen = Value.size();
-        if (ValueLen >= 2 && Value[0] == mQuote &&
-            Value[ValueLen - 1] == mQuote) {
-            Value.erase(ValueLen - 1, 1);
-            Value.erase(0, 1);
+
+        for (const std::wstring &Line : Generated) {
+            if (Render(TextTable, Line) != Render(Reference, Line)) {
+                report.push_back("  " + KernelName + ": Differs from scalar "
+                    "for \"" + WStrToUtf8(Line) + "\".");
+                ++NErrors;
+            }
         }
-        values.push_back(Value);
-        Pos = NextPos + 1;
     }
+
+    return NErrors;
 }
@@ -6,6 +6,37 @@
 #include <string>
 #include <vector>
 
+#include "TextScanner.hpp"
+
+//##############################################################################
+// CBasicField
+//##############################################################################
+//! Refers to a single value without owning it: CTextField to wide text, such
+//! as a value parsed by CTextTable::Parse(), and CUtf8Field to UTF-8 bytes,
+//! such as a value parsed by CTextPushParser.
+//##############################################################################
+
+template <typename TChar>
+struct CBasicField {
+    const TChar *pText;
+    size_t       Len;
+
+    std::basic_string<TChar> Str() const {
+        return std::basic_string<TChar>(pText, Len);
+    }
+    bool Equals(const TChar *ptext) const {
+        return std::char_traits<TChar>::length(ptext) == Len &&
+            std::char_traits<TChar>::compare(pText, ptext, Len) == 0;
+    }
+    bool Equals(const CBasicField &other) const {
+        return other.Len == Len &&
+            std::char_traits<TChar>::compare(pText, other.pText, Len) == 0;
+    }
+};
+
+typedef CBasicField<wchar_t> CTextField;
+typedef CBasicField<char>    CUtf8Field;
+
 //##############################################################################
 // CTextTable
 //##############################################################################
@@ -14,7 +45,8 @@
 class CTextTable {
     wchar_t mDelimiter;
     wchar_t mQuote;
-    std::wstring mQuoteDelimiter;
+    CTextScanner mScanner;
+    size_t mValues;
     std::wstring mLine;
 public:
     CTextTable(wchar_t delimiter = L',', wchar_t quote = L'"');
@@ -23,16 +55,35 @@ public:
     CTextTable &operator=(const CTextTable &other);
     CTextTable &operator=(CTextTable &&other);
 
+    wchar_t Delimiter() const { return mDelimiter; }
+    wchar_t Quote() const { return mQuote; }
+
     void Clear();
     void Add(const std::wstring &value);
     void Add(const std::vector<std::wstring> &values);
     std::wstring Line() const;
     void Parse(const std::wstring &line,
         std::vector<std::wstring> &values) const;
+    void Parse(const wchar_t *pline, size_t len,
+        std::vector<std::wstring> &values) const;
+    void Parse(const wchar_t *pline, size_t len,
+        std::vector<CTextField> &fields, std::wstring &scratch) const;
+
+    CTextScanner::EKernel ScanKernel() const { return mScanner.Kernel(); }
+    void ScanKernel(CTextScanner::EKernel kernel) { mScanner.Kernel(kernel); }
+
+private:
+    void ParseScalar(const wchar_t *pline, size_t len,
+        std::vector<CTextField> &fields, std::wstring &scratch) const;
+    void FieldAdd(const wchar_t *pvalue, const wchar_t *pend, size_t len,
+        std::vector<CTextField> &fields, std::wstring &scratch) const;
+    void Unescape(const wchar_t *pvalue, const wchar_t *pend, size_t len,
+        std::wstring &scratch, CTextField &field) const;
 };
 
 // Clears the accumulated output line
 inline void CTextTable::Clear() {
+    mValues = 0;
     mLine.clear();
 }
 
@@ -43,4 +94,6 @@ inline std::wstring CTextTable::Line() const {
 
 //##############################################################################
 
+uint32_t TextTableTest(std::vector<std::string> &report);
+
 #endif // TEXT_TABLE_DEFD
@@ -0,0 +1,234 @@
+#include "stdafx.h"
+
+#include <algorithm>
+#include <cstring>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+
+#include "Utils.hpp"
+#include "TextPushParser.hpp"
+#include "TextWriter.hpp"
+
+//##############################################################################
+// CTextWriter
+//##############################################################################
+//! Writes records of delimited values to a stream as UTF-8 text, escaping and
+//! quoting each value in a single pass.
+//##############################################################################
+
+//------------------------------------------------------------------------------
+//! Constructor sets the output stream and the delimiter and quote characters,
+//! which must both be ASCII characters other than CR and LF.
+//
+CTextWriter::CTextWriter(std::ostream &stream, wchar_t delimiter,
+    wchar_t quote) : mStream(stream), mDelimiter(static_cast<char>(delimiter)),
+    mQuote(static_cast<char>(quote)), mBuffer(BufferSize, '\0'), mUsed(0),
+    mValues(0), mRecords(0) {
+    if (delimiter >= 0x80 || quote >= 0x80 || delimiter == L'\n' ||
+        delimiter == L'\r' || quote == L'\n' || quote == L'\r')
+        throw std::runtime_error("CTextWriter: The delimiter and quote "
+            "must be ASCII characters other than CR and LF.");
+}
+
+//------------------------------------------------------------------------------
+//! Destructor passes any buffered text to the stream.  Errors are lost, so
+//! Flush() should be called first where they matter.
+//
+CTextWriter::~CTextWriter() {
+    try {
+        Flush();
+    }
+    catch (std::exception &) {
+    }
+}
+
+//------------------------------------------------------------------------------
+//! Function adds the specified value to the current record, enclosing it in
+//! quotes if it contains a delimiter, quote or line break, and doubling any
+//! quotes.  Characters are encoded by CodePointNext() and CodePointPut(), as
+//! by WStrToUtf8(), so UTF-16 surrogate pairs are combined and characters that
+//! UTF-8 cannot represent become U+FFFD.
+//
+void CTextWriter::Add(const wchar_t *pvalue, size_t len) {
+    const wchar_t *pend = pvalue + len;
+    bool NeedQuote = (len == 0 && mValues == 0) || // Not an empty record
+        std::find_if(pvalue, pend, [this](wchar_t ch) {
+            return IsSpecial(static_cast<uint32_t>(ch));
+        }) != pend;
+
+    // At most 4 bytes per character, with doubled quotes taking 2
+    char *p = Reserve(4 * len + 2);
+    if (NeedQuote)
+        *p++ = mQuote;
+    for (const wchar_t *pch = pvalue; pch < pend;) {
+        uint32_t Ch = CodePointNext(pch, pend);
+        p = CodePointPut(Ch, p);
+        if (Ch == static_cast<uint8_t>(mQuote))
+            *p++ = mQuote;
+    }
+    if (NeedQuote)
+        *p++ = mQuote;
+    mUsed = p - mBuffer.data();
+}
+
+//------------------------------------------------------------------------------
+//! Function adds the specified UTF-8 value to the current record, enclosing
+//! it in quotes if necessary and doubling any quotes.
+//
+void CTextWriter::Add(const char *pvalue, size_t len) {
+    const char *pend = pvalue + len;
+    bool NeedQuote = (len == 0 && mValues == 0) || // Not an empty record
+        std::find_if(pvalue, pend, [this](char ch) {
+            return IsSpecial(static_cast<uint8_t>(ch));
+        }) != pend;
+
+    char *p = Reserve(2 * len + 2);
+    if (!NeedQuote) {
+        std::memcpy(p, pvalue, len);
+        mUsed += len;
+        return;
+    }
+    *p++ = mQuote;
+    while (pvalue < pend) {
+        const char *pquote = std::find(pvalue, pend, mQuote);
+        std::memcpy(p, pvalue, pquote - pvalue);
+        p += pquote - pvalue;
+        if (pquote == pend)
+            break;
+        *p++ = mQuote;
+        *p++ = mQuote;
+        pvalue = pquote + 1;
+    }
+    *p++ = mQuote;
+    mUsed = p - mBuffer.data();
+}
+
+//------------------------------------------------------------------------------
+//! Function adds the specified values to the current record.
+//
+void CTextWriter::Add(const std::vector<std::wstring> &values) {
+    for (const std::wstring &Value : values)
+        Add(Value);
+}
+
+//------------------------------------------------------------------------------
+//! Function ends the current record.
+//
+void CTextWriter::RecordEnd() {
+    if (mUsed >= mBuffer.size())
+        Flush();
+    mBuffer[mUsed++] = '\n';
+    mValues = 0;
+    ++mRecords;
+}
+
+//------------------------------------------------------------------------------
+//! Function passes the buffered text to the stream.
+//
+void CTextWriter::Flush() {
+    if (mUsed > 0 && !mStream.write(mBuffer.data(), mUsed))
+        throw std::runtime_error("CTextWriter: Failed to write.");
+    mUsed = 0;
+}
+
+//------------------------------------------------------------------------------
+//! Private function writes the delimiter, unless the next value is the first
+//! of its record, and returns where to write the value, making room for at
+//! most maxLen bytes.  The caller updates mUsed.
+//
+char *CTextWriter::Reserve(size_t maxLen) {
+    if (mUsed + 1 + maxLen > mBuffer.size()) {
+        Flush();
+        if (1 + maxLen > mBuffer.size())
+            mBuffer.resize(1 + maxLen);
+    }
+    if (mValues++ > 0)
+        mBuffer[mUsed++] = mDelimiter;
+    return &mBuffer[mUsed];
+}
+
+//##############################################################################
+
+//------------------------------------------------------------------------------
+//! Function tests CTextWriter by writing records of awkward values, including
+//! values longer than the buffer, and checking that CTextPushParser reads
+//! them back unchanged.
+//
+uint32_t TextWriterTest(std::vector<std::string> &report) {
+    static const wchar_t Alphabet[] = L"ab,\"\n\r \xe9\x4e2d";
+    static const size_t NRecords = 500;
+
+    uint32_t NErrors = 0;
+    report.push_back("");
+    report.push_back("TextWriter Test:");
+
+    uint32_t Seed = 54321;
+    auto Random = [&Seed](uint32_t range) {
+        Seed = Seed * 1103515245 + 12345;
+        return (Seed >> 8) % range;
+    };
+
+    std::vector<std::vector<std::string>> Expected;
+    std::ostringstream Stream;
+    {
+        CTextWriter Writer(Stream);
+        for (size_t Ix = 0; Ix < NRecords; ++Ix) {
+            std::vector<std::wstring> Values(Random(5));
+            for (std::wstring &Value : Values)
+                for (size_t Len = Random(12); Len > 0; --Len)
+                    Value += Alphabet[Random(sizeof(Alphabet) /
+                        sizeof(*Alphabet) - 1)];
+            if (Ix == NRecords / 2)
+                Values.push_back(std::wstring(CTextWriter::BufferSize, L'"'));
+            Writer.Add(Values);
+            Writer.RecordEnd();
+
+            std::vector<std::string> Utf8Values;
+            for (const std::wstring &Value : Values)
+                Utf8Values.push_back(WStrToUtf8(Value));
+            Expected.push_back(Utf8Values);
+        }
+        Writer.Add("x\"y", 3);
+        Writer.Add("", 0);
+        Writer.RecordEnd();
+        Expected.push_back(std::vector<std::string>{ "x\"y", "" });
+
+        // Lone surrogates become U+FFFD, as in WStrToUtf8(), while a pair is
+        // combined
+        std::wstring Surrogates{ L'a', static_cast<wchar_t>(0xd800), L'b',
+            static_cast<wchar_t>(0xd83d), static_cast<wchar_t>(0xde00),
+            static_cast<wchar_t>(0xdc00) };
+        Writer.Add(Surrogates);
+        Writer.RecordEnd();
+        Expected.push_back(std::vector<std::string>{
+            "a\xef\xbf\xbd" "b\xf0\x9f\x98\x80\xef\xbf\xbd" });
+        Writer.Flush();
+    }
+
+    std::vector<std::vector<std::string>> Actual;
+    CTextPushParser Parser([&Actual](const CTextRecord &record) {
+        std::vector<std::string> Values;
+        for (const CUtf8Field &Field : record.Fields)
+            Values.push_back(Field.Str());
+        Actual.push_back(Values);
+    });
+    std::string Text(Stream.str());
+    Parser.Feed(Text.data(), Text.size(), true);
+
+    if (Actual.size() != Expected.size()) {
+        report.push_back("  Incorrect number of records.");
+        ++NErrors;
+    }
+    else {
+        for (size_t Ix = 0; Ix < Actual.size(); ++Ix) {
+            if (Actual[Ix] != Expected[Ix]) {
+                report.push_back("  Incorrect record " + std::to_string(Ix) +
+                    ".");
+                ++NErrors;
+            }
+        }
+    }
+
+    return NErrors;
+}
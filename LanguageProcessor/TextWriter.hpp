@@ -0,0 +1,64 @@
+//#pragma once
+
+#ifndef TEXT_WRITER_HPP
+#define TEXT_WRITER_HPP
+
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+//##############################################################################
+// CTextWriter
+//##############################################################################
+//! Writes records of delimited values to a stream as UTF-8 text, following
+//! the quoting rules that CTextPushParser reads.  Each value is escaped and
+//! quoted in a single pass directly into an output buffer, which is sized for
+//! the worst case before the value is written and passed to the stream
+//! whenever it fills.  Records end with LF.
+//##############################################################################
+
+class CTextWriter {
+public:
+    static const size_t BufferSize = 0x10000;
+
+    CTextWriter(std::ostream &stream, wchar_t delimiter = L',',
+        wchar_t quote = L'"');
+    CTextWriter(const CTextWriter &other) = delete;
+    CTextWriter &operator=(const CTextWriter &other) = delete;
+    ~CTextWriter();
+
+    void   Add(const wchar_t *pvalue, size_t len);
+    void   Add(const char *pvalue, size_t len);
+    void   Add(const std::wstring &value) { Add(value.data(), value.size()); }
+    void   Add(const std::vector<std::wstring> &values);
+    void   RecordEnd();
+    void   Flush();
+    size_t Records() const { return mRecords; }
+
+private:
+    std::ostream &mStream;
+    char          mDelimiter;
+    char          mQuote;
+    std::string   mBuffer;
+    size_t        mUsed;
+    size_t        mValues;
+    size_t        mRecords;
+
+    char *Reserve(size_t maxLen);
+    bool  IsSpecial(uint32_t ch) const;
+};
+
+//------------------------------------------------------------------------------
+//! Private function returns true if a value containing ch must be quoted.
+//
+inline bool CTextWriter::IsSpecial(uint32_t ch) const {
+    return ch == static_cast<uint8_t>(mQuote) ||
+        ch == static_cast<uint8_t>(mDelimiter) || ch == '\n' || ch == '\r';
+}
+
+//##############################################################################
+
+uint32_t TextWriterTest(std::vector<std::string> &report);
+
+#endif // TEXT_WRITER_HPP
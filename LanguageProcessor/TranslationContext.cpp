@@ -0,0 +1,195 @@
+#include "stdafx.h"
+
+#include <memory>
+#include <stdexcept>
+
+#include "Utils.hpp"
+#include "Messages.hpp"
+#include "TranslationContext.hpp"
+
+//##############################################################################
+// CTranslationContext
+//##############################################################################
+//! Translates messages for one thread from a pinned snapshot of a catalog.
+//##############################################################################
+
+//------------------------------------------------------------------------------
+//! Constructor pins the current snapshot of the catalog published by the
+//! specified handle, which must outlive the context, and sets the active
+//! language.
+//
+CTranslationContext::CTranslationContext(const CHandle &handle,
+    const std::wstring &language) : mHandle(handle), mLanguage(language),
+    mLanguageID(ELanguage::Invalid), mHits(0), mMisses(0) {
+    CacheClear();
+    Refresh();
+}
+
+//------------------------------------------------------------------------------
+//! Function moves the context to the current version of the catalog, if it
+//! has a newer one, and returns true if it did.  The language is resolved
+//! again and the cache emptied, and views returned before are no longer
+//! valid.
+//
+bool CTranslationContext::Refresh() {
+    if (mSnapshot && mHandle.Version() == mSnapshot.Version())
+        return false;
+    CHandle::CSnapshot Snapshot = mHandle.Acquire();
+    if (Snapshot.Version() == mSnapshot.Version())
+        return false;
+    mSnapshot = std::move(Snapshot);
+    Language(mLanguage);
+    return true;
+}
+
+//------------------------------------------------------------------------------
+//! Function returns the pinned catalog, or nullptr if none has been published.
+//
+const CColumnarMessages *CTranslationContext::Messages() const {
+    return mSnapshot ? &*mSnapshot : nullptr;
+}
+
+//------------------------------------------------------------------------------
+//! Function sets the active language, resolving it to its handle in the pinned
+//! catalog, and empties the cache.  Translations into a language the catalog
+//! does not have are "???".
+//
+void CTranslationContext::Language(const std::wstring &language) {
+    mLanguage = language;
+    mLanguageID = mSnapshot ? mSnapshot->Language(language)
+        : ELanguage::Invalid;
+    CacheClear();
+}
+
+//------------------------------------------------------------------------------
+//! Function returns the translation of the first message with the specified
+//! name into the active language, or "???" if there is no such message.  A
+//! message found in the cache costs a hash and a comparison of its name.
+//
+CTextField CTranslationContext::Translation(const std::wstring &name) {
+    CTextField Name = { name.data(), name.size() };
+    uint32_t Hash = CColumnarMessages::NameHash(Name);
+    CCacheEntry &Entry = mCache[Hash & (CacheSize - 1)];
+    if (Entry.Ix != CColumnarMessages::NotFound && Entry.Hash == Hash) {
+        CTextField Cached = mSnapshot->Name(Entry.Ix);
+        if (Cached.Len == Name.Len && std::char_traits<wchar_t>::compare(
+            Cached.pText, Name.pText, Name.Len) == 0) {
+            ++mHits;
+            return Entry.Translation;
+        }
+    }
+
+    ++mMisses;
+    size_t Ix = mSnapshot ? mSnapshot->Find(Name, Hash)
+        : CColumnarMessages::NotFound;
+    if (Ix == CColumnarMessages::NotFound) {
+        const std::wstring &Unknown = UnknownTranslation();
+        CTextField Field = { Unknown.data(), Unknown.size() };
+        return Field;
+    }
+    Entry.Hash = Hash;
+    Entry.Ix = Ix;
+    Entry.Translation = mSnapshot->Translation(Ix, mLanguageID);
+    return Entry.Translation;
+}
+
+//------------------------------------------------------------------------------
+//! Function returns the translation of the message at the specified position
+//! in the pinned catalog into the active language.
+//
+CTextField CTranslationContext::Translation(size_t ix) const {
+    if (!mSnapshot)
+        throw std::runtime_error("CTranslationContext::Translation(): No "
+            "catalog.");
+    return mSnapshot->Translation(ix, mLanguageID);
+}
+
+//------------------------------------------------------------------------------
+//! Private function empties the cache.
+//
+void CTranslationContext::CacheClear() {
+    for (CCacheEntry &Entry : mCache) {
+        Entry.Hash = 0;
+        Entry.Ix = CColumnarMessages::NotFound;
+    }
+}
+
+//##############################################################################
+
+//------------------------------------------------------------------------------
+//! Function tests CTranslationContext by looking messages up repeatedly, and
+//! checking that the cache is used, that translations stay valid until a
+//! refresh, and that a refresh picks up a reloaded catalog.
+//
+uint32_t TranslationContextTest(std::vector<std::string> &report) {
+    uint32_t NErrors = 0;
+    report.push_back("");
+    report.push_back("TranslationContext Test:");
+
+    auto CatalogMake = [](const wchar_t *pgerman) {
+        CMessages Messages({ L"English", L"German" });
+        for (size_t Ix = 0; Ix < 100; ++Ix) {
+            CMessage Message;
+            std::wstring Number(std::to_wstring(Ix));
+            Message.Name(L"Message" + Number);
+            Message.TranslationAdd(L"English " + Number);
+            Message.TranslationAdd(pgerman + Number);
+            Messages.MessageAdd(Message);
+        }
+        return std::unique_ptr<const CColumnarMessages>(
+            new CColumnarMessages(Messages));
+    };
+
+    CTranslationContext::CHandle Handle;
+    CTranslationContext Context(Handle, L"German");
+    if (Context.Messages() != nullptr ||
+        !Context.Translation(L"Message1").Equals(L"???")) {
+        report.push_back("  Incorrect translation without a catalog.");
+        ++NErrors;
+    }
+    Handle.Publish(CatalogMake(L"Deutsch "));
+    if (!Context.Refresh() || Context.Refresh()) {
+        report.push_back("  Incorrect refresh.");
+        ++NErrors;
+    }
+
+    CTextField First = Context.Translation(L"Message7");
+    for (size_t Ix = 0; Ix < 10; ++Ix) {
+        for (size_t Iy = 0; Iy < 20; ++Iy) {
+            std::wstring Name(L"Message" + std::to_wstring(Iy));
+            if (Context.Translation(Name).Str() !=
+                L"Deutsch " + std::to_wstring(Iy)) {
+                report.push_back("  Incorrect translation of " +
+                    WStrToUtf8(Name) + ".");
+                ++NErrors;
+            }
+        }
+    }
+    if (Context.Hits() < 150 || !Context.Translation(L"Missing").Equals(
+        L"???")) {
+        report.push_back("  Cache not used: " +
+            std::to_string(Context.Hits()) + " hits.");
+        ++NErrors;
+    }
+
+    // Reload, and check that the earlier view stays valid until a refresh
+    Handle.Publish(CatalogMake(L"Neu "));
+    if (!First.Equals(L"Deutsch 7") ||
+        !Context.Translation(L"Message7").Equals(L"Deutsch 7")) {
+        report.push_back("  Translation changed before refresh.");
+        ++NErrors;
+    }
+    if (!Context.Refresh() || Context.Version() != 2 ||
+        !Context.Translation(L"Message7").Equals(L"Neu 7")) {
+        report.push_back("  Reloaded catalog not used after refresh.");
+        ++NErrors;
+    }
+    Context.Language(L"English");
+    if (!Context.Translation(L"Message7").Equals(L"English 7") ||
+        !Context.Translation(7).Equals(L"English 7")) {
+        report.push_back("  Language not changed.");
+        ++NErrors;
+    }
+
+    return NErrors;
+}
@@ -0,0 +1,73 @@
+//#pragma once
+
+#ifndef TRANSLATION_CONTEXT_HPP
+#define TRANSLATION_CONTEXT_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "TextTable.hpp"
+#include "ColumnarMessages.hpp"
+#include "CatalogHandle.hpp"
+
+//##############################################################################
+// CTranslationContext
+//##############################################################################
+//! Translates messages for one thread, such as a request thread serving one
+//! locale at a time, from a catalog published through a CCatalogHandle.  The
+//! context pins a snapshot of the catalog and an active language, resolved to
+//! its handle once, and remembers where the messages it has recently looked
+//! up by name are, in a small cache indexed by the hash of the name.
+//! Translations are returned as views of the pinned snapshot, which stay
+//! valid until the context moves to a newer version of the catalog.  It does
+//! so only when Refresh() is called, for example at the start of each
+//! request, and then empties the cache.  A context belongs to one thread and
+//! must not be shared, but any number of contexts may use the same handle.
+//##############################################################################
+
+class CTranslationContext {
+public:
+    typedef CCatalogHandle<CColumnarMessages> CHandle;
+    static const size_t CacheSize = 64; // Power of two
+
+    CTranslationContext(const CHandle &handle,
+        const std::wstring &language = std::wstring());
+    CTranslationContext(const CTranslationContext &other) = delete;
+    CTranslationContext &operator=(const CTranslationContext &other) = delete;
+
+    bool Refresh();
+    uint64_t Version() const { return mSnapshot.Version(); }
+    const CColumnarMessages *Messages() const;
+
+    const std::wstring &Language() const { return mLanguage; }
+    void Language(const std::wstring &language);
+
+    CTextField Translation(const std::wstring &name);
+    CTextField Translation(size_t ix) const;
+    size_t     Hits() const { return mHits; }
+    size_t     Misses() const { return mMisses; }
+
+private:
+    struct CCacheEntry {
+        uint32_t   Hash;
+        size_t     Ix;          // Position of the message, or NotFound
+        CTextField Translation;
+    };
+
+    const CHandle      &mHandle;
+    CHandle::CSnapshot  mSnapshot;
+    std::wstring        mLanguage;
+    ELanguage           mLanguageID;
+    CCacheEntry         mCache[CacheSize];
+    size_t              mHits;
+    size_t              mMisses;
+
+    void CacheClear();
+};
+
+//##############################################################################
+
+uint32_t TranslationContextTest(std::vector<std::string> &report);
+
+#endif // TRANSLATION_CONTEXT_HPP
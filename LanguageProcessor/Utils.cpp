@@ -1,95 +1,346 @@
 #include "stdafx.h"
 
+#include <algorithm>
+#include <cstring>
 #include <sstream>
 //#include <iomanip>
 #include <stdexcept>
+#include <utility>
 
 #include "Utils.hpp"
+#include "AllocationTracker.hpp"
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || \
+    defined(__SSE2__)
+#define UTILS_SSE2
+#include <emmintrin.h>
+#include <wmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
 
 //------------------------------------------------------------------------------
-//! Function converts a UTF-8 string to a standard wide string.  The "magic"
-//! numbers in the code are based on the following table.
-//!
-//!  Bytes | Bits | First  |  Last  |  Byte 1  |  Byte 2  |  Byte 3
-//! -------+------+--------+--------+----------+----------+---------
-//!    1   |   7  | U+0000 | U+007F | 0xxxxxxx |          |
-//!    2   |  11  | U+0080 | U+07FF | 110xxxxx | 10xxxxxx |
-//!    3   |  16  | U+0800 | U+FFFF | 1110xxxx | 10xxxxxx | 10xxxxxx
-//!
+//! Function converts a UTF-8 string to a standard wide string.
+//
 std::wstring Utf8ToWStr(const std::string &utf8) {
+    return Utf8ToWStr(utf8.data(), utf8.size());
+}
+
+//------------------------------------------------------------------------------
+//! Function converts a span of UTF-8 text, which need not be null terminated,
+//! to a standard wide string.  This lets callers decode text in place, such as
+//! a record within a memory mapped file, without first copying it.
+//
+std::wstring Utf8ToWStr(const char *putf8, size_t len) {
     std::wstring Result;
-    auto It = utf8.begin();
-    while (It != utf8.end()) {
-    //while (*It != '\0') {
-            uint32_t NExtraBytes = 0;
-        wchar_t WCh = 0x0000;
-        if ((*It & 0x80) == 0x00) {      // If 1 byte
-            WCh = static_cast<wchar_t>(*It);
-        }
-        else if ((*It & 0xe0) == 0xc0) { // If 2 bytes
-            WCh = static_cast<wchar_t>(*It & 0x1f);
-            NExtraBytes = 1;
-        }
-        else if ((*It & 0xf0) == 0xe0) { // If 3 bytes
-            WCh = static_cast<wchar_t>(*It & 0x0f);
-            NExtraBytes = 2;
-        }
-        else
-            throw std::runtime_error("UTF8ToWStr(); Invalid UTF-8 string "
-                "(lead).");
-        ++It;
-
-        while (NExtraBytes-- > 0) {
-            if ((*It & 0xc0) != 0x80)
-                throw std::runtime_error("UTF8ToWStr(): Invalid UTF-8 string "
-                    "(follow).");
-            WCh <<= 6;
-            WCh |= static_cast<wchar_t>(*It++ & 0x3f);
-        }
+    Utf8ToWStr(putf8, len, Result);
+    return Result;
+}
+
+namespace {
 
-        Result.append(1, WCh);
+//------------------------------------------------------------------------------
+//! Function returns the number of set bits in the low 16 bits of mask.
+//
+inline size_t BitCount16(uint32_t mask) {
+    mask -= (mask >> 1) & 0x5555;
+    mask = (mask & 0x3333) + ((mask >> 2) & 0x3333);
+    mask = (mask + (mask >> 4)) & 0x0f0f;
+    return (mask + (mask >> 8)) & 0x1f;
+}
+
+//------------------------------------------------------------------------------
+//! Function returns the number of wide characters that a span of UTF-8 text
+//! decodes to, which is the number of bytes other than continuation bytes,
+//! plus one for each 4 byte sequence when a surrogate pair is needed for it.
+//! The count is exact for valid text and an upper bound for invalid text.
+//
+size_t Utf8WideLen(const char *putf8, const char *pend) {
+    const bool IsUtf16 = sizeof(wchar_t) == 2;
+    size_t Len = 0;
+#ifdef UTILS_SSE2
+    const __m128i Follow = _mm_set1_epi8(static_cast<char>(0xbf));
+    const __m128i Lead3 = _mm_set1_epi8(static_cast<char>(0xef));
+    for (; pend - putf8 >= 16; putf8 += 16) {
+        __m128i Bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(
+            putf8));
+        // As signed bytes, 0x00-0x7f and 0xc0-0xff exceed 0xbf, and only
+        // 0xf0-0xff (and ASCII) exceed 0xef
+        Len += BitCount16(_mm_movemask_epi8(_mm_cmpgt_epi8(Bytes, Follow)));
+        if (IsUtf16)
+            Len += BitCount16(_mm_movemask_epi8(_mm_cmpgt_epi8(Bytes, Lead3)) &
+                _mm_movemask_epi8(Bytes));
     }
-    return Result;
+#endif
+    for (; putf8 < pend; ++putf8) {
+        uint8_t Byte = static_cast<uint8_t>(*putf8);
+        Len += ((Byte & 0xc0) != 0x80) + (IsUtf16 && Byte >= 0xf0);
+    }
+    return Len;
+}
+
+//------------------------------------------------------------------------------
+//! Function throws the exception for invalid UTF-8 found by the specified
+//! function, giving the reason.
+//
+[[noreturn]] void Utf8Invalid(const char *pfunction, const char *preason) {
+    throw std::runtime_error(std::string(pfunction) + "(): Invalid UTF-8 "
+        "string (" + preason + ").");
+}
+
+//------------------------------------------------------------------------------
+//! Function decodes the multi-byte sequence that starts at putf8, advancing
+//! putf8 past it, and returns its code point.  Invalid lead or following
+//! bytes, overlong sequences, surrogates and values beyond U+10FFFF are
+//! reported as found by the specified function.  Both the conversion and the
+//! check of UTF-8 text decode through here, so they accept the same text.
+//
+uint32_t SequenceDecode(const char *&putf8, const char *pend,
+    const char *pfunction) {
+    uint32_t Ch = static_cast<uint8_t>(*putf8);
+    size_t NExtraBytes;
+    uint32_t Min;
+    if ((Ch & 0xe0) == 0xc0) {      // If 2 bytes
+        Ch &= 0x1f;
+        NExtraBytes = 1;
+        Min = 0x0080;
+    }
+    else if ((Ch & 0xf0) == 0xe0) { // If 3 bytes
+        Ch &= 0x0f;
+        NExtraBytes = 2;
+        Min = 0x0800;
+    }
+    else if ((Ch & 0xf8) == 0xf0) { // If 4 bytes
+        Ch &= 0x07;
+        NExtraBytes = 3;
+        Min = 0x10000;
+    }
+    else
+        Utf8Invalid(pfunction, "lead");
+    ++putf8;
+
+    if (static_cast<size_t>(pend - putf8) < NExtraBytes)
+        Utf8Invalid(pfunction, "follow");
+    while (NExtraBytes-- > 0) {
+        if ((*putf8 & 0xc0) != 0x80)
+            Utf8Invalid(pfunction, "follow");
+        Ch <<= 6;
+        Ch |= static_cast<uint32_t>(*putf8++ & 0x3f);
+    }
+    if (Ch < Min)
+        Utf8Invalid(pfunction, "overlong");
+    if (Ch > 0x10ffff || (Ch >= 0xd800 && Ch < 0xe000))
+        Utf8Invalid(pfunction, "range");
+    return Ch;
 }
 
+#ifdef UTILS_SSE2
 //------------------------------------------------------------------------------
-//! Function converts a standard wide string to a standard UTF-8 string.  The
-//! "magic" numbers in the code are based on the following table.
+//! Function widens 16 ASCII bytes to 16 wide characters at pwide and returns
+//! the position after them.
+//
+inline wchar_t *AsciiWiden(__m128i bytes, wchar_t *pwide) {
+    const __m128i Zero = _mm_setzero_si128();
+    __m128i Low = _mm_unpacklo_epi8(bytes, Zero);
+    __m128i High = _mm_unpackhi_epi8(bytes, Zero);
+    __m128i *pout = reinterpret_cast<__m128i *>(pwide);
+    if (sizeof(wchar_t) == 2) {
+        _mm_storeu_si128(pout, Low);
+        _mm_storeu_si128(pout + 1, High);
+    }
+    else {
+        _mm_storeu_si128(pout, _mm_unpacklo_epi16(Low, Zero));
+        _mm_storeu_si128(pout + 1, _mm_unpackhi_epi16(Low, Zero));
+        _mm_storeu_si128(pout + 2, _mm_unpacklo_epi16(High, Zero));
+        _mm_storeu_si128(pout + 3, _mm_unpackhi_epi16(High, Zero));
+    }
+    return pwide + 16;
+}
+#endif
+
+} // namespace
+
+//------------------------------------------------------------------------------
+//! Function converts a span of UTF-8 text to a wide string, replacing the
+//! content of result.  Reusing result for consecutive calls avoids a heap
+//! allocation per call once its capacity is large enough.  The length of the
+//! result is counted first, so that result is sized once, and runs of ASCII
+//! text are then widened 16 bytes at a time.  Overlong sequences, surrogates
+//! and values beyond U+10FFFF are rejected.  Where wchar_t has 16 bits,
+//! characters beyond U+FFFF become surrogate pairs.  The "magic" numbers in
+//! the code are based on the following table.
 //!
-//!  Bytes | Bits | First  |  Last  |  Byte 1  |  Byte 2  |  Byte 3
-//! -------+------+--------+--------+----------+----------+---------
-//!    1   |   7  | U+0000 | U+007F | 0xxxxxxx |          |
-//!    2   |  11  | U+0080 | U+07FF | 110xxxxx | 10xxxxxx |
-//!    3   |  16  | U+0800 | U+FFFF | 1110xxxx | 10xxxxxx | 10xxxxxx
+//! Bytes | Bits | First   | Last     | Byte 1   | Byte 2   | Byte 3   | Byte 4
+//! ------+------+---------+----------+----------+----------+----------+--------
+//!   1   |   7  | U+0000  | U+007F   | 0xxxxxxx |          |          |
+//!   2   |  11  | U+0080  | U+07FF   | 110xxxxx | 10xxxxxx |          |
+//!   3   |  16  | U+0800  | U+FFFF   | 1110xxxx | 10xxxxxx | 10xxxxxx |
+//!   4   |  21  | U+10000 | U+10FFFF | 11110xxx | 10xxxxxx | 10xxxxxx | 10xxxxxx
 //!
-std::string WStrToUtf8(const std::wstring &wstr) {
-    std::string Result;
-    for (wchar_t Ch : wstr) {
-        if (Ch < 0x0080) {
-            Result.append(1, static_cast<char>(Ch));
+void Utf8ToWStr(const char *putf8, size_t len, std::wstring &result) {
+    CAllocationScope Scope(ESubsystem::Utf8);
+    const char *pend = putf8 + len;
+    result.resize(Utf8WideLen(putf8, pend));
+    wchar_t *pwide = &result[0];
+
+    while (putf8 < pend) {
+        uint32_t Ch = static_cast<uint8_t>(*putf8);
+        if (Ch < 0x80) { // If 1 byte
+#ifdef UTILS_SSE2
+            while (pend - putf8 >= 16) {
+                __m128i Bytes = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i *>(putf8));
+                if (_mm_movemask_epi8(Bytes) != 0)
+                    break;
+                pwide = AsciiWiden(Bytes, pwide);
+                putf8 += 16;
+            }
+            if (putf8 >= pend)
+                break;
+            Ch = static_cast<uint8_t>(*putf8);
+            if (Ch < 0x80) {
+                *pwide++ = static_cast<wchar_t>(Ch);
+                ++putf8;
+                continue;
+            }
+#else
+            *pwide++ = static_cast<wchar_t>(Ch);
+            ++putf8;
+            continue;
+#endif
         }
-        else if (Ch < 0x0800) {
-            std::string Buf(2, ' ');
-            auto It = Buf.rbegin();
-            *It++ = static_cast<char>((Ch & 0x003f) | 0x0080);
-            Ch >>= 6;
-            *It++ = static_cast<char>((Ch & 0x001f) | 0x00c0);
-            Result.append(Buf);
+
+        Ch = SequenceDecode(putf8, pend, "Utf8ToWStr");
+
+        if (sizeof(wchar_t) == 2 && Ch >= 0x10000) { // If surrogate pair
+            Ch -= 0x10000;
+            *pwide++ = static_cast<wchar_t>(0xd800 | (Ch >> 10));
+            *pwide++ = static_cast<wchar_t>(0xdc00 | (Ch & 0x3ff));
         }
-        else { // Ch <= 0xffff
-            std::string Buf(3, ' ');
-            auto It = Buf.rbegin();
-            *It++ = static_cast<char>((Ch & 0x003f) | 0x0080);
-            Ch >>= 6;
-            *It++ = static_cast<char>((Ch & 0x003f) | 0x0080);
-            Ch >>= 6;
-            *It++ = static_cast<char>((Ch & 0x000f) | 0x00e0);
-            Result.append(Buf);
+        else
+            *pwide++ = static_cast<wchar_t>(Ch);
+    }
+}
+
+//------------------------------------------------------------------------------
+//! Function checks that a span of text is valid UTF-8 by the rules of
+//! Utf8ToWStr(), for text that is to be kept as UTF-8 rather than converted.
+//! Invalid text throws the exceptions of Utf8ToWStr(), naming Utf8Check().
+//! Runs of ASCII text are skipped 16 bytes at a time.
+//
+void Utf8Check(const char *putf8, size_t len) {
+    const char *pend = putf8 + len;
+    while (putf8 < pend) {
+#ifdef UTILS_SSE2
+        while (pend - putf8 >= 16 && _mm_movemask_epi8(_mm_loadu_si128(
+            reinterpret_cast<const __m128i *>(putf8))) == 0)
+            putf8 += 16;
+        if (putf8 >= pend)
+            break;
+#endif
+        if (static_cast<uint8_t>(*putf8) < 0x80)
+            ++putf8;
+        else
+            SequenceDecode(putf8, pend, "Utf8Check");
+    }
+}
+
+namespace {
+
+#ifdef UTILS_SSE2
+//------------------------------------------------------------------------------
+//! Function returns true if the 16 wide characters at pwide are all ASCII, in
+//! which case it sets bytes to them narrowed to bytes.
+//
+inline bool AsciiNarrow(const wchar_t *pwide, __m128i &bytes) {
+    const __m128i Zero = _mm_setzero_si128();
+    const __m128i *pin = reinterpret_cast<const __m128i *>(pwide);
+    if (sizeof(wchar_t) == 2) {
+        __m128i Low = _mm_loadu_si128(pin);
+        __m128i High = _mm_loadu_si128(pin + 1);
+        __m128i NonAscii = _mm_and_si128(_mm_or_si128(Low, High),
+            _mm_set1_epi16(static_cast<short>(0xff80)));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi16(NonAscii, Zero)) != 0xffff)
+            return false;
+        bytes = _mm_packus_epi16(Low, High);
+    }
+    else {
+        __m128i In0 = _mm_loadu_si128(pin);
+        __m128i In1 = _mm_loadu_si128(pin + 1);
+        __m128i In2 = _mm_loadu_si128(pin + 2);
+        __m128i In3 = _mm_loadu_si128(pin + 3);
+        __m128i NonAscii = _mm_and_si128(_mm_or_si128(_mm_or_si128(In0, In1),
+            _mm_or_si128(In2, In3)), _mm_set1_epi32(static_cast<int>(
+            0xffffff80)));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(NonAscii, Zero)) != 0xffff)
+            return false;
+        bytes = _mm_packus_epi16(_mm_packs_epi32(In0, In1),
+            _mm_packs_epi32(In2, In3));
+    }
+    return true;
+}
+#endif
+
+//------------------------------------------------------------------------------
+//! Function returns the number of bytes a span of wide text encodes to.
+//
+size_t WideUtf8Len(const wchar_t *pwide, const wchar_t *pend) {
+    size_t Len = 0;
+    while (pwide < pend) {
+#ifdef UTILS_SSE2
+        __m128i Bytes;
+        if (pend - pwide >= 16 && AsciiNarrow(pwide, Bytes)) {
+            pwide += 16;
+            Len += 16;
+            continue;
         }
+#endif
+        uint32_t Ch = CodePointNext(pwide, pend);
+        Len += (Ch < 0x0080) ? 1 : (Ch < 0x0800) ? 2 : (Ch < 0x10000) ? 3 : 4;
     }
+    return Len;
+}
+
+} // namespace
+
+//------------------------------------------------------------------------------
+//! Function converts a standard wide string to a standard UTF-8 string.
+//
+std::string WStrToUtf8(const std::wstring &wstr) {
+    std::string Result;
+    WStrToUtf8(wstr.data(), wstr.size(), Result);
     return Result;
 }
 
+//------------------------------------------------------------------------------
+//! Function converts a span of wide text to UTF-8, replacing the content of
+//! result.  The length of the result is counted first, so that result is sized
+//! once and then written in place, and runs of ASCII text are narrowed 16
+//! characters at a time.  Surrogate pairs become 4 byte sequences, while lone
+//! surrogates become U+FFFD.  The "magic" numbers in the code are based on the
+//! table for Utf8ToWStr().
+//
+void WStrToUtf8(const wchar_t *pwide, size_t len, std::string &result) {
+    CAllocationScope Scope(ESubsystem::Utf8);
+    const wchar_t *pend = pwide + len;
+    result.resize(WideUtf8Len(pwide, pend));
+    char *putf8 = &result[0];
+
+    while (pwide < pend) {
+#ifdef UTILS_SSE2
+        __m128i Bytes;
+        if (pend - pwide >= 16 && AsciiNarrow(pwide, Bytes)) {
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(putf8), Bytes);
+            pwide += 16;
+            putf8 += 16;
+            continue;
+        }
+#endif
+        putf8 = CodePointPut(CodePointNext(pwide, pend), putf8);
+    }
+}
+
 //##############################################################################
 
 //------------------------------------------------------------------------------
@@ -130,62 +381,289 @@ std::string ToLowerHex(uint32_t value, size_t width) {
     return ToHex("0123456789abcdef", value, width);
 }
 
+//##############################################################################
+
+//------------------------------------------------------------------------------
+//! Function returns a 64-bit fingerprint of a buffer, for telling whether two
+//! buffers are the same without keeping either.  Whole words are mixed in by
+//! multiplication, and the result is finished as in MurmurHash3, so it takes
+//! about a cycle per byte and any change flips about half the bits.  It is not
+//! a cryptographic hash and the value depends on byte order.
+//
+uint64_t Fingerprint64(const char *pdata, size_t len) {
+    static const uint64_t Multiplier = 0x9e3779b97f4a7c15ull;
+    const char *pEnd = pdata + len;
+    uint64_t Hash = len * Multiplier;
+    for (; pEnd - pdata >= 8; pdata += 8) {
+        uint64_t Word;
+        std::memcpy(&Word, pdata, sizeof(Word));
+        Hash = (Hash ^ Word) * Multiplier;
+        Hash ^= Hash >> 29;
+    }
+    uint64_t Tail = 0;
+    std::memcpy(&Tail, pdata, pEnd - pdata);
+    Hash = (Hash ^ Tail) * Multiplier;
+    Hash ^= Hash >> 33;
+    Hash *= 0xff51afd7ed558ccdull;
+    Hash ^= Hash >> 33;
+    Hash *= 0xc4ceb3f99d53ec6dull;
+    Hash ^= Hash >> 33;
+    return Hash;
+}
+
 //##############################################################################
 // CModbusCRC
 //##############################################################################
+//! Accumulates a Modbus CRC.  The lookup tables are generated at compile time:
+//! table 0 advances the CRC by one byte, and table N advances it by one byte
+//! followed by N zero bytes, so that slicing by 8 or 16 combines the bytes of
+//! a whole word independently.  The CLMul method folds 64 bytes at a time by
+//! carry-less multiplication, reducing the buffer to 16 bytes with the same
+//! CRC, which are then added by slicing.
 //##############################################################################
 
-const uint16_t CModbusCRC::sLookup[]{
-    0x0000, 0xC0C1, 0xC181, 0x0140, 0xC301, 0x03C0, 0x0280, 0xC241,
-    0xC601, 0x06C0, 0x0780, 0xC741, 0x0500, 0xC5C1, 0xC481, 0x0440,
-    0xCC01, 0x0CC0, 0x0D80, 0xCD41, 0x0F00, 0xCFC1, 0xCE81, 0x0E40,
-    0x0A00, 0xCAC1, 0xCB81, 0x0B40, 0xC901, 0x09C0, 0x0880, 0xC841,
-    0xD801, 0x18C0, 0x1980, 0xD941, 0x1B00, 0xDBC1, 0xDA81, 0x1A40,
-    0x1E00, 0xDEC1, 0xDF81, 0x1F40, 0xDD01, 0x1DC0, 0x1C80, 0xDC41,
-    0x1400, 0xD4C1, 0xD581, 0x1540, 0xD701, 0x17C0, 0x1680, 0xD641,
-    0xD201, 0x12C0, 0x1380, 0xD341, 0x1100, 0xD1C1, 0xD081, 0x1040,
-    0xF001, 0x30C0, 0x3180, 0xF141, 0x3300, 0xF3C1, 0xF281, 0x3240,
-    0x3600, 0xF6C1, 0xF781, 0x3740, 0xF501, 0x35C0, 0x3480, 0xF441,
-    0x3C00, 0xFCC1, 0xFD81, 0x3D40, 0xFF01, 0x3FC0, 0x3E80, 0xFE41,
-    0xFA01, 0x3AC0, 0x3B80, 0xFB41, 0x3900, 0xF9C1, 0xF881, 0x3840,
-    0x2800, 0xE8C1, 0xE981, 0x2940, 0xEB01, 0x2BC0, 0x2A80, 0xEA41,
-    0xEE01, 0x2EC0, 0x2F80, 0xEF41, 0x2D00, 0xEDC1, 0xEC81, 0x2C40,
-    0xE401, 0x24C0, 0x2580, 0xE541, 0x2700, 0xE7C1, 0xE681, 0x2640,
-    0x2200, 0xE2C1, 0xE381, 0x2340, 0xE101, 0x21C0, 0x2080, 0xE041,
-    0xA001, 0x60C0, 0x6180, 0xA141, 0x6300, 0xA3C1, 0xA281, 0x6240,
-    0x6600, 0xA6C1, 0xA781, 0x6740, 0xA501, 0x65C0, 0x6480, 0xA441,
-    0x6C00, 0xACC1, 0xAD81, 0x6D40, 0xAF01, 0x6FC0, 0x6E80, 0xAE41,
-    0xAA01, 0x6AC0, 0x6B80, 0xAB41, 0x6900, 0xA9C1, 0xA881, 0x6840,
-    0x7800, 0xB8C1, 0xB981, 0x7940, 0xBB01, 0x7BC0, 0x7A80, 0xBA41,
-    0xBE01, 0x7EC0, 0x7F80, 0xBF41, 0x7D00, 0xBDC1, 0xBC81, 0x7C40,
-    0xB401, 0x74C0, 0x7580, 0xB541, 0x7700, 0xB7C1, 0xB681, 0x7640,
-    0x7200, 0xB2C1, 0xB381, 0x7340, 0xB101, 0x71C0, 0x7080, 0xB041,
-    0x5000, 0x90C1, 0x9181, 0x5140, 0x9301, 0x53C0, 0x5280, 0x9241,
-    0x9601, 0x56C0, 0x5780, 0x9741, 0x5500, 0x95C1, 0x9481, 0x5440,
-    0x9C01, 0x5CC0, 0x5D80, 0x9D41, 0x5F00, 0x9FC1, 0x9E81, 0x5E40,
-    0x5A00, 0x9AC1, 0x9B81, 0x5B40, 0x9901, 0x59C0, 0x5880, 0x9841,
-    0x8801, 0x48C0, 0x4980, 0x8941, 0x4B00, 0x8BC1, 0x8A81, 0x4A40,
-    0x4E00, 0x8EC1, 0x8F81, 0x4F40, 0x8D01, 0x4DC0, 0x4C80, 0x8C41,
-    0x4400, 0x84C1, 0x8581, 0x4540, 0x8701, 0x47C0, 0x4680, 0x8641,
-    0x8201, 0x42C0, 0x4380, 0x8341, 0x4100, 0x81C1, 0x8081, 0x4040
+namespace {
+
+const size_t NCrcSlices = 16;
+
+//------------------------------------------------------------------------------
+//! Function advances a CRC by the specified number of zero bits.
+//
+constexpr uint16_t CrcShift(uint16_t crc, int bits) {
+    return (bits == 0) ? crc : CrcShift(static_cast<uint16_t>((crc & 1) ?
+        (crc >> 1) ^ 0xa001 : crc >> 1), bits - 1);
+}
+
+//------------------------------------------------------------------------------
+//! Functions return entry byte of table slice, each table following from the
+//! previous one by one more zero byte.
+//
+constexpr uint16_t CrcNext(uint16_t entry) {
+    return static_cast<uint16_t>((entry >> 8) ^ CrcShift(entry & 0xff, 8));
+}
+
+constexpr uint16_t CrcEntry(size_t slice, uint16_t byte) {
+    return (slice == 0) ? CrcShift(byte, 8)
+        : CrcNext(CrcEntry(slice - 1, byte));
+}
+
+struct CCrcTables {
+    uint16_t Table[NCrcSlices][256];
 };
 
+template <size_t... Ix>
+constexpr CCrcTables CrcTablesMake(std::index_sequence<Ix...>) {
+    return CCrcTables{ { CrcEntry(Ix / 256, Ix % 256)... } };
+}
+
+constexpr CCrcTables sCrc =
+    CrcTablesMake(std::make_index_sequence<NCrcSlices * 256>());
+
+static_assert(sCrc.Table[0][1] == 0xc0c1 && sCrc.Table[0][255] == 0x4040,
+    "Incorrect Modbus CRC table.");
+
+//------------------------------------------------------------------------------
+//! Function loads 8 bytes as a little endian word.
+//
+inline uint64_t Load64(const uint8_t *p) {
+    uint64_t Word;
+    std::memcpy(&Word, p, sizeof(Word));
+    return Word;
+}
+
+//------------------------------------------------------------------------------
+//! Function adds bytes to a CRC one at a time.
+//
+uint16_t CrcByte(uint16_t crc, const uint8_t *p, size_t count) {
+    const uint16_t *pTable = sCrc.Table[0];
+    for (const uint8_t *pend = p + count; p < pend; ++p)
+        crc = static_cast<uint16_t>((crc >> 8) ^ pTable[(crc ^ *p) & 0xff]);
+    return crc;
+}
+
+//------------------------------------------------------------------------------
+//! Function adds bytes to a CRC 8 at a time.
+//
+uint16_t CrcSlice8(uint16_t crc, const uint8_t *p, size_t count) {
+    const uint16_t (*T)[256] = sCrc.Table;
+    for (; count >= 8; count -= 8, p += 8) {
+        uint64_t X = Load64(p) ^ crc;
+        crc = T[7][X & 0xff] ^ T[6][(X >> 8) & 0xff] ^
+            T[5][(X >> 16) & 0xff] ^ T[4][(X >> 24) & 0xff] ^
+            T[3][(X >> 32) & 0xff] ^ T[2][(X >> 40) & 0xff] ^
+            T[1][(X >> 48) & 0xff] ^ T[0][X >> 56];
+    }
+    return CrcByte(crc, p, count);
+}
+
+//------------------------------------------------------------------------------
+//! Function adds bytes to a CRC 16 at a time.
+//
+uint16_t CrcSlice16(uint16_t crc, const uint8_t *p, size_t count) {
+    const uint16_t (*T)[256] = sCrc.Table;
+    for (; count >= 16; count -= 16, p += 16) {
+        uint64_t X = Load64(p) ^ crc;
+        uint64_t Y = Load64(p + 8);
+        crc = T[15][X & 0xff] ^ T[14][(X >> 8) & 0xff] ^
+            T[13][(X >> 16) & 0xff] ^ T[12][(X >> 24) & 0xff] ^
+            T[11][(X >> 32) & 0xff] ^ T[10][(X >> 40) & 0xff] ^
+            T[9][(X >> 48) & 0xff] ^ T[8][X >> 56] ^
+            T[7][Y & 0xff] ^ T[6][(Y >> 8) & 0xff] ^
+            T[5][(Y >> 16) & 0xff] ^ T[4][(Y >> 24) & 0xff] ^
+            T[3][(Y >> 32) & 0xff] ^ T[2][(Y >> 40) & 0xff] ^
+            T[1][(Y >> 48) & 0xff] ^ T[0][Y >> 56];
+    }
+    return CrcSlice8(crc, p, count);
+}
+
+#ifdef UTILS_SSE2
+
+//------------------------------------------------------------------------------
+//! Function returns x^n modulo the (unreflected) Modbus polynomial
+//! x^16 + x^15 + x^2 + 1, reflected into the top 16 bits of a 64 bit word to
+//! suit the reflected bit order of the buffer.
+//
+uint64_t CrcFoldConstant(size_t n) {
+    uint32_t Remainder = 1;
+    while (n-- > 0) {
+        Remainder <<= 1;
+        if (Remainder & 0x10000)
+            Remainder ^= 0x18005;
+    }
+    uint64_t Reflected = 0;
+    for (int Bit = 0; Bit < 16; ++Bit)
+        if (Remainder & (1u << Bit))
+            Reflected |= static_cast<uint64_t>(1) << (63 - Bit);
+    return Reflected;
+}
+
+//------------------------------------------------------------------------------
+//! Function returns the multipliers that fold a 16 byte block forward over n
+//! bits: the first 8 bytes of the block are multiplied by x^(n+64) and the
+//! last 8 by x^n.  Multiplying reflected values loses a factor of x, which is
+//! made up by using one less power.
+//
+__m128i CrcFoldConstants(size_t n) {
+    uint64_t First = CrcFoldConstant(n + 63);
+    uint64_t Last = CrcFoldConstant(n - 1);
+    return _mm_set_epi32(static_cast<int>(Last >> 32), static_cast<int>(Last),
+        static_cast<int>(First >> 32), static_cast<int>(First));
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+#define CLMUL_TARGET __attribute__((target("pclmul")))
+#else
+#define CLMUL_TARGET
+#endif
+
+//------------------------------------------------------------------------------
+//! Function folds block forward over the distance given by constants and adds
+//! next, the block at that distance.
+//
+CLMUL_TARGET inline __m128i CrcFold(__m128i block, __m128i constants,
+    __m128i next) {
+    return _mm_xor_si128(_mm_xor_si128(
+        _mm_clmulepi64_si128(block, constants, 0x00),
+        _mm_clmulepi64_si128(block, constants, 0x11)), next);
+}
+
+//------------------------------------------------------------------------------
+//! Function adds bytes to a CRC by folding 4 blocks of 16 bytes at a time.
+//! Buffers too short to fold are added by slicing.
+//
+CLMUL_TARGET uint16_t CrcCLMul(uint16_t crc, const uint8_t *p, size_t count) {
+    static const __m128i Fold128 = CrcFoldConstants(128);
+    static const __m128i Fold512 = CrcFoldConstants(512);
+    if (count < 128)
+        return CrcSlice16(crc, p, count);
+
+    // The CRC so far is equivalent to adding it to the first 2 bytes
+    const __m128i *pin = reinterpret_cast<const __m128i *>(p);
+    __m128i Block0 = _mm_xor_si128(_mm_loadu_si128(pin),
+        _mm_cvtsi32_si128(crc));
+    __m128i Block1 = _mm_loadu_si128(pin + 1);
+    __m128i Block2 = _mm_loadu_si128(pin + 2);
+    __m128i Block3 = _mm_loadu_si128(pin + 3);
+    for (pin += 4, count -= 64; count >= 64; pin += 4, count -= 64) {
+        Block0 = CrcFold(Block0, Fold512, _mm_loadu_si128(pin));
+        Block1 = CrcFold(Block1, Fold512, _mm_loadu_si128(pin + 1));
+        Block2 = CrcFold(Block2, Fold512, _mm_loadu_si128(pin + 2));
+        Block3 = CrcFold(Block3, Fold512, _mm_loadu_si128(pin + 3));
+    }
+    Block0 = CrcFold(Block0, Fold128, Block1);
+    Block0 = CrcFold(Block0, Fold128, Block2);
+    Block0 = CrcFold(Block0, Fold128, Block3);
+    for (; count >= 16; ++pin, count -= 16)
+        Block0 = CrcFold(Block0, Fold128, _mm_loadu_si128(pin));
+
+    uint8_t Rest[16];
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(Rest), Block0);
+    crc = CrcSlice16(0, Rest, sizeof(Rest));
+    return CrcSlice16(crc, reinterpret_cast<const uint8_t *>(pin), count);
+}
+
+//------------------------------------------------------------------------------
+//! Function reports whether the CPU supports carry-less multiplication.
+//
+bool CpuHasCLMul() {
+#ifdef _MSC_VER
+    int Info[4];
+    __cpuid(Info, 1);
+    return (Info[2] & (1 << 1)) != 0;
+#else
+    return __builtin_cpu_supports("pclmul") != 0;
+#endif
+}
+
+#endif // UTILS_SSE2
+
+} // namespace
+
 //------------------------------------------------------------------------------
 //! Constructor initializes the current CRC value as specified or to the default
-//! Modbus CRC value if not specified.
+//! Modbus CRC value if not specified, and selects the method used for buffers,
+//! which defaults to the best one the CPU supports.
 //
-CModbusCRC::CModbusCRC(uint16_t value) : mValue(value) {
+CModbusCRC::CModbusCRC(uint16_t value, EMethod method) : mValue(value) {
+    Method(method);
+}
+
+//------------------------------------------------------------------------------
+//! Function selects the method used for buffers.  EMethod::Auto selects the
+//! best method the CPU supports.  Selecting an unsupported method throws an
+//! exception.
+//
+void CModbusCRC::Method(EMethod method) {
+    if (method == EMethod::Auto)
+        method = Best();
+    if (!Supported(method)) {
+        std::string Message("CModbusCRC::Method(): ");
+        Message += MethodName(method);
+        Message += " is not supported.";
+        throw std::runtime_error(Message);
+    }
+    mMethod = method;
 }
 
 //------------------------------------------------------------------------------
 //! Functions adds the specified buffer of bytes to the accumulated CRC.
 //
 void CModbusCRC::Add(const uint8_t *pbuf, uint32_t count) {
-    const uint8_t *pend = pbuf + count;
-    while (pbuf < pend) {
-        uint8_t Iy = static_cast<uint8_t>(mValue ^ *pbuf++);
-        mValue >>= 8;
-        mValue ^= sLookup[Iy];
+    switch (mMethod) {
+    case EMethod::Byte:
+        mValue = CrcByte(mValue, pbuf, count);
+        break;
+    case EMethod::Slice8:
+        mValue = CrcSlice8(mValue, pbuf, count);
+        break;
+#ifdef UTILS_SSE2
+    case EMethod::CLMul:
+        mValue = CrcCLMul(mValue, pbuf, count);
+        break;
+#endif
+    default:
+        mValue = CrcSlice16(mValue, pbuf, count);
+        break;
     }
 }
 
@@ -195,7 +673,50 @@ void CModbusCRC::Add(const uint8_t *pbuf, uint32_t count) {
 void CModbusCRC::Add(uint8_t byte) {
     byte ^= static_cast<uint8_t>(mValue);
     mValue >>= 8;
-    mValue ^= sLookup[byte];
+    mValue ^= sCrc.Table[0][byte];
+}
+
+//------------------------------------------------------------------------------
+//! Function returns the best method the CPU supports.  The answer is
+//! determined on first use and cached.
+//
+CModbusCRC::EMethod CModbusCRC::Best() {
+    static const EMethod sBest = Supported(EMethod::CLMul) ? EMethod::CLMul
+        : EMethod::Slice16;
+    return sBest;
+}
+
+//------------------------------------------------------------------------------
+//! Function returns true if the specified method can run on this CPU.
+//
+bool CModbusCRC::Supported(EMethod method) {
+    switch (method) {
+    case EMethod::Auto:
+    case EMethod::Byte:
+    case EMethod::Slice8:
+    case EMethod::Slice16:
+        return true;
+#ifdef UTILS_SSE2
+    case EMethod::CLMul:
+        return CpuHasCLMul();
+#endif
+    default:
+        return false;
+    }
+}
+
+//------------------------------------------------------------------------------
+//! Function returns the name of the specified method.
+//
+const char *CModbusCRC::MethodName(EMethod method) {
+    switch (method) {
+    case EMethod::Auto:    return "Auto";
+    case EMethod::Byte:    return "Byte";
+    case EMethod::Slice8:  return "Slice8";
+    case EMethod::Slice16: return "Slice16";
+    case EMethod::CLMul:   return "CLMul";
+    }
+    return "?";
 }
 
 //##############################################################################
@@ -227,6 +748,186 @@ uint32_t UtilsTest(std::vector<std::string> &report) {
         }
     }
 
+    // Check conversion of 4 byte sequences and long mixed runs, which take the
+    // vector paths, and rejection of invalid sequences
+    {
+        if (Utf8ToWStr("a\xf0\x9f\x98\x80z\xf4\x8f\xbf\xbf") !=
+            L"a\U0001f600z\U0010ffff") {
+            report.push_back("  Incorrect decoding of 4 byte sequences.");
+            ++NErrors;
+        }
+        if (WStrToUtf8(L"a\U0001f600z\U0010ffff") !=
+            "a\xf0\x9f\x98\x80z\xf4\x8f\xbf\xbf") {
+            report.push_back("  Incorrect encoding of 4 byte sequences.");
+            ++NErrors;
+        }
+        if (WStrToUtf8(std::wstring(1, static_cast<wchar_t>(0xdc00)) + L"a") !=
+            "\xef\xbf\xbd" "a") {
+            report.push_back("  Incorrect encoding of a lone surrogate.");
+            ++NErrors;
+        }
+
+        std::wstring Source;
+        uint32_t Seed = 1;
+        for (size_t Ix = 0; Ix < 4000; ++Ix) {
+            Seed = Seed * 1103515245 + 12345;
+            uint32_t Ch = (Seed >> 8) % 0x10000;
+            if (Seed & 0x40000000)
+                Ch &= 0x7f; // Favor ASCII runs
+            if ((Seed >> 28) == 0)
+                Source += std::wstring(40, L'x');
+            if (Ch >= 0xd800 && Ch < 0xe000)
+                Source += L"\U0001f600";
+            else
+                Source += static_cast<wchar_t>(Ch);
+        }
+        for (size_t Len : { 0, 1, 15, 16, 17, 100, 4000 }) {
+            std::wstring Part(Source, 0, Len);
+            std::string Utf8(WStrToUtf8(Part));
+            if (Utf8ToWStr(Utf8) != Part) {
+                report.push_back("  Mixed text of length " +
+                    std::to_string(Len) + " doesn't survive conversion.");
+                ++NErrors;
+            }
+            try {
+                Utf8Check(Utf8.data(), Utf8.size());
+            }
+            catch (std::runtime_error &) {
+                report.push_back("  Utf8Check(): Error for valid text of "
+                    "length " + std::to_string(Len) + ".");
+                ++NErrors;
+            }
+        }
+
+        static const char *BadStrings[] = {
+            "\x80", "\xc0\x80", "\xe0\x9f\xbf", "\xed\xa0\x80",
+            "\xf0\x8f\xbf\xbf", "\xf4\x90\x80\x80", "\xf8\x88\x80\x80\x80",
+            "abcdefghijklmnop\xe2\x82", "\xe2\x28\xa1",
+        };
+        for (const char *pBad : BadStrings) {
+            try {
+                Utf8ToWStr(pBad);
+                report.push_back("  No error for invalid UTF-8 \"" +
+                    ToUpperHex(static_cast<uint8_t>(*pBad), 2) + "...\".");
+                ++NErrors;
+            }
+            catch (std::runtime_error &e) {
+                if (std::string(e.what()).compare(0, 13, "Utf8ToWStr():") !=
+                    0) {
+                    report.push_back("  Utf8ToWStr(): Error not its own.");
+                    ++NErrors;
+                }
+            }
+            try {
+                Utf8Check(pBad, std::char_traits<char>::length(pBad));
+                report.push_back("  Utf8Check(): No error for \"" +
+                    ToUpperHex(static_cast<uint8_t>(*pBad), 2) + "...\".");
+                ++NErrors;
+            }
+            catch (std::runtime_error &e) {
+                if (std::string(e.what()).compare(0, 12, "Utf8Check():") !=
+                    0) {
+                    report.push_back("  Utf8Check(): Error not its own.");
+                    ++NErrors;
+                }
+            }
+        }
+    }
+
+    // Check that every CRC method gives the standard check value and agrees
+    // with the byte method on buffers of all lengths and alignments
+    {
+        typedef CModbusCRC::EMethod EMethod;
+        static const EMethod Methods[] = {
+            EMethod::Byte, EMethod::Slice8, EMethod::Slice16, EMethod::CLMul
+        };
+        std::vector<uint8_t> Buffer(1100);
+        uint32_t Seed = 7;
+        for (uint8_t &Byte : Buffer) {
+            Seed = Seed * 1103515245 + 12345;
+            Byte = static_cast<uint8_t>(Seed >> 16);
+        }
+        for (EMethod Method : Methods) {
+            if (!CModbusCRC::Supported(Method))
+                continue;
+            std::string MethodName(CModbusCRC::MethodName(Method));
+            CModbusCRC CRC(0xffff, Method);
+            CRC.Add(reinterpret_cast<const uint8_t *>("123456789"), 9);
+            if (CRC.Value() != 0x4b37) {
+                report.push_back("  CModbusCRC " + MethodName +
+                    ": Incorrect check value.");
+                ++NErrors;
+            }
+            for (uint32_t Len = 0; Len <= 1024; Len += (Len < 300) ? 1 : 61) {
+                uint32_t Offset = Len % 13;
+                CModbusCRC Expected(0x1234, EMethod::Byte);
+                CModbusCRC Actual(0x1234, Method);
+                Expected.Add(Buffer.data() + Offset, Len);
+                Actual.Add(Buffer.data() + Offset, Len);
+                if (Actual.Value() != Expected.Value()) {
+                    report.push_back("  CModbusCRC " + MethodName +
+                        ": Incorrect value for length " + std::to_string(Len) +
+                        ".");
+                    ++NErrors;
+                }
+            }
+        }
+    }
+
+    // Check that fingerprints tell apart every prefix of a buffer and every
+    // change of a single bit
+    {
+        std::string Buffer(200, '\0');
+        for (size_t Ix = 0; Ix < Buffer.size(); ++Ix)
+            Buffer[Ix] = static_cast<char>(Ix * 7);
+        std::vector<uint64_t> Fingerprints;
+        for (size_t Len = 0; Len <= Buffer.size(); ++Len)
+            Fingerprints.push_back(Fingerprint64(Buffer.data(), Len));
+        for (size_t Bit = 0; Bit < 8 * 40; ++Bit) {
+            std::string Changed(Buffer, 0, 40);
+            Changed[Bit / 8] ^= static_cast<char>(1 << (Bit % 8));
+            Fingerprints.push_back(Fingerprint64(Changed.data(), 40));
+        }
+        std::sort(Fingerprints.begin(), Fingerprints.end());
+        if (std::adjacent_find(Fingerprints.begin(), Fingerprints.end()) !=
+            Fingerprints.end()) {
+            report.push_back("  Fingerprint64: Duplicate fingerprints.");
+            ++NErrors;
+        }
+    }
+
+    // Check that an index finds the first of equal keys, and every key after
+    // growing, although many hashes collide, and that it finds nothing for a
+    // hash it does not hold.  Check that wide and narrow text hash alike.
+    {
+        std::vector<std::string> Keys;
+        for (size_t Ix = 0; Ix < 1000; ++Ix)
+            Keys.push_back("Key" + std::to_string(Ix % 700));
+        CHashIndex<uint32_t> Index(0xffffffff);
+        for (size_t Ix = 0; Ix < Keys.size(); ++Ix) {
+            const std::string &Key = Keys[Ix];
+            Index.Insert(TextHash(Key.data(), Key.size()) & 0xff,
+                [&](uint32_t other) { return Keys[other] == Key; },
+                [Ix]() { return static_cast<uint32_t>(Ix); });
+        }
+        bool IsFound = (Index.Count() == 700);
+        for (size_t Ix = 0; IsFound && Ix < Keys.size(); ++Ix) {
+            const std::string &Key = Keys[Ix];
+            IsFound = Index.Find(TextHash(Key.data(), Key.size()) & 0xff,
+                [&](uint32_t other) { return Keys[other] == Key; }) ==
+                Ix % 700;
+        }
+        std::wstring Wide(L"Key\x00e9");
+        std::string Narrow("Key\xe9");
+        if (!IsFound ||
+            Index.Find(0x100, [](uint32_t) { return true; }) != 0xffffffff ||
+            TextHash(Wide.data(), Wide.size()) !=
+            TextHash(Narrow.data(), Narrow.size())) {
+            report.push_back("  CHashIndex: Incorrect index.");
+            ++NErrors;
+        }
+    }
+
     // Check Hex conversions
     for (size_t Width = 0; Width <= 8; ++Width) {
         for (size_t Ix = 0; Ix < HexTableLen; ++Ix) {
@@ -2,39 +2,221 @@
 #ifndef UTILS_HPP
 #define UTILS_HPP
 
+#include <cstdint>
+#include <type_traits>
 #include <vector>
 #include <string>
 
 //#############################################################################
 
 std::wstring Utf8ToWStr(const std::string  &utf8);
+std::wstring Utf8ToWStr(const char *putf8, size_t len);
+void         Utf8ToWStr(const char *putf8, size_t len, std::wstring &result);
 std::string  WStrToUtf8(const std::wstring &wstr);
+void         WStrToUtf8(const wchar_t *pwide, size_t len, std::string &result);
+void         Utf8Check(const char *putf8, size_t len);
+
+//------------------------------------------------------------------------------
+//! Function returns the code point at p and advances p past it, combining a
+//! surrogate pair into a single code point.  Lone surrogates and values beyond
+//! U+10FFFF, which UTF-8 cannot represent, become U+FFFD.  Every encoder of
+//! wide text uses it, so all of them replace the same characters.
+//
+inline uint32_t CodePointNext(const wchar_t *&p, const wchar_t *pend) {
+    uint32_t Ch = static_cast<uint32_t>(*p++);
+    if (Ch < 0xd800)
+        return Ch;
+    if (Ch < 0xdc00 && p < pend) { // If high surrogate with something after it
+        uint32_t Low = static_cast<uint32_t>(*p);
+        if (Low >= 0xdc00 && Low < 0xe000) {
+            ++p;
+            return 0x10000 + ((Ch - 0xd800) << 10) + (Low - 0xdc00);
+        }
+    }
+    return (Ch < 0xe000 || Ch > 0x10ffff) ? 0xfffd : Ch;
+}
+
+//------------------------------------------------------------------------------
+//! Function writes a code point returned by CodePointNext() as 1 to 4 bytes of
+//! UTF-8 at putf8, and returns the position following them.  The "magic"
+//! numbers are based on the table for Utf8ToWStr().
+//
+inline char *CodePointPut(uint32_t ch, char *putf8) {
+    if (ch < 0x0080) {
+        *putf8++ = static_cast<char>(ch);
+    }
+    else if (ch < 0x0800) {
+        *putf8++ = static_cast<char>(0xc0 | (ch >> 6));
+        *putf8++ = static_cast<char>(0x80 | (ch & 0x3f));
+    }
+    else if (ch < 0x10000) {
+        *putf8++ = static_cast<char>(0xe0 | (ch >> 12));
+        *putf8++ = static_cast<char>(0x80 | ((ch >> 6) & 0x3f));
+        *putf8++ = static_cast<char>(0x80 | (ch & 0x3f));
+    }
+    else {
+        *putf8++ = static_cast<char>(0xf0 | (ch >> 18));
+        *putf8++ = static_cast<char>(0x80 | ((ch >> 12) & 0x3f));
+        *putf8++ = static_cast<char>(0x80 | ((ch >> 6) & 0x3f));
+        *putf8++ = static_cast<char>(0x80 | (ch & 0x3f));
+    }
+    return putf8;
+}
 
 //#############################################################################
 
 std::string  ToUpperHex(uint32_t value, size_t width = 8);
 std::string  ToLowerHex(uint32_t value, size_t width = 8);
 
+//#############################################################################
+
+uint64_t     Fingerprint64(const char *pdata, size_t len);
+
+//------------------------------------------------------------------------------
+//! Function returns the FNV-1a hash of a string, taking each character as
+//! unsigned.  Every hashed index of text uses it, so a name hashed by one
+//! container may be looked up in another.
+//
+template <typename TChar>
+inline uint32_t TextHash(const TChar *ptext, size_t len) {
+    uint32_t Hash = 2166136261u;
+    for (const TChar *pend = ptext + len; ptext < pend; ++ptext) {
+        Hash ^= static_cast<uint32_t>(
+            static_cast<typename std::make_unsigned<TChar>::type>(*ptext));
+        Hash *= 16777619u;
+    }
+    return Hash;
+}
+
+//#############################################################################
+// CHashIndex
+//#############################################################################
+//! Open addressing hash table of values, such as positions in a container,
+//! each stored with the hash of a key that only the container holds, so that
+//! the caller compares keys.  Slots are probed linearly, and the table is
+//! kept at most half full, doubling in size as it fills, so probe sequences
+//! stay short.  Stored hashes are reused when the table grows.  The value
+//! given on construction marks unused slots and is never stored.
+//#############################################################################
+
+template <typename TValue>
+class CHashIndex {
+public:
+    CHashIndex(TValue empty, size_t firstSize = 16) : mEmpty(empty),
+        mFirstSize(firstSize), mCount(0) {}
+
+    void   Clear() {
+        std::vector<CSlot>().swap(mSlots);
+        mCount = 0;
+    }
+    size_t Count() const { return mCount; }
+    size_t MemoryUsed() const { return mSlots.capacity() * sizeof(CSlot); }
+
+    //--------------------------------------------------------------------------
+    //! Function returns the first value with the specified hash for which
+    //! isMatch(value) is true, or the empty value if there is none.
+    //
+    template <typename TMatch>
+    TValue Find(uint32_t hash, TMatch isMatch) const {
+        if (mSlots.empty())
+            return mEmpty;
+        size_t Mask = mSlots.size() - 1;
+        for (size_t Slot = hash & Mask; ; Slot = (Slot + 1) & Mask) {
+            const CSlot &IndexSlot = mSlots[Slot];
+            if (IndexSlot.Value == mEmpty)
+                return mEmpty;
+            if (IndexSlot.Hash == hash && isMatch(IndexSlot.Value))
+                return IndexSlot.Value;
+        }
+    }
+
+    //--------------------------------------------------------------------------
+    //! Function returns the first value with the specified hash for which
+    //! isMatch(value) is true or, if there is none, stores and returns the
+    //! value returned by make(), which is called only then.
+    //
+    template <typename TMatch, typename TMake>
+    TValue Insert(uint32_t hash, TMatch isMatch, TMake make) {
+        if (2 * (mCount + 1) > mSlots.size())
+            Grow();
+        size_t Mask = mSlots.size() - 1;
+        size_t Slot = hash & Mask;
+        for (; !(mSlots[Slot].Value == mEmpty); Slot = (Slot + 1) & Mask) {
+            const CSlot &IndexSlot = mSlots[Slot];
+            if (IndexSlot.Hash == hash && isMatch(IndexSlot.Value))
+                return IndexSlot.Value;
+        }
+        TValue Value = make();
+        mSlots[Slot].Hash = hash;
+        mSlots[Slot].Value = Value;
+        ++mCount;
+        return Value;
+    }
+
+private:
+    struct CSlot {
+        uint32_t Hash;
+        TValue   Value;
+    };
+
+    TValue             mEmpty;
+    size_t             mFirstSize;  // A power of 2
+    size_t             mCount;
+    std::vector<CSlot> mSlots;
+
+    //--------------------------------------------------------------------------
+    //! Private function doubles the size of the table and reinserts its
+    //! values, reusing their stored hashes.
+    //
+    void Grow() {
+        std::vector<CSlot> Old;
+        Old.swap(mSlots);
+        CSlot Empty = { 0, mEmpty };
+        mSlots.assign(Old.empty() ? mFirstSize : 2 * Old.size(), Empty);
+        size_t Mask = mSlots.size() - 1;
+        for (const CSlot &IndexSlot : Old) {
+            if (IndexSlot.Value == mEmpty)
+                continue;
+            size_t Slot = IndexSlot.Hash & Mask;
+            while (!(mSlots[Slot].Value == mEmpty))
+                Slot = (Slot + 1) & Mask;
+            mSlots[Slot] = IndexSlot;
+        }
+    }
+};
+
 //#############################################################################
 // CModbusCRC
 //#############################################################################
+//! Accumulates a Modbus CRC (CRC-16, polynomial 0xA001 reflected, initial
+//! value 0xFFFF).  Buffers are processed by one of several methods, chosen at
+//! run time according to the capabilities of the CPU or selected explicitly
+//! for benchmarking.  All methods produce identical values.
 //#############################################################################
 
 class CModbusCRC {
     static const uint16_t sInitialValue = 0xffff;
 public:
-    CModbusCRC(uint16_t value = sInitialValue);
+    enum class EMethod { Auto, Byte, Slice8, Slice16, CLMul };
+
+    CModbusCRC(uint16_t value = sInitialValue, EMethod method = EMethod::Auto);
 
     uint16_t Value() const { return mValue; }
     void     Value(uint16_t value) { mValue = value; }
+    EMethod  Method() const { return mMethod; }
+    void     Method(EMethod method);
 
     void Clear() { mValue = sInitialValue; }
     void Add(const uint8_t *pbuf, uint32_t count);
     void Add(uint8_t byte);
 
+    static EMethod     Best();
+    static bool        Supported(EMethod method);
+    static const char *MethodName(EMethod method);
+
 private:
-    static const uint16_t sLookup[];
     uint16_t mValue;
+    EMethod  mMethod;
 };
 
 //#############################################################################
@@ -0,0 +1,75 @@
+#include "stdafx.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include "Utils.hpp"
+#include "Messages.hpp"
+#include "MessagesFile.hpp"
+#include "MessagesHeader.hpp"
+#include "Switches.hpp"
+
+//------------------------------------------------------------------------------
+//! Reads a messages file and writes it as a C++ header of constant tables,
+//! for builds that should not parse the file at run time:
+//!
+//!   MessagesGenerator [-i Messages.txt] [-o Messages.g.hpp] [-n Msg] [-v]
+//
+int main(int argc, char** argv) {
+    static const CSwitchSpec SwitchSpecs[] = {
+        { "-h",    ESwitchID::Help,      0, 0 },
+        { "-?",    ESwitchID::Help,      0, 0 },
+        { "-i",    ESwitchID::Input,     1, 1 },
+        { "-n",    ESwitchID::Namespace, 1, 1 },
+        { "-o",    ESwitchID::Output,    1, 1 },
+        { "-v",    ESwitchID::Verbose,   0, 0 },
+        { nullptr, ESwitchID::None,      0, 0 } // Terminator
+    };
+
+    int ExitCode = 0;
+    CSwitches Switches(SwitchSpecs);
+
+    try {
+        Switches.ExecPath(argv[0]);
+        for (int Ix = 1; Ix < argc; ++Ix)
+            Switches.ItemAdd(argv[Ix]);
+        Switches.Check();
+        if (Switches.Exists(ESwitchID::Help)) {
+            std::cout << "Usage: MessagesGenerator [-i <messages file>] "
+                "[-o <header file>] [-n <namespace>] [-v]" << std::endl;
+            return 0;
+        }
+        if (Switches.Exists(ESwitchID::Verbose))
+            Switches.Show();
+
+        std::string InputFileName("Messages.txt");
+        std::string OutputFileName("Messages.g.hpp");
+        std::string NameSpace("Msg");
+        std::vector<std::string> Parameters;
+        if (Switches.Parameters(ESwitchID::Input, Parameters))
+            InputFileName = Parameters[0];
+        if (Switches.Parameters(ESwitchID::Output, Parameters))
+            OutputFileName = Parameters[0];
+        if (Switches.Parameters(ESwitchID::Namespace, Parameters))
+            NameSpace = Parameters[0];
+        if (CMessagesHeader::Identifier(Utf8ToWStr(NameSpace)) != NameSpace)
+            throw std::runtime_error("Invalid namespace \"" + NameSpace +
+                "\".");
+
+        CMessages Messages;
+        CMessagesFile MessagesFile;
+        MessagesFile.Load(InputFileName, Messages);
+        CMessagesHeader::Save(Messages, OutputFileName, NameSpace);
+        if (Switches.Exists(ESwitchID::Verbose))
+            std::cout << "Wrote " << Messages.MessageCount() << " messages "
+                "to \"" << OutputFileName << "\"." << std::endl;
+    }
+    catch (std::exception &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        ExitCode = -1;
+    }
+
+    return ExitCode;
+}